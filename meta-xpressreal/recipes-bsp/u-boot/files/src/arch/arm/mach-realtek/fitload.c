@@ -0,0 +1,510 @@
+/***********************************************************************
+ *
+ *  fitload.c
+ *
+ *  Streamed FIT loading from a filesystem
+ *
+ *  "fitload" reads an external-data FIT image (mkimage -E) in chunks.
+ *  Each chunk is hashed as it arrives, in the window at <addr> where the
+ *  file would sit after a plain load. Nothing is written to an image's
+ *  load address until its hash has matched: the signature does not cover
+ *  data-size, so unverified data must stay inside the file window. LZ4
+ *  frames are then decompressed with stored blocks handed to the MD
+ *  engine, other compression types go through image_decomp() and
+ *  uncompressed images are copied to their load address.
+ *
+ *  The configuration signature is checked on the FIT header before any
+ *  image data is read, so a hash match on each image is enough to trust
+ *  it. The results are left in ${fit_kernel}, ${fit_fdt} and
+ *  ${fit_initrd}, ready for booti.
+ *
+ ************************************************************************/
+
+/************************************************************************
+ *  Include files
+ ************************************************************************/
+#include <common.h>
+#include <bootstage.h>
+#include <command.h>
+#include <div64.h>
+#include <env.h>
+#include <fs.h>
+#include <hash.h>
+#include <image.h>
+#include <mapmem.h>
+#include <time.h>
+#include <asm/cache.h>
+#include <asm/unaligned.h>
+#include <asm/arch/md.h>
+#include <linux/libfdt.h>
+#include <u-boot/lz4.h>
+
+/************************************************************************
+ *  Definitions
+ ************************************************************************/
+#define FITLOAD_CHUNK		SZ_1M
+#define FITLOAD_HDR_SIZE	SZ_4K
+#define FITLOAD_MD_MIN		SZ_64K
+
+#define LZ4F_MAGIC		0x184D2204
+#define LZ4F_FLG_VERSION(x)	(((x) >> 6) & 0x3)
+#define LZ4F_FLG_INDEP		BIT(5)
+#define LZ4F_FLG_BLK_CSUM	BIT(4)
+#define LZ4F_FLG_SIZE		BIT(3)
+#define LZ4F_FLG_DICT_ID	BIT(0)
+#define LZ4F_BLK_RAW		BIT(31)
+
+enum {
+	FITLOAD_BS_READ = BOOTSTAGE_ID_USER + 16,
+	FITLOAD_BS_HASH,
+	FITLOAD_BS_DECOMP,
+};
+
+enum lz4s_state {
+	LZ4S_HEADER,
+	LZ4S_BLOCKS,
+	LZ4S_DONE,
+};
+
+struct lz4s {
+	enum lz4s_state state;
+	bool blk_csum;
+	const u8 *in;
+	u8 *out;
+	u8 *out_start;
+	u8 *out_end;
+	int md_cookie;
+};
+
+struct fitload {
+	const char *ifname;
+	const char *dev_part;
+	const char *name;
+	ulong base;
+	loff_t size;
+	void *fit;
+	ulong data_base;
+
+	ulong read_bytes;
+	ulong read_us;
+	ulong hash_us;
+	ulong decomp_us;
+};
+
+/************************************************************************
+ *  Static functions
+ ************************************************************************/
+static void lz4s_copy(struct lz4s *s, void *dst, const void *src, ulong len)
+{
+	int cookie;
+
+	/*
+	 * Stored blocks are left to the MD engine while the next block is
+	 * decompressed. dst must not share a cache line with the output that
+	 * the CPU goes on to write, so unaligned blocks are copied here.
+	 */
+	if (len >= FITLOAD_MD_MIN && IS_ALIGNED((ulong)dst | len, ARCH_DMA_MINALIGN)) {
+		cookie = md_memcpy_async(dst, (void *)src, len);
+		if (cookie >= 0) {
+			s->md_cookie = cookie;
+			return;
+		}
+	}
+
+	memcpy(dst, src, len);
+}
+
+static int lz4s_run(struct lz4s *s, const u8 *end)
+{
+	const u8 *in = s->in;
+	u32 blk, len;
+	int ret;
+
+	if (s->state == LZ4S_HEADER) {
+		u8 flg;
+		int hdr;
+
+		if (end - in < 7)
+			return 0;
+		if (get_unaligned_le32(in) != LZ4F_MAGIC)
+			return -EPROTONOSUPPORT;
+
+		flg = in[4];
+		if (LZ4F_FLG_VERSION(flg) != 1)
+			return -EPROTONOSUPPORT;
+		/* linked blocks would need the previous 64K as a dictionary */
+		if (!(flg & LZ4F_FLG_INDEP))
+			return -EPROTONOSUPPORT;
+		/* so would a preset dictionary, there is none to give */
+		if (flg & LZ4F_FLG_DICT_ID)
+			return -EPROTONOSUPPORT;
+
+		hdr = 7 + ((flg & LZ4F_FLG_SIZE) ? 8 : 0);
+		if (end - in < hdr)
+			return 0;
+
+		s->blk_csum = flg & LZ4F_FLG_BLK_CSUM;
+		in += hdr;
+		s->state = LZ4S_BLOCKS;
+	}
+
+	while (s->state == LZ4S_BLOCKS && end - in >= 4) {
+		blk = get_unaligned_le32(in);
+		if (!blk) {
+			/* end mark; a trailing content checksum is ignored */
+			in += 4;
+			s->state = LZ4S_DONE;
+			break;
+		}
+
+		len = blk & ~LZ4F_BLK_RAW;
+		if (end - in < 4 + (long)len + (s->blk_csum ? 4 : 0))
+			break;
+
+		if (blk & LZ4F_BLK_RAW) {
+			/* incompressible block, a plain copy */
+			if (len > s->out_end - s->out)
+				return -ENOSPC;
+			lz4s_copy(s, s->out, in + 4, len);
+			ret = len;
+		} else {
+			ret = LZ4_decompress_safe((const char *)in + 4, (char *)s->out,
+						  len, s->out_end - s->out);
+			if (ret < 0)
+				return -EINVAL;
+		}
+
+		s->out += ret;
+		in += 4 + len + (s->blk_csum ? 4 : 0);
+	}
+
+	s->in = in;
+	return 0;
+}
+
+static int fitload_copy(void *dst, void *src, ulong len)
+{
+	ulong d = (ulong)dst, s = (ulong)src;
+
+	if (dst == src)
+		return 0;
+
+	/* same rules as lz4s_copy(), and the engine must not see an overlap */
+	if (len >= FITLOAD_MD_MIN && IS_ALIGNED(d | len, ARCH_DMA_MINALIGN) &&
+	    (d + len <= s || s + len <= d))
+		return md_memcpy(dst, src, len) ? -EIO : 0;
+
+	memmove(dst, src, len);
+	return 0;
+}
+
+static int fitload_read(struct fitload *fl, ulong addr, loff_t offset, loff_t len)
+{
+	loff_t actread;
+	ulong start_us;
+	int ret;
+
+	if (fs_set_blk_dev(fl->ifname, fl->dev_part, FS_TYPE_ANY))
+		return -ENODEV;
+
+	bootstage_start(FITLOAD_BS_READ, "fitload_read");
+	start_us = timer_get_us();
+	ret = fs_read(fl->name, addr, offset, len, &actread);
+	fl->read_us += timer_get_us() - start_us;
+	bootstage_accum(FITLOAD_BS_READ);
+
+	if (ret < 0 || actread != len) {
+		printf("fitload: read of 0x%llx bytes at 0x%llx failed\n", len, offset);
+		return -EIO;
+	}
+
+	fl->read_bytes += len;
+	return 0;
+}
+
+static int fitload_header(struct fitload *fl)
+{
+	loff_t len = min_t(loff_t, fl->size, FITLOAD_HDR_SIZE);
+	ulong total;
+	int ret;
+
+	ret = fitload_read(fl, fl->base, 0, len);
+	if (ret)
+		return ret;
+
+	fl->fit = map_sysmem(fl->base, 0);
+	if (fdt_check_header(fl->fit)) {
+		printf("fitload: %s is not a FIT image\n", fl->name);
+		return -EINVAL;
+	}
+
+	total = fdt_totalsize(fl->fit);
+	if (total > fl->size)
+		return -EINVAL;
+	if (total > len) {
+		ret = fitload_read(fl, fl->base + len, len, total - len);
+		if (ret)
+			return ret;
+	}
+
+	if (fit_check_format(fl->fit, total))
+		return -EINVAL;
+
+	fl->data_base = ALIGN(total, 4);
+	return 0;
+}
+
+static int fitload_hash_node(struct fitload *fl, int image, struct hash_algo **algo,
+			     u8 **value, int *value_len)
+{
+	const char *name;
+	const char *algo_name;
+	int noffset;
+
+	fdt_for_each_subnode(noffset, fl->fit, image) {
+		name = fit_get_name(fl->fit, noffset, NULL);
+		if (strncmp(name, FIT_HASH_NODENAME, strlen(FIT_HASH_NODENAME)))
+			continue;
+		if (fit_image_hash_get_algo(fl->fit, noffset, &algo_name) ||
+		    fit_image_hash_get_value(fl->fit, noffset, value, value_len))
+			continue;
+		if (hash_lookup_algo(algo_name, algo) || !(*algo)->hash_init)
+			continue;
+		if (*value_len != (*algo)->digest_size)
+			continue;
+
+		return 0;
+	}
+
+	return -ENOENT;
+}
+
+static int fitload_image(struct fitload *fl, int conf, const char *prop,
+			 ulong *addr, ulong *len)
+{
+	struct hash_algo *algo;
+	struct lz4s lz4 = { 0 };
+	u8 digest[HASH_MAX_DIGEST_SIZE];
+	u8 *value;
+	int image, value_len, offset, size;
+	ulong load, src, done, n, start_us, out_len;
+	void *ctx;
+	u8 comp, type;
+	int ret;
+
+	image = fit_conf_get_prop_node(fl->fit, conf, prop, IH_PHASE_NONE);
+	if (image < 0)
+		return -ENOENT;
+
+	if (!fit_image_get_data_position(fl->fit, image, &offset)) {
+		/* absolute position */
+	} else if (!fit_image_get_data_offset(fl->fit, image, &offset)) {
+		offset += fl->data_base;
+	} else {
+		printf("fitload: %s image has embedded data, use bootm\n", prop);
+		return -EOPNOTSUPP;
+	}
+
+	if (fit_image_get_data_size(fl->fit, image, &size) || offset + size > fl->size)
+		return -EINVAL;
+
+	/* the hash covers the ciphertext, leave decryption to bootm */
+	if (fdt_subnode_offset(fl->fit, image, FIT_CIPHER_NODENAME) >= 0) {
+		printf("fitload: %s image is encrypted, use bootm\n", prop);
+		return -EOPNOTSUPP;
+	}
+	if (fit_image_get_comp(fl->fit, image, &comp))
+		comp = IH_COMP_NONE;
+	fit_image_get_type(fl->fit, image, &type);
+	if (fit_image_get_load(fl->fit, image, &load)) {
+		if (comp != IH_COMP_NONE) {
+			printf("fitload: compressed %s image needs a load address\n", prop);
+			return -EINVAL;
+		}
+		load = fl->base + offset;
+	}
+
+	if (fitload_hash_node(fl, image, &algo, &value, &value_len)) {
+		printf("fitload: %s image has no usable hash\n", prop);
+		return -EPERM;
+	}
+	ret = algo->hash_init(algo, &ctx);
+	if (ret)
+		return ret;
+
+	/* offset + size is inside the file, so this stays in the window */
+	src = fl->base + offset;
+
+	for (done = 0; done < size; done += n) {
+		n = min_t(ulong, size - done, FITLOAD_CHUNK);
+
+		ret = fitload_read(fl, src + done, offset + done, n);
+		if (ret)
+			goto err;
+
+		bootstage_start(FITLOAD_BS_HASH, "fitload_hash");
+		start_us = timer_get_us();
+		ret = algo->hash_update(algo, ctx, map_sysmem(src + done, n), n,
+					done + n == size);
+		fl->hash_us += timer_get_us() - start_us;
+		bootstage_accum(FITLOAD_BS_HASH);
+		if (ret)
+			goto err;
+	}
+
+	ret = algo->hash_finish(algo, ctx, digest, algo->digest_size);
+	if (ret)
+		return ret;
+	if (memcmp(digest, value, value_len)) {
+		printf("fitload: %s %s hash mismatch\n", prop, algo->name);
+		return -EPERM;
+	}
+
+	bootstage_start(FITLOAD_BS_DECOMP, "fitload_decomp");
+	start_us = timer_get_us();
+	out_len = size;
+	if (comp == IH_COMP_NONE) {
+		ret = fitload_copy(map_sysmem(load, size), map_sysmem(src, size), size);
+	} else if (comp == IH_COMP_LZ4) {
+		lz4.md_cookie = -1;
+		lz4.in = map_sysmem(src, size);
+		lz4.out = lz4.out_start = map_sysmem(load, CONFIG_SYS_BOOTM_LEN);
+		lz4.out_end = lz4.out + CONFIG_SYS_BOOTM_LEN;
+
+		ret = lz4s_run(&lz4, lz4.in + size);
+		if (lz4.md_cookie >= 0 && md_wait(lz4.md_cookie) && !ret)
+			ret = -EIO;
+		if (!ret && lz4.state != LZ4S_DONE)
+			ret = -EINVAL;
+		out_len = lz4.out - lz4.out_start;
+	} else {
+		ulong load_end;
+
+		ret = image_decomp(comp, load, src, type, map_sysmem(load, 0),
+				   map_sysmem(src, size), size,
+				   CONFIG_SYS_BOOTM_LEN, &load_end);
+		out_len = load_end - load;
+	}
+	fl->decomp_us += timer_get_us() - start_us;
+	bootstage_accum(FITLOAD_BS_DECOMP);
+	if (ret) {
+		printf("fitload: loading %s to 0x%lx failed %d\n", prop, load, ret);
+		return ret;
+	}
+
+	flush_cache(load, ALIGN(out_len, ARCH_DMA_MINALIGN));
+
+	*addr = load;
+	*len = out_len;
+	return 0;
+
+err:
+	algo->hash_finish(algo, ctx, digest, algo->digest_size);
+	return ret;
+}
+
+static int fitload_run(struct fitload *fl, const char *conf_name)
+{
+	ulong addr, len;
+	char buf[40];
+	int conf, ret;
+
+	ret = fitload_header(fl);
+	if (ret)
+		return ret;
+	bootstage_mark_name(BOOTSTAGE_ID_ALLOC, "fitload_header");
+
+	conf = fit_conf_get_node(fl->fit, conf_name);
+	if (conf < 0) {
+		printf("fitload: no configuration %s\n", conf_name ? conf_name : "(default)");
+		return -ENOENT;
+	}
+
+	if (IS_ENABLED(CONFIG_FIT_SIGNATURE)) {
+		puts("   Verifying configuration ... ");
+		if (fit_config_verify(fl->fit, conf)) {
+			puts("Bad\n");
+			return -EPERM;
+		}
+		puts("OK\n");
+		bootstage_mark_name(BOOTSTAGE_ID_ALLOC, "fitload_conf_verify");
+	}
+
+	ret = fitload_image(fl, conf, FIT_KERNEL_PROP, &addr, &len);
+	if (ret)
+		return ret;
+	env_set_hex("fit_kernel", addr);
+	bootstage_mark_name(BOOTSTAGE_ID_ALLOC, "fitload_kernel");
+
+	ret = fitload_image(fl, conf, FIT_FDT_PROP, &addr, &len);
+	if (ret)
+		return ret;
+	env_set_hex("fit_fdt", addr);
+	bootstage_mark_name(BOOTSTAGE_ID_ALLOC, "fitload_fdt");
+
+	ret = fitload_image(fl, conf, FIT_RAMDISK_PROP, &addr, &len);
+	if (ret == -ENOENT) {
+		env_set("fit_initrd", "-");
+	} else if (ret) {
+		return ret;
+	} else {
+		snprintf(buf, sizeof(buf), "0x%lx:0x%lx", addr, len);
+		env_set("fit_initrd", buf);
+		bootstage_mark_name(BOOTSTAGE_ID_ALLOC, "fitload_ramdisk");
+	}
+
+	return 0;
+}
+
+/************************************************************************
+ *  Implementation : Public functions
+ ************************************************************************/
+static int do_fitload(struct cmd_tbl *cmdtp, int flag, int argc,
+		      char *const argv[])
+{
+	struct fitload fl = { 0 };
+	char name[128];
+	char *conf_name;
+	ulong start_us, us;
+	int ret;
+
+	if (argc < 5)
+		return CMD_RET_USAGE;
+
+	fl.ifname = argv[1];
+	fl.dev_part = argv[2];
+	fl.base = hextoul(argv[3], NULL);
+
+	strlcpy(name, argv[4], sizeof(name));
+	conf_name = strchr(name, '#');
+	if (conf_name)
+		*conf_name++ = '\0';
+	fl.name = name;
+
+	if (fs_set_blk_dev(fl.ifname, fl.dev_part, FS_TYPE_ANY))
+		return CMD_RET_FAILURE;
+	if (fs_size(fl.name, &fl.size) < 0) {
+		printf("fitload: %s not found\n", fl.name);
+		return CMD_RET_FAILURE;
+	}
+
+	start_us = timer_get_us();
+	ret = fitload_run(&fl, conf_name);
+	if (ret)
+		return CMD_RET_FAILURE;
+	us = timer_get_us() - start_us;
+
+	printf("fitload: %lu bytes in %lu ms: read %lu ms (%lu KiB/s), hash %lu ms, decompress %lu ms\n",
+	       fl.read_bytes, us / 1000, fl.read_us / 1000,
+	       fl.read_us ? (ulong)div_u64((u64)fl.read_bytes * 1000000, fl.read_us) >> 10 : 0,
+	       fl.hash_us / 1000, fl.decomp_us / 1000);
+
+	return CMD_RET_SUCCESS;
+}
+
+U_BOOT_CMD(fitload, 5, 0, do_fitload,
+	   "stream, verify and decompress a FIT image from a filesystem",
+	   "<interface> <dev[:part]> <addr> <filename>[#conf]\n"
+	   "    - read an external-data FIT in chunks through <addr>, hashing\n"
+	   "      each image as it arrives and placing it once verified, and\n"
+	   "      set fit_kernel, fit_fdt and fit_initrd for booti");
@@ -186,6 +186,8 @@ int SHA256_hash(unsigned char * src_addr, unsigned int length, unsigned char *ds
 int Verify_SHA256_hash( unsigned char * src_addr, unsigned int length, unsigned char * ref_sha256, unsigned int do_recovery, unsigned char * rsa_key_addr);
 int Verify_SHA256_hash_SMC(unsigned char *src_addr, unsigned int length, unsigned char *ref_sha256, unsigned char *rsa_key_addr, unsigned int hw_padding);
 int MCP_SHA256_hash_hwpadding(unsigned char * src_addr, unsigned int length, unsigned char *dst_addr, unsigned int iv[8], unsigned int hw_padding);
+struct image_cipher_info;
+int image_aes_decrypt_hw(struct image_cipher_info *info, void *data, size_t len);
 void rtk_hexdump( const char * str, void * pBuf, unsigned int length );
 void reverse_signature( unsigned char * pSignature );
 void copy_memory(void *dst, void *src, unsigned int size);
@@ -12,11 +12,33 @@
 /************************************************************************
  *  Definition
  ************************************************************************/
+struct md_sg {
+	void *dst;
+	void *src;
+	unsigned int len;
+};
 
 /************************************************************************
  *  Public functions
  ************************************************************************/
 int md_memcpy(void *dst, void *src, unsigned int len);
+
+/*
+ * Queue copies on the MD engine and return at once. The return value is
+ * a cookie for md_done()/md_wait(), or a negative error. md_done() is 1
+ * once the copy is done, 0 while it is in flight and -EIO if it failed;
+ * md_wait() returns 0 or the error. The caches are handled here: src is
+ * cleaned at queue time and dst is invalidated on completion, so the CPU
+ * must not write to the cache lines at either edge of dst while the copy
+ * is in flight.
+ */
+int md_memcpy_async(void *dst, void *src, unsigned int len);
+int md_memcpy_sg_async(const struct md_sg *sg, unsigned int nents);
+int md_memcpy_2d_async(void *dst, unsigned int dst_pitch, void *src,
+		       unsigned int src_pitch, unsigned int width,
+		       unsigned int height);
+int md_done(int cookie);
+int md_wait(int cookie);
 //void md_flash2mem(void *dst, void *src, UINT32 len);
 
 #endif /* #ifndef MD_H */
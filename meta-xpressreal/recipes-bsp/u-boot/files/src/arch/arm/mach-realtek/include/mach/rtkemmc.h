@@ -695,6 +695,7 @@ void error_handling(unsigned int cmd_idx, unsigned int bIgnore);
 void frequency(unsigned int  fre, unsigned int  div);
 int emmc_send_cmd_get_rsp(unsigned int cmd_idx, unsigned int sd_arg, unsigned int rsp_con, unsigned int crc);
 void switch_speed(UINT8 speed);
+void rtkemmc_show_throughput(void);
 UINT32 check_error(int bIgnore);
 void mmc_show_ext_csd( unsigned char * pext_csd );
 void mmc_show_csd( struct mmc* card );
@@ -19,6 +19,7 @@
 #include <asm/arch/mcp.h>
 #include <asm/arch/io.h>
 #include <linux/delay.h>
+#include <image.h>
 #include <uboot_aes.h>
 
 #define PTR_TO_U32(ptr)		(unsigned int)((unsigned long)(ptr) & 0xFFFFFFFF) // Keeps only lower 32-bit
@@ -165,6 +166,34 @@ int MCP_AES_CBC_decrypt(unsigned char * src_addr, unsigned int length, unsigned
 	return AES_CBC_decrypt(src_addr, length, dst_addr, key, iv, mode);
 }
 
+#if CONFIG_IS_ENABLED(FIT_CIPHER)
+/*
+ * Hook for lib/aes image_aes_decrypt(): decrypt a FIT image in place, the
+ * caller keeps using the ciphered buffer as the output.
+ */
+int image_aes_decrypt_hw(struct image_cipher_info *info, void *data, size_t len)
+{
+	unsigned int key_len = info->cipher->key_len;
+	int ret;
+
+	if (key_len != AES128_KEY_LENGTH && key_len != AES192_KEY_LENGTH &&
+	    key_len != AES256_KEY_LENGTH)
+		return -ENOSYS;
+
+	flush_cache((uintptr_t)info->key, key_len);
+	flush_cache((uintptr_t)data, len);
+	ret = MCP_AES_CBC_decrypt(data, len, data, (unsigned int *)info->key,
+				  (unsigned int *)info->iv, key_len);
+	invalidate_dcache_range((uintptr_t)data, (uintptr_t)data + len);
+	if (ret) {
+		printf("[ERR] %s: mcp decrypt fail(%d)\n", __FUNCTION__, ret);
+		return -EIO;
+	}
+
+	return 0;
+}
+#endif
+
 int AES_CBC_encrypt(unsigned char * src_addr, unsigned int length, unsigned char * dst_addr, unsigned int key[4])
 {
 	t_mcp_descriptor *dscpt;
@@ -647,7 +676,7 @@ static int do_mcp(t_mcp_descriptor *dscpt)
 	int i;
 #endif
 	int res;
-	int count;
+	ulong start;
 
 	if (dscpt == NULL)
 		return -1;
@@ -707,10 +736,10 @@ static int do_mcp(t_mcp_descriptor *dscpt)
 	//rtd_outl(K_MCP_CTRL, 0x3);
 	REG32(MCP_CTRL) = 0x3;
 	sync();
-	count = 0;
+	// busy-poll: a block takes microseconds, sleeping 1ms per poll dominated
+	start = get_timer(0);
 	while ((REG32(MCP_STATUS) & 0x6) == 0) {
-		count++;
-		if (count == 15000) {
+		if (get_timer(start) > 15000) {
 #ifdef MCP_DEBUG
 			printf("%s timeout\n", __FUNCTION__);
 			printf("REG32(MCP_CTRL): 0x%x\n", REG32(MCP_CTRL));
@@ -718,11 +747,10 @@ static int do_mcp(t_mcp_descriptor *dscpt)
 #endif
 			return -3;
 		}
-		mdelay(1);
 	}
 
 #ifdef MCP_DEBUG
-	printf("mcp done counter: 0x%x\n", count);
+	printf("mcp done in %lu ms\n", get_timer(start));
 	printf("MCP status: 0x%x\n", REG32(MCP_STATUS));
 #endif
 
@@ -753,7 +781,12 @@ static t_mcp_descriptor *alloc_mcp_descriptor(void)
 	print_hex(mcp_dscpt_addr);
 	prints("\n");
 #endif
-	mcp_dscpt_addr_base = mcp_dscpt_addr = memalign(256, CP_DSCPT_POOL_SIZE);
+	// allocate the pool once, every hash/cipher call goes through here
+	if (mcp_dscpt_addr_base == NULL) {
+		mcp_dscpt_addr_base = mcp_dscpt_addr = memalign(256, CP_DSCPT_POOL_SIZE);
+		if (mcp_dscpt_addr_base == NULL)
+			return NULL;
+	}
 
 	// check if pool is full (descriptor address overflow)
 	if (mcp_dscpt_addr + sizeof(t_mcp_descriptor) > mcp_dscpt_addr_base + CP_DSCPT_POOL_SIZE) {
@@ -0,0 +1,246 @@
+/***********************************************************************
+ *
+ *  mcp_sha.c
+ *
+ *  SHA hash_algo backend (CONFIG_SHA_HW_ACCEL) on top of the CP module
+ *
+ *  One-shot sha256 runs as a single MCP descriptor with hardware
+ *  padding. Progressive sha256 feeds whole 64-byte blocks with hardware
+ *  padding off, chaining the state through the descriptor IV, and pads
+ *  the last block in software. sha1 is left to the software code.
+ *
+ ************************************************************************/
+
+/************************************************************************
+ *  Include files
+ ************************************************************************/
+#include <common.h>
+#include <command.h>
+#include <div64.h>
+#include <hash.h>
+#include <hw_sha.h>
+#include <malloc.h>
+#include <memalign.h>
+#include <time.h>
+#include <u-boot/sha1.h>
+#include <u-boot/sha256.h>
+#include <asm/cache.h>
+#include <asm/unaligned.h>
+#include <asm/arch/mcp.h>
+
+/************************************************************************
+ *  Definitions
+ ************************************************************************/
+#define MCP_SHA256_BLOCK	64
+
+struct mcp_sha_ctx {
+	unsigned int state[8];
+	u64 total;
+	unsigned int buf_len;
+	int is_sha1;
+#if CONFIG_IS_ENABLED(SHA1)
+	sha1_context sha1;
+#endif
+	/* room for the last block plus padding */
+	u8 buf[2 * MCP_SHA256_BLOCK] __aligned(ARCH_DMA_MINALIGN);
+	u8 digest[ARCH_DMA_MINALIGN] __aligned(ARCH_DMA_MINALIGN);
+};
+
+/************************************************************************
+ *  Static functions
+ ************************************************************************/
+static int mcp_sha256_blocks(struct mcp_sha_ctx *ctx, const u8 *data, unsigned int len)
+{
+	int i;
+
+	if (MCP_SHA256_hash_hwpadding((unsigned char *)data, len, ctx->digest, ctx->state, 0))
+		return -EIO;
+
+	for (i = 0; i < 8; i++)
+		ctx->state[i] = get_unaligned_be32(ctx->digest + i * 4);
+
+	return 0;
+}
+
+/************************************************************************
+ *  Implementation : Public functions
+ ************************************************************************/
+void hw_sha256(const uchar *in_addr, uint buflen, uchar *out_addr, uint chunk_size)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(u8, digest, SHA256_SUM_LEN);
+
+	if (buflen && !MCP_SHA256_hash_hwpadding((unsigned char *)in_addr, buflen, digest, NULL, 1)) {
+		memcpy(out_addr, digest, SHA256_SUM_LEN);
+		return;
+	}
+
+	sha256_csum_wd(in_addr, buflen, out_addr, chunk_size);
+}
+
+#if CONFIG_IS_ENABLED(SHA1)
+void hw_sha1(const uchar *in_addr, uint buflen, uchar *out_addr, uint chunk_size)
+{
+	sha1_csum_wd(in_addr, buflen, out_addr, chunk_size);
+}
+#endif
+
+int hw_sha_init(struct hash_algo *algo, void **ctxp)
+{
+	struct mcp_sha_ctx *ctx;
+
+	ctx = memalign(ARCH_DMA_MINALIGN, sizeof(*ctx));
+	if (!ctx)
+		return -ENOMEM;
+
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->is_sha1 = (algo->digest_size == SHA1_SUM_LEN);
+	if (ctx->is_sha1) {
+#if CONFIG_IS_ENABLED(SHA1)
+		sha1_starts(&ctx->sha1);
+#endif
+	} else {
+		ctx->state[0] = SHA256_H0;
+		ctx->state[1] = SHA256_H1;
+		ctx->state[2] = SHA256_H2;
+		ctx->state[3] = SHA256_H3;
+		ctx->state[4] = SHA256_H4;
+		ctx->state[5] = SHA256_H5;
+		ctx->state[6] = SHA256_H6;
+		ctx->state[7] = SHA256_H7;
+	}
+
+	*ctxp = ctx;
+	return 0;
+}
+
+int hw_sha_update(struct hash_algo *algo, void *ctx, const void *buf,
+		  unsigned int size, int is_last)
+{
+	struct mcp_sha_ctx *c = ctx;
+	const u8 *p = buf;
+	unsigned int n;
+	int ret;
+
+	if (c->is_sha1) {
+#if CONFIG_IS_ENABLED(SHA1)
+		sha1_update(&c->sha1, buf, size);
+#endif
+		return 0;
+	}
+
+	c->total += size;
+
+	/* complete a pending partial block first */
+	if (c->buf_len) {
+		n = min_t(unsigned int, size, MCP_SHA256_BLOCK - c->buf_len);
+		memcpy(c->buf + c->buf_len, p, n);
+		c->buf_len += n;
+		p += n;
+		size -= n;
+		if (c->buf_len < MCP_SHA256_BLOCK)
+			return 0;
+
+		ret = mcp_sha256_blocks(c, c->buf, MCP_SHA256_BLOCK);
+		if (ret)
+			return ret;
+		c->buf_len = 0;
+	}
+
+	/* hash whole blocks straight from the caller's buffer */
+	n = size & ~(MCP_SHA256_BLOCK - 1);
+	if (n) {
+		ret = mcp_sha256_blocks(c, p, n);
+		if (ret)
+			return ret;
+		p += n;
+		size -= n;
+	}
+
+	memcpy(c->buf, p, size);
+	c->buf_len = size;
+
+	return 0;
+}
+
+int hw_sha_finish(struct hash_algo *algo, void *ctx, void *dest_buf, int size)
+{
+	struct mcp_sha_ctx *c = ctx;
+	unsigned int len;
+	int ret = 0;
+
+	if (size < algo->digest_size) {
+		free(ctx);
+		return -1;
+	}
+
+	if (c->is_sha1) {
+#if CONFIG_IS_ENABLED(SHA1)
+		sha1_finish(&c->sha1, dest_buf);
+#endif
+		free(ctx);
+		return 0;
+	}
+
+	len = c->buf_len;
+	c->buf[len++] = 0x80;
+	if (len > MCP_SHA256_BLOCK - 8) {
+		memset(c->buf + len, 0, 2 * MCP_SHA256_BLOCK - len);
+		len = 2 * MCP_SHA256_BLOCK;
+	} else {
+		memset(c->buf + len, 0, MCP_SHA256_BLOCK - len);
+		len = MCP_SHA256_BLOCK;
+	}
+	put_unaligned_be64(c->total << 3, c->buf + len - 8);
+
+	ret = mcp_sha256_blocks(c, c->buf, len);
+	if (!ret)
+		memcpy(dest_buf, c->digest, SHA256_SUM_LEN);
+
+	free(ctx);
+	return ret;
+}
+
+#if !defined(CONFIG_SPL_BUILD) && defined(CONFIG_CMD_HASH)
+static ulong hashbench_run(const char *name, const u8 *buf, uint len, u8 *out,
+			   void (*func)(const uchar *, uint, uchar *, uint))
+{
+	ulong start_us = timer_get_us();
+	ulong us;
+
+	func(buf, len, out, CHUNKSZ_SHA256);
+	us = timer_get_us() - start_us;
+
+	printf("%-4s: %8lu us, %6lu KiB/s\n", name, us,
+	       us ? (ulong)div_u64((u64)len * 1000000, us) >> 10 : 0);
+	return us;
+}
+
+static int do_hashbench(struct cmd_tbl *cmdtp, int flag, int argc,
+			char *const argv[])
+{
+	u8 hw[SHA256_SUM_LEN], sw[SHA256_SUM_LEN];
+	ulong addr;
+	uint len;
+
+	if (argc < 3)
+		return CMD_RET_USAGE;
+
+	addr = hextoul(argv[1], NULL);
+	len = hextoul(argv[2], NULL);
+
+	printf("sha256 over 0x%x bytes at 0x%lx\n", len, addr);
+	hashbench_run("mcp", (const u8 *)addr, len, hw, hw_sha256);
+	hashbench_run("sw", (const u8 *)addr, len, sw, sha256_csum_wd);
+
+	if (memcmp(hw, sw, SHA256_SUM_LEN)) {
+		printf("digest mismatch\n");
+		return CMD_RET_FAILURE;
+	}
+
+	return CMD_RET_SUCCESS;
+}
+
+U_BOOT_CMD(hashbench, 3, 0, do_hashbench,
+	   "compare MCP and software sha256 speed",
+	   "<addr> <len>");
+#endif
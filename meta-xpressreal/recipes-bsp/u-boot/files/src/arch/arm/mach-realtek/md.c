@@ -17,6 +17,8 @@
 #include <asm/io.h>
 #include <asm/arch/rbus/md_reg.h>
 #include <malloc.h>
+#include <time.h>
+#include <asm/cache.h>
 #include <asm/arch/md.h>
 
 
@@ -30,6 +32,19 @@
 #define rtd_outi(offset,val)		(*(volatile unsigned int *)(offset) = val)
 #define rtd_outl(offset,val)		(*(volatile unsigned long *)(offset) = val)
 
+#define MD_CMD_WORDS		4
+#define MD_CMD_BYTES		(MD_CMD_WORDS * sizeof(unsigned int))
+#define MD_CMD_COPY		0x5
+#define MD_RING_CMDS		256
+#define MD_TIMEOUT_MS		1000
+
+#define MD_SMQ_CNTL_STOP	0x6
+#define MD_SMQ_CNTL_GO		0x7
+#define MD_SMQ_CNTL_IDLE	0x8
+#define MD_SMQ_INT_CLEAR	0x3e
+#define MD_SMQ_INT_INST_ERR	0x2
+#define MD_SMQ_INT_LEN_ERR	0x4
+
 /************************************************************************
  *  Public variables
  ************************************************************************/
@@ -38,77 +53,312 @@
 /************************************************************************
  *  Static variables
  ************************************************************************/
-
+/*
+ * The SMQ is fed from one ring that is allocated once. Commands are only
+ * ever appended; when the ring is full it is drained and restarted from
+ * its base. Cookies are the running command count at the end of a
+ * request, so a request is complete once md_done_seq has reached it.
+ * A failure completes everything outstanding and is remembered in
+ * md_err_seq, so those cookies report the error instead of success.
+ */
+static unsigned int *md_ring;
+static unsigned int md_wr;		/* next free slot */
+static unsigned int md_kicked;		/* slots handed to the engine */
+static unsigned int md_retired;		/* slots known to be complete */
+static unsigned int md_seq;		/* commands queued since boot */
+static unsigned int md_done_seq;	/* commands completed since boot */
+static unsigned int md_err_seq;		/* last command lost to a failure */
+static bool md_err;			/* md_err_seq is valid */
 
 /************************************************************************
  *  Static function prototypes
  ************************************************************************/
-unsigned int *allocat_md_cmd(unsigned int num_of_cmd);
 #define CACHELINE_SIZE CONFIG_SYS_CACHELINE_SIZE
 
 /************************************************************************
- *  Implementation : Public functions
+ *  Static functions
  ************************************************************************/
-int md_memcpy(void *dst, void *src, unsigned int len)
+static void md_reset_ring(void)
 {
-	unsigned int *cmd;
-	unsigned int num_of_cmd = len / SS_BLK_LENGTH + 1;
-	unsigned int i, ith_len;
-	unsigned int ith_dst = (unsigned int)(uintptr_t)dst;
-	unsigned int ith_src = (unsigned int)(uintptr_t)src;
+	unsigned int base = (unsigned int)(uintptr_t)md_ring;
+
+	rtd_outi(MD_SMQ_CNTL, MD_SMQ_CNTL_STOP);
+	rtd_outi(MD_SMQ_INT_STATUS, MD_SMQ_INT_CLEAR);
+	rtd_outi(MD_SMQBASE, base);
+	rtd_outi(MD_SMQRDPTR, base);
+	rtd_outi(MD_SMQWRPTR, base);
+	rtd_outi(MD_SMQLIMIT, base + (MD_RING_CMDS + 1) * MD_CMD_BYTES);
+	rtd_outi(MD_SMQ_CNTL, MD_SMQ_CNTL_GO);
+
+	md_wr = md_kicked = md_retired = 0;
+}
+
+/* cookies are 31 bits wide, compare in that space so a wrap is harmless */
+static bool md_seq_reached(unsigned int seq, int cookie)
+{
+	return ((seq - (unsigned int)cookie) & INT_MAX) <= INT_MAX / 2;
+}
+
+static void md_fail(void)
+{
+	md_reset_ring();
+	md_err_seq = md_seq;
+	md_err = true;
+	md_done_seq = md_seq;
+}
 
-	if ((cmd = allocat_md_cmd(num_of_cmd)) == NULL) {
+/* 1 when the request is done, 0 while pending, -EIO if it was lost */
+static int md_status(int cookie)
+{
+	if (md_err && md_seq_reached(md_err_seq, cookie))
+		return -EIO;
 
-		if( (int)(uintptr_t)dst < ARM_ROMCODE_SIZE )
-			printf("Using MD failed.");
-		else
-			memcpy(dst, src, len);	// use memcpy instead...
+	return md_seq_reached(md_done_seq, cookie);
+}
+
+static int md_init(void)
+{
+	if (md_ring)
 		return 0;
+
+	/* one spare slot keeps SMQLIMIT past the last command */
+	md_ring = memalign(ARCH_DMA_MINALIGN, (MD_RING_CMDS + 1) * MD_CMD_BYTES);
+	if (!md_ring) {
+		printf("Can not allocate memory of MD\n");
+		return -ENOMEM;
 	}
 
-	for (i = 0; i < num_of_cmd; i++) {
+	md_reset_ring();
+	return 0;
+}
 
-		ith_len = (len > SS_BLK_LENGTH ? SS_BLK_LENGTH : len);
-		cmd[i*4]   = 0x5;
-		cmd[i*4+1] = ith_dst;
-		cmd[i*4+2] = ith_src;
-		cmd[i*4+3] = ith_len;
-		ith_dst += ith_len;
-		ith_src += ith_len;
-		len -= ith_len;
-	}
+static void md_kick(void)
+{
+	unsigned int base = (unsigned int)(uintptr_t)md_ring;
+
+	if (md_kicked == md_wr)
+		return;
+
+	flush_dcache_range((unsigned long)(md_ring + md_kicked * MD_CMD_WORDS),
+			   ALIGN((unsigned long)(md_ring + md_wr * MD_CMD_WORDS), CACHELINE_SIZE));
 	sync();
-	flush_cache( (unsigned long)(uintptr_t)cmd,4* sizeof(unsigned int)*num_of_cmd);
-
-	rtd_outi(MD_SMQ_CNTL,0x6);
-	rtd_outi(MD_SMQ_INT_STATUS,0x3e);
-	rtd_outi(MD_SMQBASE , (unsigned int)(uintptr_t)cmd);
-	rtd_outi(MD_SMQRDPTR, (unsigned int)(uintptr_t)cmd);
-	rtd_outi(MD_SMQWRPTR,(unsigned int)(uintptr_t)cmd + num_of_cmd * sizeof(unsigned int) * 4);
-	rtd_outi(MD_SMQLIMIT,(rtd_ini(MD_SMQWRPTR) + sizeof(unsigned int) * 4));
-
-	rtd_outi(MD_SMQ_CNTL, 0x7);
-	i = 100000;
-	while (i--) {
-		// check idle
-		if (rtd_ini(MD_SMQ_CNTL) & 0x8)
-			return 0;
-
-		// check error
-		if (rtd_ini(MD_SMQ_INT_STATUS) & 0x2) {
-			printf("[ERROR] opcode error\n");
-			return -1;
+
+	rtd_outi(MD_SMQWRPTR, base + md_wr * MD_CMD_BYTES);
+	rtd_outi(MD_SMQ_CNTL, MD_SMQ_CNTL_GO);
+	md_kicked = md_wr;
+}
+
+/*
+ * Returns 1 once everything kicked so far has completed, 0 while the
+ * engine is still busy and a negative value on an engine error.
+ */
+static int md_poll(void)
+{
+	unsigned int status = rtd_ini(MD_SMQ_INT_STATUS);
+	unsigned long dst, len;
+	unsigned int i;
+
+	if (status & (MD_SMQ_INT_INST_ERR | MD_SMQ_INT_LEN_ERR)) {
+		printf("[ERROR] MD %s error\n",
+		       (status & MD_SMQ_INT_INST_ERR) ? "opcode" : "length");
+		md_fail();
+		return -EIO;
+	}
+
+	if (!(rtd_ini(MD_SMQ_CNTL) & MD_SMQ_CNTL_IDLE))
+		return 0;
+	if (rtd_ini(MD_SMQRDPTR) != rtd_ini(MD_SMQWRPTR)) {
+		rtd_outi(MD_SMQ_CNTL, MD_SMQ_CNTL_GO);
+		return 0;
+	}
+
+	/* drop anything the CPU may have pulled into the cache meanwhile */
+	for (i = md_retired; i < md_kicked; i++) {
+		dst = md_ring[i * MD_CMD_WORDS + 1];
+		len = md_ring[i * MD_CMD_WORDS + 3];
+		invalidate_dcache_range(ALIGN_DOWN(dst, CACHELINE_SIZE),
+					ALIGN(dst + len, CACHELINE_SIZE));
+	}
+
+	md_done_seq += md_kicked - md_retired;
+	md_retired = md_kicked;
+	return 1;
+}
+
+static int md_drain(void)
+{
+	ulong start = get_timer(0);
+	int ret;
+
+	md_kick();
+	while (!(ret = md_poll())) {
+		if (get_timer(start) > MD_TIMEOUT_MS) {
+			printf("[ERROR] MD no response\n");
+			md_fail();
+			return -ETIMEDOUT;
 		}
+	}
+
+	return ret < 0 ? ret : 0;
+}
+
+static int md_push(unsigned long dst, unsigned long src, unsigned int len)
+{
+	unsigned int *cmd;
+	unsigned int n;
+	int ret;
+
+	if ((dst | src | (dst + len) | (src + len)) >> 32)
+		return -EINVAL;
+
+	/* the engine works on DRAM; clean src and keep dst lines out */
+	flush_dcache_range(ALIGN_DOWN(src, CACHELINE_SIZE), ALIGN(src + len, CACHELINE_SIZE));
+	flush_dcache_range(ALIGN_DOWN(dst, CACHELINE_SIZE), ALIGN(dst + len, CACHELINE_SIZE));
 
-		if (rtd_ini(MD_SMQ_INT_STATUS) & 0x4) {
-			printf("[ERROR] length error\n");
-			return -2;
+	while (len) {
+		if (md_wr == MD_RING_CMDS) {
+			ret = md_drain();
+			if (ret)
+				return ret;
+			md_reset_ring();
 		}
+
+		n = len > SS_BLK_LENGTH ? SS_BLK_LENGTH : len;
+		cmd = md_ring + md_wr * MD_CMD_WORDS;
+		cmd[0] = MD_CMD_COPY;
+		cmd[1] = dst;
+		cmd[2] = src;
+		cmd[3] = n;
+		md_wr++;
+		md_seq++;
+
+		dst += n;
+		src += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int md_cookie(void)
+{
+	return md_seq & INT_MAX;
+}
+
+/************************************************************************
+ *  Implementation : Public functions
+ ************************************************************************/
+int md_memcpy_async(void *dst, void *src, unsigned int len)
+{
+	int ret;
+
+	ret = md_init();
+	if (ret)
+		return ret;
+
+	ret = md_push((unsigned long)dst, (unsigned long)src, len);
+	if (ret)
+		return ret;
+
+	md_kick();
+	return md_cookie();
+}
+
+int md_memcpy_sg_async(const struct md_sg *sg, unsigned int nents)
+{
+	unsigned int i;
+	int ret;
+
+	ret = md_init();
+	if (ret)
+		return ret;
+
+	for (i = 0; i < nents; i++) {
+		ret = md_push((unsigned long)sg[i].dst, (unsigned long)sg[i].src, sg[i].len);
+		if (ret)
+			return ret;
+	}
+
+	md_kick();
+	return md_cookie();
+}
+
+int md_memcpy_2d_async(void *dst, unsigned int dst_pitch, void *src,
+		       unsigned int src_pitch, unsigned int width,
+		       unsigned int height)
+{
+	unsigned long d = (unsigned long)dst, s = (unsigned long)src;
+	unsigned int y;
+	int ret;
+
+	/* contiguous rectangles are a single linear copy */
+	if (width == dst_pitch && width == src_pitch)
+		return md_memcpy_async(dst, src, width * height);
+
+	ret = md_init();
+	if (ret)
+		return ret;
+
+	for (y = 0; y < height; y++) {
+		ret = md_push(d, s, width);
+		if (ret)
+			return ret;
+		d += dst_pitch;
+		s += src_pitch;
+	}
+
+	md_kick();
+	return md_cookie();
+}
+
+int md_done(int cookie)
+{
+	int ret;
+
+	if (!md_ring)
+		return 1;
+
+	ret = md_status(cookie);
+	if (ret)
+		return ret;
+
+	md_poll();
+	return md_status(cookie);
+}
+
+int md_wait(int cookie)
+{
+	int ret;
+
+	if (cookie < 0)
+		return cookie;
+	if (!md_ring)
+		return 0;
+
+	ret = md_status(cookie);
+	if (!ret) {
+		ret = md_drain();
+		if (ret)
+			return ret;
+		ret = md_status(cookie);
+	}
+
+	return ret < 0 ? ret : 0;
+}
+
+int md_memcpy(void *dst, void *src, unsigned int len)
+{
+	int cookie;
+
+	cookie = md_memcpy_async(dst, src, len);
+	if (cookie < 0) {
+		printf("Using MD failed (%d)\n", cookie);
+		return cookie;
 	}
-	printf("[ERROR] MD no response\n");
 
-	return -1;
+	return md_wait(cookie);
 }
+
 /*
 void md_flash2mem(void *dst, void *src, UINT32 len)
 {
@@ -136,21 +386,3 @@ void md_flash2mem(void *dst, void *src, UINT32 len)
 	if (remain)
 		memcpy(dst + (len - remain), src + (len - remain), remain);
 }*/
-
-unsigned int *allocat_md_cmd(unsigned int num_of_cmd)
-{
-	unsigned int *cmd;
-	unsigned int num_of_bytes = 4 * sizeof(unsigned int) * num_of_cmd;
-
-
-        cmd = (unsigned int*)memalign(16,num_of_bytes);
-        if (!cmd) {
-            printf("Can not allocate memory of MD\n");
-            free(cmd);
-            return NULL;
-        }
-
-	memset(cmd, 0, num_of_bytes);
-
-	return cmd;
-}
@@ -19,6 +19,8 @@
 #include <image.h>
 #include <boot_fit.h>
 #include <malloc.h>
+#include <asm/io.h>
+#include <asm/arch/rbus/iso_reg.h>
 
 #ifdef CONFIG_SPL_BUILD
 
@@ -149,7 +151,22 @@ void spl_perform_fixups(struct spl_image_info *spl_image) {
 	if (!blob || (fdt_magic(blob) != FDT_MAGIC))
 		return;
 
+#if CONFIG_IS_ENABLED(OS_BOOT)
+	/* falcon: Linux gets the args blob prepared by "spl export fdt" */
+	if (spl_image->os == IH_OS_LINUX) {
+		void *args = (void *)CONFIG_SPL_PAYLOAD_ARGS_ADDR;
+
+		if (fdt_magic(args) == FDT_MAGIC)
+			spl_image->arg = args;
+		else
+			spl_image->arg = blob;
+	}
+#endif
+
 # if CONFIG_IS_ENABLED(MULTI_DTB_FIT) && defined(CONFIG_OF_LIBFDT_OVERLAY)
+	if (spl_image->os == IH_OS_LINUX)
+		goto fit_images;
+
 	cfg_board_name = "cipher";
 	dtbo = locate_dtb_in_fit(gd->multi_dtb_fit);
 	cfg_board_name = NULL;
@@ -164,6 +181,8 @@ void spl_perform_fixups(struct spl_image_info *spl_image) {
 		if (dtbo && fdt_magic(dtbo) == FDT_MAGIC)
 			fdt_overlay_apply_verbose((void *)blob, dtbo);
 	}
+
+fit_images:
 #endif
 
 	offset = fdt_subnode_offset(blob, 0, "fit-images");
@@ -213,8 +232,15 @@ int cmd_bl31_fw(uint idx)
 }
 #endif
 
+#if defined(CONFIG_TARGET_RTD1619B) && defined(CONFIG_RTK_MMC_DRIVER)
+extern void rtkemmc_show_throughput(void);
+#endif
+
 void spl_board_prepare_for_boot(void)
 {
+#if defined(CONFIG_TARGET_RTD1619B) && defined(CONFIG_RTK_MMC_DRIVER)
+	rtkemmc_show_throughput();
+#endif
 #if defined(CONFIG_TARGET_RTD1319)
 	cmd_bl31_pcpu();
 #else
@@ -223,6 +249,59 @@ void spl_board_prepare_for_boot(void)
 #endif
 }
 
+#if CONFIG_IS_ENABLED(OS_BOOT)
+/*
+ * Falcon mode attempts are counted in a no-reset ISO register: a magic
+ * in the upper half and the count in the lower half. Linux clears it
+ * once the system is up; too many unconfirmed attempts, a key on the
+ * console or a secure boot drop back to U-Boot proper. "falcon_prepare"
+ * in U-Boot also clears it.
+ */
+#define FALCON_COUNT_REG	ISO_NORST_6
+#define FALCON_COUNT_MAGIC	0xFA1C0000
+#define FALCON_COUNT_LIMIT	3
+
+static u32 falcon_count(void)
+{
+	u32 val = readl(FALCON_COUNT_REG);
+
+	return (val & 0xffff0000) == FALCON_COUNT_MAGIC ? val & 0xffff : 0;
+}
+
+int spl_start_uboot(void)
+{
+	/* the MMC boot list asks several times, keep the first answer */
+	static int start_uboot = -1;
+	u32 count;
+
+	if (start_uboot >= 0)
+		return start_uboot;
+
+	start_uboot = 1;
+	count = falcon_count();
+
+	if (rtk_is_secure_boot()) {
+		debug("SPL: secure boot, no falcon\n");
+	} else if (tstc()) {
+		getchar();
+		puts("SPL: key pressed, loading U-Boot\n");
+	} else if (count >= FALCON_COUNT_LIMIT) {
+		printf("SPL: %u unconfirmed falcon boots, loading U-Boot\n", count);
+	} else {
+		start_uboot = 0;
+	}
+
+	return start_uboot;
+}
+
+void spl_board_prepare_for_linux(void)
+{
+	writel(FALCON_COUNT_MAGIC | (falcon_count() + 1), FALCON_COUNT_REG);
+
+	spl_board_prepare_for_boot();
+}
+#endif
+
 #if defined(CONFIG_TARGET_RTD1619B)
 int fdtdec_board_setup(const void *fdt_blob) {
 	int ret = 0;
@@ -19,6 +19,7 @@
 #include <asm/arch/rbus/crt_reg.h>
 #include <asm/arch/cpu.h>
 #include <linux/io.h>
+#include <time.h>
 #include "rtkemmc_generic.h"
 #define __RTKEMMC_C__
 
@@ -35,8 +36,22 @@ struct rtk_mmc_plat {
 	struct mmc mmc;
 };
 
+/* read throughput, reported once before SPL hands over */
+static u64 rd_bytes;
+static u64 rd_us;
+
+/* last good HS200 phases, re-checked instead of a full sweep on re-init */
+static struct {
+	int valid;
+	u32 tx, rx;
+	u32 drv[4];
+} tuning_cache;
+static u32 cur_drv[4];
+
 void wait_done(volatile UINT32 *addr, UINT32 mask, UINT32 value, unsigned int cmd){
-	int n = 0;
+	/* busy-poll, a 1ms sleep per check used to dominate short transfers */
+	ulong start = get_timer(0);
+
 	while (1)
 	{
 		if(((*addr) &mask) == value)
@@ -46,14 +61,13 @@ void wait_done(volatile UINT32 *addr, UINT32 mask, UINT32 value, unsigned int cm
                         break;
                 }
 
-		if(n++ > 3000)
+		if(get_timer(start) > 3000)
 		{
 			printf("Time out \n");
 			printf("%s: cmd_idx=%d, addr=0x%08x, mask=0x%08x, value=0x%08x, pad_mux=0x%x, 0x98012030=0x%x, 0x98012032=0x%x\n",
                                 __func__, cmd, PTR_U32(addr), mask, value, readl(0x9804e000), readw(EMMC_NORMAL_INT_STAT_R), readw(EMMC_ERROR_INT_STAT_R));
 			return;
 		}
-		mdelay(1);
 	}
 }
 
@@ -493,7 +507,8 @@ void print_ip_desc(void)
 	printf("0x98012058 EMMC EMMC_ADMA_SA_LOW_R = 0x%08x\n------------------------------>\n", readl(EMMC_ADMA_SA_LOW_R));
 }
 
-void make_ip_des(UINT32 dma_addr, UINT32 dma_length)
+/* returns the size of the descriptors written, in bytes */
+UINT32 make_ip_des(UINT32 dma_addr, UINT32 dma_length)
 {
 	UINT32* des_base = rw_descriptor;
 	UINT32  blk_cnt;
@@ -549,6 +564,8 @@ void make_ip_des(UINT32 dma_addr, UINT32 dma_length)
 		CP15ISB;
 		sync();
 	}
+
+	return (des_base - rw_descriptor) * sizeof(UINT32);
 }
 
 static void rtkemmc_read_rsp(u32 *rsp, int reg_count)
@@ -1153,6 +1170,7 @@ int rtkemmc_Stream_Cmd( struct rtk_cmd_info * cmd_info, unsigned int bIgnore)
 	UINT32  cur_blk_addr = cmd_info->cmd->cmdarg;
 
 	u8* data = (unsigned char *) cmd_info->data->dest;
+	ulong start_us = timer_get_us();
 
 	if (data == NULL){
 		ret_err = -1;
@@ -1186,6 +1204,11 @@ int rtkemmc_Stream_Cmd( struct rtk_cmd_info * cmd_info, unsigned int bIgnore)
 		cur_blk_addr += cur_blk_cnt;
 		if (ret_err) return -1;
 	}
+
+	if (cmd_idx == MMC_READ_SINGLE_BLOCK || cmd_idx == MMC_READ_MULTIPLE_BLOCK) {
+		rd_bytes += (u64)block_count << 9;
+		rd_us += timer_get_us() - start_us;
+	}
 	//if (cmd_idx == MMC_SEND_EXT_CSD)
 		return 0;
 	//else
@@ -1197,6 +1220,7 @@ int rtkemmc_Stream( unsigned int cmd_idx,UINT32 blk_addr, UINT32 dma_addr, UINT3
 	unsigned int read=1;
 	unsigned int  mul_blk=0;
 	unsigned int ret_error = 0;
+	UINT32 des_size;
 
 	writel(readl(EMMC_SWC_SEL)|0x10, EMMC_SWC_SEL);
 	writel(readl(EMMC_SWC_SEL1)&0xffffffef, EMMC_SWC_SEL1);
@@ -1207,7 +1231,7 @@ int rtkemmc_Stream( unsigned int cmd_idx,UINT32 blk_addr, UINT32 dma_addr, UINT3
 	CP15ISB;
 	sync();
 
-	make_ip_des(dma_addr, dma_length);
+	des_size = make_ip_des(dma_addr, dma_length);
 	CP15ISB;
 	sync();
 
@@ -1219,7 +1243,7 @@ int rtkemmc_Stream( unsigned int cmd_idx,UINT32 blk_addr, UINT32 dma_addr, UINT3
 		writew(0x1, EMMC_BLOCKCOUNT_R);
 	else writew((dma_length/0x200), EMMC_BLOCKCOUNT_R);
 
-	rtkemmc_flush_cache((uintptr_t)rw_descriptor, 2 * sizeof(unsigned int) * MAX_DESCRIPTOR_NUM);
+	rtkemmc_flush_cache((uintptr_t)rw_descriptor, des_size);
 	CP15ISB;
 	sync();
 
@@ -1908,6 +1932,11 @@ int rtkemmc_init_setup(struct udevice *dev)
  *******************************************************/
 void rtkemmc_set_pad_driving(unsigned int clk_drv, unsigned int cmd_drv, unsigned int data_drv, unsigned int ds_drv)
 {
+	cur_drv[0] = clk_drv;
+	cur_drv[1] = cmd_drv;
+	cur_drv[2] = data_drv;
+	cur_drv[3] = ds_drv;
+
 	writel((readl(EMMC_ISO_pfunc4)&0xfff81fff)|(clk_drv<<13)|(clk_drv<<16), EMMC_ISO_pfunc4);
 	writel((readl(EMMC_ISO_pfunc5)&0xfffff03f)|(cmd_drv<<6)|(cmd_drv<<9), EMMC_ISO_pfunc5);
 	writel((readl(EMMC_ISO_pfunc6)&0xfff03fff)|(data_drv<<14)|(data_drv<<17), EMMC_ISO_pfunc6);
@@ -2060,6 +2089,30 @@ int search_best(u32 window, u32 range){
 	return window_best;
 }
 
+static int rtkemmc_reuse_tuning(void)
+{
+	int i;
+
+	if (!tuning_cache.valid)
+		return -1;
+
+	rtkemmc_set_pad_driving(tuning_cache.drv[0], tuning_cache.drv[1],
+				tuning_cache.drv[2], tuning_cache.drv[3]);
+	phase(tuning_cache.tx, tuning_cache.rx);
+
+	for (i = 0; i < 3; i++) {
+		if (rtkemmc_send_cmd21() != 0) {
+			tuning_cache.valid = 0;
+			return -1;
+		}
+	}
+
+	printf("reuse tuning TX=0x%x RX=0x%x\n", tuning_cache.tx, tuning_cache.rx);
+	writel(readl(EMMC_OTHER1)&0xfffffffe, EMMC_OTHER1);        //enable L4 gated after HS200 finished
+
+	return 0;
+}
+
 int rtkemmc_execute_tuning(struct udevice *dev, u8 opcode){
 //int mmc_Tuning_HS200(void) {
 	volatile UINT32 TX_window=0xffffffff;
@@ -2071,6 +2124,9 @@ int rtkemmc_execute_tuning(struct udevice *dev, u8 opcode){
 	int loop_cnt = 0;
 	int j;
 
+	if (!rtkemmc_reuse_tuning())
+		return 0;
+
 	rtkemmc_set_pad_driving(0x2, 0x2, 0x2, 0x2);
 	phase(0, 0);	//VP0, VP1 phas
 
@@ -2189,10 +2245,24 @@ tx1_retry:
 	phase(TX_best, 0xff);
 	writel(readl(EMMC_OTHER1)&0xfffffffe, EMMC_OTHER1);        //enable L4 gated after HS200 finished
 
+	tuning_cache.tx = TX_best;
+	tuning_cache.rx = RX_best;
+	memcpy(tuning_cache.drv, cur_drv, sizeof(cur_drv));
+	tuning_cache.valid = 1;
+
 	return 0;
 }
 #endif
 
+void rtkemmc_show_throughput(void)
+{
+	if (!rd_us)
+		return;
+
+	printf("eMMC: %llu bytes read in %llu us (%llu KiB/s)\n", rd_bytes, rd_us,
+	       (rd_bytes * 1000000 / rd_us) >> 10);
+}
+
 int mmc_Select_SDR50_Push_Sample(void){
 	frequency(0xa6, 0x4);
 	rtkemmc_set_pad_driving(0x0, 0x0, 0x0, 0x0);
@@ -2373,7 +2443,8 @@ void rtk_mmc_config_setup(const char *name, struct mmc_config *cfg)
 	cfg->voltages = MMC_VDD_32_33 | MMC_VDD_33_34 | MMC_VDD_165_195;
 	cfg->f_min = 400000;
 	cfg->f_max = 50000000;
-	cfg->b_max = 256; // max transfer block size
+	/* one command covers the table, less one entry for a 128MB boundary split */
+	cfg->b_max = (MAX_DESCRIPTOR_NUM - 1) * EMMC_MAX_SCRIPT_BLK;
 	cfg->part_type = PART_TYPE_UNKNOWN;
 }
 
@@ -12,6 +12,7 @@
 #include <linux/of_address.h>
 #include <linux/of_gpio.h>
 #include <linux/reset.h>
+#include <linux/ktime.h>
 
 #include <linux/ahci_platform.h>
 #include "ahci.h"
@@ -28,6 +29,10 @@
 #define SRAM_SHARE		BIT(0)
 #define CLEAR_ERR		BIT(2)
 
+/* resume polling starts short and backs off to the old fixed period */
+#define RTK_SATA_RETRY_MIN_MS	50
+#define RTK_SATA_RETRY_MAX_MS	2000
+
 enum host_state {
 	INITIAL = 0,
 	SUSPEND,
@@ -37,6 +42,9 @@ enum host_state {
 
 struct rtk_ahci_port {
 	struct reset_control *rst;
+	bool ready;
+	s64 link_us;
+	s64 ready_us;
 };
 
 struct rtk_ahci_priv {
@@ -48,6 +56,13 @@ struct rtk_ahci_priv {
 
 	enum host_state state;
 	unsigned int hostinit;
+
+	ktime_t resume_start;
+	s64 power_us;
+	s64 ctrl_us;
+	s64 host_us;
+	unsigned int retry_ms;
+	unsigned int retries;
 };
 
 static const struct ata_port_info ahci_port_info = {
@@ -78,19 +93,90 @@ static void rtk_sata_init(struct ahci_host_priv *hpriv, unsigned int port)
 				   MAC_PORT1_EN , MAC_PORT1_EN);
 }
 
+/* switch the drive power of every port together so the drives spin up in parallel */
+static void rtk_sata_set_power(struct device *dev, bool on)
+{
+	struct device_node *child;
+	struct gpio_desc *powerio;
+
+	for_each_available_child_of_node(dev->of_node, child) {
+		powerio = fwnode_gpiod_get_index(of_fwnode_handle(child), "sata", 0,
+						 on ? GPIOD_OUT_HIGH : GPIOD_OUT_LOW,
+						 child->name);
+		if (!IS_ERR(powerio))
+			gpiod_put(powerio);
+	}
+}
+
+static void rtk_sata_port_ready(struct rtk_ahci_priv *priv, struct ata_port *ap,
+				int i, bool online)
+{
+	struct rtk_ahci_port *port = priv->ports[i];
+	char port_env[16], spd_env[16];
+	char *envp[] = { "SATA_LINK=up", port_env, spd_env, NULL };
+	u32 sstatus = 0;
+
+	port->ready = true;
+	port->ready_us = ktime_us_delta(ktime_get(), priv->resume_start);
+
+	if (!online)
+		return;
+
+	sata_scr_read(&ap->link, SCR_STATUS, &sstatus);
+	snprintf(port_env, sizeof(port_env), "SATA_PORT=%d", i);
+	snprintf(spd_env, sizeof(spd_env), "SATA_SPD=%u", (sstatus >> 4) & 0xf);
+	kobject_uevent_env(&priv->dev->kobj, KOBJ_CHANGE, envp);
+}
+
+/* libata still resuming the port, its link state is not settled yet */
+static bool rtk_sata_port_busy(struct ata_port *ap)
+{
+	unsigned long flags;
+	bool busy;
+
+	spin_lock_irqsave(ap->lock, flags);
+	busy = ap->pflags & (ATA_PFLAG_RESUMING | ATA_PFLAG_PM_PENDING |
+			     ATA_PFLAG_EH_PENDING | ATA_PFLAG_EH_IN_PROGRESS);
+	spin_unlock_irqrestore(ap->lock, flags);
+
+	return busy;
+}
+
+/*
+ * Ports are tracked one by one so a port whose drive is back is announced
+ * right away instead of waiting for the slowest one. Only the live link
+ * state counts, what libata cached before suspend says nothing yet.
+ */
 static int rtk_sata_host_resume(struct rtk_ahci_priv *priv)
 {
 	struct ata_host *host = dev_get_drvdata(priv->dev);
 	struct ahci_host_priv *hpriv = host->private_data;
+	struct rtk_ahci_port *port;
 	struct ata_port *ap;
+	bool online;
 	int cnt = 0, i;
 
 	for (i = 0; i < hpriv->nports; i++) {
 		ap = host->ports[i];
-		if (ap->link.sata_spd && ap->scsi_host->shost_state == SHOST_RUNNING)
+		port = priv->ports[i];
+		if (!port || port->ready) {
 			cnt++;
-		else if (!ap->link.sata_spd)
+			continue;
+		}
+
+		online = ata_link_online(&ap->link);
+		if (online && !port->link_us)
+			port->link_us = ktime_us_delta(ktime_get(), priv->resume_start);
+
+		if (rtk_sata_port_busy(ap))
+			continue;
+
+		/* EH may have just finished, look again */
+		online = ata_link_online(&ap->link);
+		if (!online || ap->scsi_host->shost_state == SHOST_RUNNING) {
+			rtk_sata_port_ready(priv, ap, i, online);
 			cnt++;
+		}
 	}
 	if (cnt < hpriv->nports)
 		return -1;
@@ -98,6 +184,27 @@ static int rtk_sata_host_resume(struct rtk_ahci_priv *priv)
 	return 0;
 }
 
+static void rtk_sata_resume_report(struct rtk_ahci_priv *priv)
+{
+	struct rtk_ahci_port *port;
+	int i;
+
+	dev_info(priv->dev, "resume: power %lld us, controller %lld us, host %lld us, %u polls\n",
+		 priv->power_us, priv->ctrl_us, priv->host_us, priv->retries);
+
+	for (i = 0; i < priv->hpriv->nports; i++) {
+		port = priv->ports[i];
+		if (!port)
+			continue;
+		if (port->link_us)
+			dev_info(priv->dev, "resume: port%d link up %lld us, ready %lld us\n",
+				 i, port->link_us, port->ready_us);
+		else
+			dev_info(priv->dev, "resume: port%d no link, done %lld us\n",
+				 i, port->ready_us);
+	}
+}
+
 static void rtk_sata_host_ctrl(struct work_struct *work)
 {
 	struct rtk_ahci_priv *priv = container_of(work, struct rtk_ahci_priv, work.work);
@@ -114,10 +221,16 @@ static void rtk_sata_host_ctrl(struct work_struct *work)
 		pr_err("host is running\n");
 		break;
 	case RESUME:
-		if (!rtk_sata_host_resume(priv))
+		priv->retries++;
+		if (!rtk_sata_host_resume(priv)) {
 			priv->state = RUNNING;
-		else
-			schedule_delayed_work(&priv->work, 2*HZ);
+			rtk_sata_resume_report(priv);
+		} else {
+			schedule_delayed_work(&priv->work,
+					      msecs_to_jiffies(priv->retry_ms));
+			priv->retry_ms = min(priv->retry_ms * 2,
+					     (unsigned int)RTK_SATA_RETRY_MAX_MS);
+		}
 		break;
 	case SUSPEND:
 	default:
@@ -136,7 +249,6 @@ static int rtk_ahci_probe(struct platform_device *pdev)
 	struct rtk_ahci_priv *priv;
 	struct rtk_ahci_port *port;
 	unsigned int portid;
-	struct gpio_desc *powerio;
 
 	priv = devm_kzalloc(dev, sizeof(*priv), GFP_KERNEL);
 	if (!priv)
@@ -167,6 +279,8 @@ static int rtk_ahci_probe(struct platform_device *pdev)
 		return -ENOMEM;
 
 	for_each_available_child_of_node(node, child) {
+		struct gpio_desc *powerio;
+
 		port = devm_kzalloc(dev, sizeof(*port), GFP_KERNEL);
 		if (!port)
 			return -ENOMEM;
@@ -175,7 +289,8 @@ static int rtk_ahci_probe(struct platform_device *pdev)
 			if (portid >= RTK_SATA_MAX_PORT)
 				continue;
 
-		powerio = devm_fwnode_gpiod_get(dev, of_fwnode_handle(child), "sata", GPIOD_OUT_HIGH, child->name);
+		powerio = fwnode_gpiod_get_index(of_fwnode_handle(child), "sata", 0,
+						 GPIOD_OUT_HIGH, child->name);
 		if (!IS_ERR(powerio)) {
 			gpiod_put(powerio);
 		} else {
@@ -223,28 +338,30 @@ static int rtk_ahci_suspend(struct device *dev)
 	struct ata_host *host = dev_get_drvdata(dev);
 	struct ahci_host_priv *hpriv = (host) ? host->private_data : NULL;
 	struct rtk_ahci_priv *priv = (hpriv) ? hpriv->plat_data : NULL;
-	struct device_node *child;
-	int rc;
-	struct gpio_desc *powerio;
+	int rc, i;
 
 	if (!host || !hpriv || !priv)
 		return 0;
 
 	dev_info(dev, "Enter %s\n", __func__);
 
-	cancel_delayed_work(&priv->work);
+	cancel_delayed_work_sync(&priv->work);
 	priv->state = SUSPEND;
 
+	for (i = 0; i < hpriv->nports; i++) {
+		if (priv->ports[i] == NULL)
+			continue;
+
+		priv->ports[i]->ready = false;
+		priv->ports[i]->link_us = 0;
+		priv->ports[i]->ready_us = 0;
+	}
+
 	rc = ahci_platform_suspend(dev);
 	if (rc)
 		return rc;
 
-	for_each_available_child_of_node(dev->of_node, child) {
-		powerio = devm_fwnode_gpiod_get(dev, of_fwnode_handle(child), "sata-gpios", GPIOD_OUT_LOW, child->name);
-		if (!IS_ERR(powerio)) {
-			gpiod_put(powerio);
-		}
-	}
+	rtk_sata_set_power(dev, false);
 
 	dev_info(dev, "Exit %s\n", __func__);
 	return 0;
@@ -262,15 +379,21 @@ static int rtk_ahci_resume(struct device *dev)
 	struct ata_host *host = dev_get_drvdata(dev);
 	struct ahci_host_priv *hpriv = (host) ? host->private_data : NULL;
 	struct rtk_ahci_priv *priv = (hpriv) ? hpriv->plat_data: NULL;
-	struct device_node *child;
+	ktime_t t;
 	int rc, i;
-	struct gpio_desc *powerio;
 
 	if (!host || !hpriv || !priv)
 		return 0;
 
 	dev_info(dev, "Enter %s\n", __func__);
 
+	priv->resume_start = ktime_get();
+
+	/* drives spin up while the controller and PHYs are brought back */
+	rtk_sata_set_power(dev, true);
+	t = ktime_get();
+	priv->power_us = ktime_us_delta(t, priv->resume_start);
+
 	for (i=0; i<hpriv->nports; i++) {
 		if (priv->ports[i] == NULL)
 			continue;
@@ -283,25 +406,23 @@ static int rtk_ahci_resume(struct device *dev)
 
 	writel((readl(hpriv->mmio + HOST_PORTS_IMPL) | 3),
 		hpriv->mmio + HOST_PORTS_IMPL);
+	priv->ctrl_us = ktime_us_delta(ktime_get(), t);
+	t = ktime_get();
 
 	rc = ahci_platform_resume_host(dev);
 	if (rc)
 		return rc;
+	priv->host_us = ktime_us_delta(ktime_get(), t);
 
 	/* We resumed so update PM runtime state */
 	pm_runtime_disable(dev);
 	pm_runtime_set_active(dev);
 	pm_runtime_enable(dev);
 
-	for_each_available_child_of_node(dev->of_node, child) {
-		powerio = devm_fwnode_gpiod_get(dev, of_fwnode_handle(child), "sata-gpios", GPIOD_OUT_HIGH, child->name);
-		if (!IS_ERR(powerio)) {
-			gpiod_put(powerio);
-		}
-	}
-
 	priv->state = RESUME;
-	schedule_delayed_work(&priv->work, 3*HZ);
+	priv->retries = 0;
+	priv->retry_ms = RTK_SATA_RETRY_MIN_MS;
+	schedule_delayed_work(&priv->work, msecs_to_jiffies(priv->retry_ms));
 
 	dev_info(dev, "Exit %s\n", __func__);
 	return 0;
@@ -9,6 +9,9 @@
 #include <linux/delay.h>
 #include <linux/hw_random.h>
 #include <linux/io.h>
+#include <linux/iopoll.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/of_address.h>
@@ -20,9 +23,19 @@ struct rtd_rng {
 	struct device *dev;
 	void __iomem *base;
 	struct hwrng rng;
+
+	/* reads are serialized by the hwrng core */
+	u64 bytes;
+	u64 busy_ns;
+	u32 reads;
+	u32 empty_waits;
+	u32 timeouts;
+	u32 last_word;
+	u32 rct_fails;
 };
 
-#define MAX_1MS_TO_CNT		1000
+#define RNG_READY_TIMEOUT_US	30000
+#define RNG_RCT_MAX_REPEATS	4
 
 #define TRNG_REG_BASE		0
 
@@ -42,26 +55,98 @@ struct rtd_rng {
 #define RNG_OUT_READY		RNG_RETURN6
 #define RNG_RETURN3		RNG_RETURN0
 
+/*
+ * Drain every word the generator has ready, up to max. Only when nothing
+ * is ready and the caller may block, sleep until the first word shows up.
+ */
 static int rtd_rng_read(struct hwrng *rng, void *buf, size_t max,
 			       bool wait)
 {
 	struct rtd_rng *rtd_rng = container_of(rng, struct rtd_rng, rng);
 	void __iomem *rng_base = (void __iomem *)rtd_rng->base;
-	unsigned int tocnt = 0;
+	u32 *data = buf;
+	size_t words = max / sizeof(u32);
+	size_t n = 0;
+	unsigned int repeats = 0;
+	ktime_t start;
+	u32 ready, val;
+
+	if (!words)
+		return 0;
 
-	while (!(__raw_readl(rng_base + RNG_OUT_READY) & 0x1)) {
-		if (!wait || tocnt++ > MAX_1MS_TO_CNT){
-			pr_err("********%s timeout*********** \n", __func__);
+	start = ktime_get();
+
+	if (!(__raw_readl(rng_base + RNG_OUT_READY) & 0x1)) {
+		if (!wait)
+			return 0;
+		rtd_rng->empty_waits++;
+		if (read_poll_timeout(__raw_readl, ready, ready & 0x1, 20,
+				      RNG_READY_TIMEOUT_US, false,
+				      rng_base + RNG_OUT_READY)) {
+			rtd_rng->timeouts++;
+			dev_err(rtd_rng->dev, "%s timeout\n", __func__);
 			return 0;
 		}
-		udelay(30);
 	}
-	*(u32 *)buf = __raw_readl(rng_base + RNG_RESULTR);
-	pr_debug("%s 0x%x \n", __func__, *(u32*)buf);
 
-	return sizeof(u32);
+	do {
+		val = __raw_readl(rng_base + RNG_RESULTR);
+
+		/*
+		 * Repetition count test: two equal consecutive words are a
+		 * 2^-32 event, treat it as a stuck source and drop the word.
+		 */
+		if (val == rtd_rng->last_word) {
+			rtd_rng->rct_fails++;
+			/* a source stuck with ready set would spin here forever */
+			if (++repeats >= RNG_RCT_MAX_REPEATS) {
+				dev_err_ratelimited(rtd_rng->dev,
+						    "repeated output, source stuck (rct_fails %u)\n",
+						    rtd_rng->rct_fails);
+				break;
+			}
+			continue;
+		}
+		repeats = 0;
+		rtd_rng->last_word = val;
+		data[n++] = val;
+	} while (n < words && (__raw_readl(rng_base + RNG_OUT_READY) & 0x1));
+
+	if (!n && repeats >= RNG_RCT_MAX_REPEATS)
+		return -EIO;
+
+	rtd_rng->reads++;
+	rtd_rng->bytes += n * sizeof(u32);
+	rtd_rng->busy_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	return n * sizeof(u32);
 }
 
+static ssize_t stats_show(struct device *dev, struct device_attribute *attr,
+			  char *buf)
+{
+	struct rtd_rng *rtd_rng = dev_get_drvdata(dev);
+	u64 rate = 0;
+
+	if (rtd_rng->busy_ns)
+		rate = mul_u64_u64_div_u64(rtd_rng->bytes, NSEC_PER_SEC,
+					   rtd_rng->busy_ns);
+
+	return sysfs_emit(buf,
+			  "bytes: %llu\nreads: %u\nthroughput: %llu bytes/s\n"
+			  "empty_waits: %u\ntimeouts: %u\nrct_fails: %u\n",
+			  rtd_rng->bytes, rtd_rng->reads, rate,
+			  rtd_rng->empty_waits, rtd_rng->timeouts,
+			  rtd_rng->rct_fails);
+}
+static DEVICE_ATTR_RO(stats);
+
+static struct attribute *rtd_rng_attrs[] = {
+	&dev_attr_stats.attr,
+	NULL,
+};
+ATTRIBUTE_GROUPS(rtd_rng);
+
 static int rtd13xxd_rng_init(struct hwrng *rng)
 {
 	pr_info("%s \n", __func__);
@@ -200,6 +285,7 @@ static struct platform_driver rtd_rng_driver = {
 	.driver = {
 		.name		= "rtd-rng",
 		.of_match_table	= rtd_rng_of_match,
+		.dev_groups	= rtd_rng_groups,
 #ifdef CONFIG_PM
 		.pm		= &rtd_rng_pm_ops,
 #endif /* CONFIG_PM */
@@ -9,7 +9,9 @@
 #include <linux/clk-provider.h>
 #include <linux/clk.h>
 #include <linux/spinlock.h>
+#include <linux/debugfs.h>
 #include <linux/delay.h>
+#include <linux/ktime.h>
 #include "common.h"
 #include "clk-pll.h"
 
@@ -19,14 +21,32 @@ static inline int __clk_pll_set_oc_en(struct clk_pll *clkp)
 {
 	u32 val;
 	u32 pollval;
+	ktime_t start;
+	int ret;
 
 	val = clk_regmap_read(&clkp->clkr, clkp->ssc_ofs + 0x0);
 	if ((val & 0x7) == 0x5)
 		return 0;
 	clk_regmap_update_bits(&clkp->clkr, clkp->ssc_ofs + 0x0, 0x7, 0x5);
 
-	return regmap_read_poll_timeout(clkp->clkr.regmap, clkp->ssc_ofs + 0x1c,
+	start = ktime_get();
+	ret = regmap_read_poll_timeout(clkp->clkr.regmap, clkp->ssc_ofs + 0x1c,
 		pollval, pollval & BIT(20), 0, 2000);
+
+	clkp->relock_us = ktime_us_delta(ktime_get(), start);
+	if (clkp->relock_us > clkp->relock_max_us)
+		clkp->relock_max_us = clkp->relock_us;
+	return ret;
+}
+
+/* the code is already programmed and locked, e.g. a divider-only change */
+static inline bool __clk_pll_ssc_is_set(struct clk_pll *clkp, u32 mask, u32 val)
+{
+	u32 ctl = clk_regmap_read(&clkp->clkr, clkp->ssc_ofs + 0x0);
+	u32 cur = clk_regmap_read(&clkp->clkr, clkp->ssc_ofs + 0x4);
+	u32 st = clk_regmap_read(&clkp->clkr, clkp->ssc_ofs + 0x1c);
+
+	return (ctl & 0x7) == 0x5 && (st & BIT(20)) && (cur & mask) == (val & mask);
 }
 
 static inline int __clk_pll_set_pow_on_common(struct clk_pll *clkp)
@@ -172,6 +192,9 @@ static inline int __clk_pll_freq_set(struct clk_pll *clkp, u32 val)
 		break;
 
 	case CLK_PLL_TYPE_NF_SSC:
+		if (__clk_pll_ssc_is_set(clkp, mask, val))
+			break;
+
 		clk_regmap_update_bits(&clkp->clkr, clkp->ssc_ofs + 0x0, 0x7, 0x4);
 		clk_regmap_update_bits(&clkp->clkr, clkp->ssc_ofs + 0x4, mask, val);
 
@@ -398,6 +421,17 @@ static int clk_pll_div_set_rate(struct clk_hw *hw, unsigned long rate,
 	return ret;
 }
 
+static void clk_pll_debug_init(struct clk_hw *hw, struct dentry *dentry)
+{
+	struct clk_pll *clkp = to_clk_pll(hw);
+
+	if (clkp->pll_type != CLK_PLL_TYPE_NF_SSC)
+		return;
+
+	debugfs_create_u32("relock_us", 0444, dentry, &clkp->relock_us);
+	debugfs_create_u32("relock_max_us", 0644, dentry, &clkp->relock_max_us);
+}
+
 const struct clk_ops clk_pll_ops = {
 	.round_rate       = clk_pll_round_rate,
 	.recalc_rate      = clk_pll_recalc_rate,
@@ -406,6 +440,7 @@ const struct clk_ops clk_pll_ops = {
 	.disable          = clk_pll_disable,
 	.disable_unused   = clk_pll_disable_unused,
 	.is_enabled       = clk_pll_is_enabled,
+	.debug_init       = clk_pll_debug_init,
 };
 EXPORT_SYMBOL_GPL(clk_pll_ops);
 
@@ -422,5 +457,6 @@ const struct clk_ops clk_pll_div_ops = {
 	.disable          = clk_pll_disable,
 	.disable_unused   = clk_pll_disable_unused,
 	.is_enabled       = clk_pll_is_enabled,
+	.debug_init       = clk_pll_debug_init,
 };
 EXPORT_SYMBOL_GPL(clk_pll_div_ops);
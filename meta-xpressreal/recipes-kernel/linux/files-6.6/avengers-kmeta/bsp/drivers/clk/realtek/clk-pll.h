@@ -40,6 +40,10 @@ struct clk_pll {
 	spinlock_t *lock;
 
 	u32 flags;
+
+	/* time taken by the last and the slowest ssc relock */
+	u32 relock_us;
+	u32 relock_max_us;
 };
 
 #define to_clk_pll(_hw) container_of(to_clk_regmap(_hw), struct clk_pll, clkr)
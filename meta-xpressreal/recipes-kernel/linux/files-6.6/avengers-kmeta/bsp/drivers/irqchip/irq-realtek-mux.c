@@ -6,17 +6,20 @@
  *
  */
 
+#include <linux/debugfs.h>
 #include <linux/err.h>
 #include <linux/init.h>
 #include <linux/io.h>
 #include <linux/irqchip.h>
 #include <linux/irqchip/chained_irq.h>
 #include <linux/irqdomain.h>
+#include <linux/ktime.h>
 #include <linux/mfd/syscon.h>
 #include <linux/of_address.h>
 #include <linux/of_irq.h>
 #include <linux/of_device.h>
 #include <linux/regmap.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 
 #define RTK_MUX_IRQ_ALWAYS_ENABLED  (-1)
@@ -55,11 +58,36 @@ struct realtek_irq_mux_subset_data {
 	int parent_irq;
 };
 
+/**
+ * struct realtek_irq_mux_stats
+ *
+ * @count: number of times the child handler was called
+ * @total_ns: time spent from demux entry to handler return
+ * @max_ns: worst case of the above
+ */
+struct realtek_irq_mux_stats {
+	u64 count;
+	u64 total_ns;
+	u64 max_ns;
+};
+
+/**
+ * struct realtek_irq_mux_data
+ *
+ * @virq: hwirq to virq cache, kept in sync by the domain map/unmap ops
+ * @stats: per child statistics, only touched by the subset owning the bit
+ * @stats_enable: also measure handler latency, not only count
+ */
 struct realtek_irq_mux_data {
 	struct regmap *base;
 	const struct realtek_irq_mux_info *info;
 	struct irq_domain *domain;
 	spinlock_t lock;
+	unsigned int virq[32];
+	struct realtek_irq_mux_stats stats[32];
+	u64 spurious;
+	bool stats_enable;
+	struct dentry *debugfs;
 	int subset_data_num;
 	struct realtek_irq_mux_subset_data subset_data[0];
 };
@@ -72,9 +100,10 @@ static unsigned int realtek_mux_irq_get_ints(struct realtek_irq_mux_data *data)
 	return val;
 }
 
-static void realtek_mux_irq_clear_ints_bit(struct realtek_irq_mux_data *data, int bit)
+/* bit 0 is the write-data bit, writing the others with it cleared acks them */
+static void realtek_mux_irq_clear_ints(struct realtek_irq_mux_data *data, u32 bits)
 {
-	regmap_write(data->base, data->info->isr_offset, BIT(bit) & ~1);
+	regmap_write(data->base, data->info->isr_offset, bits & ~1);
 }
 
 static unsigned int realtek_mux_irq_get_inte(struct realtek_irq_mux_data *data)
@@ -89,16 +118,44 @@ static unsigned int realtek_mux_irq_get_inte(struct realtek_irq_mux_data *data)
 	return val;
 }
 
+static void realtek_mux_irq_dispatch(struct realtek_irq_mux_data *data, int hwirq,
+				     ktime_t entry)
+{
+	struct realtek_irq_mux_stats *st = &data->stats[hwirq];
+	unsigned int virq = READ_ONCE(data->virq[hwirq]);
+	u64 ns;
+
+	if (!virq) {
+		data->spurious++;
+		return;
+	}
+
+	generic_handle_irq(virq);
+
+	st->count++;
+	if (!entry)
+		return;
+
+	ns = ktime_to_ns(ktime_sub(ktime_get(), entry));
+	st->total_ns += ns;
+	if (ns > st->max_ns)
+		st->max_ns = ns;
+}
+
 static void realtek_mux_irq_handle(struct irq_desc *desc)
 {
 	struct realtek_irq_mux_subset_data *subset_data = irq_desc_get_handler_data(desc);
 	struct realtek_irq_mux_data *data = subset_data->common;
 	struct irq_chip *chip = irq_desc_get_chip(desc);
-	u32 ints, inte, mask;
+	ktime_t entry = 0;
+	u32 ints, inte, mask, handled = 0;
 	int i;
 
 	chained_irq_enter(chip, desc);
 
+	if (data->stats_enable)
+		entry = ktime_get();
+
 	ints = realtek_mux_irq_get_ints(data) & subset_data->cfg->ints_mask;
 	inte = realtek_mux_irq_get_inte(data);
 
@@ -111,10 +168,14 @@ static void realtek_mux_irq_handle(struct irq_desc *desc)
 		if (mask != RTK_MUX_IRQ_ALWAYS_ENABLED && !(inte & mask))
 			continue;
 
-		generic_handle_irq(irq_find_mapping(data->domain, i));
-		realtek_mux_irq_clear_ints_bit(data, i);
+		realtek_mux_irq_dispatch(data, i, entry);
+		handled |= BIT(i);
 	}
 
+	/* ack everything that was handled with a single write */
+	if (handled)
+		realtek_mux_irq_clear_ints(data, handled);
+
 	chained_irq_exit(chip, desc);
 }
 
@@ -170,9 +231,9 @@ static void realtek_mux_disable_irq(struct irq_data *data)
 	spin_unlock_irqrestore(&mux_data->lock, flags);
 }
 
-static int lookup_parent_irq(struct realtek_irq_mux_data *mux_data, struct irq_data *d)
+static int lookup_parent_hwirq(struct realtek_irq_mux_data *mux_data, irq_hw_number_t hwirq)
 {
-	unsigned int mask = BIT(d->hwirq);
+	unsigned int mask = BIT(hwirq);
 	int i;
 
 	for (i = 0; i < mux_data->subset_data_num; i++)
@@ -182,11 +243,21 @@ static int lookup_parent_irq(struct realtek_irq_mux_data *mux_data, struct irq_d
 	return -EINVAL;
 }
 
+static int lookup_parent_irq(struct realtek_irq_mux_data *mux_data, struct irq_data *d)
+{
+	return lookup_parent_hwirq(mux_data, d->hwirq);
+}
+
+/*
+ * A child follows the parent line of its subset. Children with a line of
+ * their own (uart, rtc, wdt) can be steered independently; the ones sharing
+ * the main line move together, so report where the parent really ended up.
+ */
 static int realtek_mux_set_affinity(struct irq_data *d,
 			const struct cpumask *mask_val, bool force)
 {
 	struct realtek_irq_mux_data *mux_data = irq_data_get_irq_chip_data(d);
-	int irq;
+	int irq, ret;
 	struct irq_chip *chip;
 	struct irq_data *data;
 
@@ -197,11 +268,15 @@ static int realtek_mux_set_affinity(struct irq_data *d,
 	chip = irq_get_chip(irq);
 	data = irq_get_irq_data(irq);
 
-	irq_data_update_effective_affinity(d, cpu_online_mask);
-	if (chip && chip->irq_set_affinity)
-		return chip->irq_set_affinity(data, mask_val, force);
-	else
+	if (!chip || !chip->irq_set_affinity)
 		return -EINVAL;
+
+	ret = chip->irq_set_affinity(data, mask_val, force);
+	if (ret < 0)
+		return ret;
+
+	irq_data_update_effective_affinity(d, irq_data_get_effective_affinity_mask(data));
+	return ret;
 }
 
 static struct irq_chip realtek_mux_irq_chip = {
@@ -222,14 +297,62 @@ static int realtek_mux_irq_domain_map(struct irq_domain *d,
 	irq_set_chip_data(irq, data);
 	irq_set_probe(irq);
 
+	WRITE_ONCE(data->virq[hw], irq);
+
 	return 0;
 }
 
+static void realtek_mux_irq_domain_unmap(struct irq_domain *d, unsigned int irq)
+{
+	struct realtek_irq_mux_data *data = d->host_data;
+	struct irq_data *irqd = irq_domain_get_irq_data(d, irq);
+
+	if (irqd)
+		WRITE_ONCE(data->virq[irqd->hwirq], 0);
+}
+
 static const struct irq_domain_ops realtek_mux_irq_domain_ops = {
 	.xlate	= irq_domain_xlate_onecell,
 	.map	= realtek_mux_irq_domain_map,
+	.unmap	= realtek_mux_irq_domain_unmap,
 };
 
+#ifdef CONFIG_DEBUG_FS
+static int realtek_mux_stats_show(struct seq_file *s, void *unused)
+{
+	struct realtek_irq_mux_data *data = s->private;
+	struct realtek_irq_mux_stats *st;
+	int i, parent;
+
+	seq_puts(s, "hwirq  virq  parent       count    avg_ns    max_ns\n");
+	for (i = 0; i < 32; i++) {
+		if (!data->virq[i])
+			continue;
+
+		st = &data->stats[i];
+		parent = lookup_parent_hwirq(data, i);
+		seq_printf(s, "%5d %5u %7d %11llu %9llu %9llu\n", i, data->virq[i],
+			   parent, st->count,
+			   st->count ? div64_u64(st->total_ns, st->count) : 0,
+			   st->max_ns);
+	}
+	seq_printf(s, "spurious: %llu\n", data->spurious);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(realtek_mux_stats);
+
+static void realtek_mux_debugfs_init(struct device *dev, struct realtek_irq_mux_data *data)
+{
+	data->debugfs = debugfs_create_dir(dev_name(dev), NULL);
+	debugfs_create_bool("stats_enable", 0644, data->debugfs, &data->stats_enable);
+	debugfs_create_file("stats", 0444, data->debugfs, data, &realtek_mux_stats_fops);
+}
+#else
+static inline void realtek_mux_debugfs_init(struct device *dev,
+					    struct realtek_irq_mux_data *data) {}
+#endif
+
 enum rtd13xx_iso_isr_bits {
 	RTD13XX_ISO_ISR_TC3_SHIFT =		1,
 	RTD13XX_ISO_ISR_UR0_SHIFT =		2,
@@ -879,6 +1002,8 @@ static int realtek_irq_mux_probe(struct platform_device *pdev)
 		WARN(ret, "failed to init subset %d: %d", i, ret);
 	}
 
+	realtek_mux_debugfs_init(dev, data);
+
 	return 0;
 }
 
@@ -29,6 +29,14 @@
 #define HS400_WINDOW_ALL_PASS   0xffff
 #define HS200_WINDOW_ALL_PASS   0xffffffff
 
+/*
+ * Seed for the tuning cache, same format as the tuning_cache attribute:
+ * "<hs200|hs400>,<cid>,<tx>,<rx>,<dqs>,<pad>" entries separated by ';'.
+ */
+static char *tuning_cache;
+module_param(tuning_cache, charp, 0444);
+MODULE_PARM_DESC(tuning_cache, "Known good eMMC tuning phases");
+
 static void dqs_delay_tap_setting(struct dw_mci *host, u32 dqs_dly);
 static void cmd_delay_tap_setting(struct dw_mci *host, u32 cmd_dly_tape);
 static void data_delay_tap_setting(struct dw_mci *host);
@@ -369,6 +377,8 @@ tuning_info_dev_show(struct device *dev, struct device_attribute *attr, char *bu
 	if (ret != 0)
 		goto out;
 
+	/* explicit request, always run the full sweep */
+	priv->tuning_force = true;
 	if (mmc->ios.timing == MMC_TIMING_MMC_HS400) {
 		dw_mci_rtk_hs400_complete(mmc);
 		size = sprintf(buf, "eMMC hs400 tuning finished !!!\n");
@@ -379,6 +389,8 @@ tuning_info_dev_show(struct device *dev, struct device_attribute *attr, char *bu
 		size = sprintf(buf, "This function only supports hs400 or hs200 mode !!!\n");
 	}
 
+	priv->tuning_force = false;
+
 	ret = dw_mci_rtk13xx_restore_from_uda(mmc);
 	if (ret)
 		goto out;
@@ -400,6 +412,97 @@ static ssize_t tuning_info_dev_store(struct device *dev, struct device_attribute
 DEVICE_ATTR(tuning_info, S_IRUGO | S_IWUSR,
 		tuning_info_dev_show, tuning_info_dev_store);
 
+static const char * const tuning_mode_name[DW_MCI_RTK_TUNING_NR] = {
+	[DW_MCI_RTK_TUNING_HS200] = "hs200",
+	[DW_MCI_RTK_TUNING_HS400] = "hs400",
+};
+
+/* parse "<mode>,<cid>,<tx>,<rx>,<dqs>,<pad>" entries separated by ';' */
+static int dw_mci_rtk_tuning_parse(struct dw_mci_rtkemmc_host *priv,
+				   const char *buf)
+{
+	struct dw_mci_rtk_tuning t = {};
+	char mode[6];
+	unsigned int pad;
+	int i;
+
+	while (buf && *buf) {
+		if (sscanf(buf, "%5[^,],%8x%8x%8x%8x,%u,%u,%x,%u", mode,
+			   &t.cid[0], &t.cid[1], &t.cid[2], &t.cid[3],
+			   &t.tx_best, &t.rx_best, &t.dqs, &pad) != 9)
+			return -EINVAL;
+		if (t.tx_best > 0x1f || t.rx_best > 0x1f)
+			return -EINVAL;
+
+		for (i = 0; i < DW_MCI_RTK_TUNING_NR; i++)
+			if (!strcmp(mode, tuning_mode_name[i]))
+				break;
+		if (i == DW_MCI_RTK_TUNING_NR)
+			return -EINVAL;
+
+		t.pad_tune4 = !!pad;
+		t.valid = true;
+		priv->tuning_cache[i] = t;
+
+		buf = strchr(buf, ';');
+		if (buf)
+			buf++;
+	}
+
+	return 0;
+}
+
+static ssize_t
+tuning_cache_dev_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct dw_mci *host = dev_get_drvdata(dev);
+	struct dw_mci_rtkemmc_host *priv = host->priv;
+	struct dw_mci_rtk_tuning *t;
+	ssize_t size = 0;
+	int i;
+
+	for (i = 0; i < DW_MCI_RTK_TUNING_NR; i++) {
+		t = &priv->tuning_cache[i];
+		if (!t->valid)
+			continue;
+		size += sysfs_emit_at(buf, size, "%s,%08x%08x%08x%08x,%u,%u,%x,%u;\n",
+				      tuning_mode_name[i], t->cid[0], t->cid[1],
+				      t->cid[2], t->cid[3], t->tx_best, t->rx_best,
+				      t->dqs, t->pad_tune4);
+	}
+	size += sysfs_emit_at(buf, size, "hit=%lu miss=%lu retune=%lu\n",
+			      priv->tuning_hit, priv->tuning_miss,
+			      priv->tuning_retune);
+
+	return size;
+}
+
+static ssize_t tuning_cache_dev_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct dw_mci *host = dev_get_drvdata(dev);
+	struct dw_mci_rtkemmc_host *priv = host->priv;
+	char *str, *line;
+	int ret = 0;
+
+	if (sysfs_streq(buf, "clear")) {
+		memset(priv->tuning_cache, 0, sizeof(priv->tuning_cache));
+		return count;
+	}
+
+	str = kstrndup(buf, count, GFP_KERNEL);
+	if (!str)
+		return -ENOMEM;
+
+	line = strim(str);
+	ret = dw_mci_rtk_tuning_parse(priv, line);
+	kfree(str);
+
+	return ret ? ret : count;
+}
+
+DEVICE_ATTR(tuning_cache, S_IRUGO | S_IWUSR,
+		tuning_cache_dev_show, tuning_cache_dev_store);
+
 static void reset_fifo(struct dw_mci *host)
 {
 	mci_writel(host, OTHER1, mci_readl(host, OTHER1) & (~SDMMC_TOP_RST_N_FIFO));
@@ -692,6 +795,59 @@ out:
 	return err;
 }
 
+static struct dw_mci_rtk_tuning *dw_mci_rtk_tuning_entry(struct dw_mci_rtkemmc_host *priv,
+							  struct mmc_host *mmc)
+{
+	if (mmc->ios.timing == MMC_TIMING_MMC_HS200)
+		return &priv->tuning_cache[DW_MCI_RTK_TUNING_HS200];
+	if (mmc->ios.timing == MMC_TIMING_MMC_HS400)
+		return &priv->tuning_cache[DW_MCI_RTK_TUNING_HS400];
+
+	return NULL;
+}
+
+/*
+ * Apply the cached phases and check them with one read and one write on
+ * the blocks the full sweep uses.
+ */
+static int dw_mci_rtk_tuning_try_cache(struct dw_mci *host, struct mmc_host *mmc,
+				       struct dw_mci_rtk_tuning *t)
+{
+	struct dw_mci_rtkemmc_host *priv = host->priv;
+	u32 src = 0x0;
+	int err;
+
+	if (t->pad_tune4)
+		pinctrl_select_state(priv->pinctrl, priv->pins_tune4);
+	else if (mmc->ios.timing == MMC_TIMING_MMC_HS400)
+		pinctrl_select_state(priv->pinctrl, priv->pins_hs400);
+	else
+		pinctrl_select_state(priv->pinctrl, priv->pins_hs200);
+
+	dw_mci_rtk_phase_tuning(host, 0xff, t->rx_best);
+	if (mmc->ios.timing == MMC_TIMING_MMC_HS400)
+		dqs_delay_tap_setting(host, t->dqs);
+	dw_mci_rtk_phase_tuning(host, t->tx_best, 0xff);
+
+	if (mmc->ios.timing == MMC_TIMING_MMC_HS200)
+		err = mmc_send_tuning(mmc, MMC_SEND_TUNING_BLOCK_HS200, NULL);
+	else
+		err = dw_mci_rtk_send_tuning(mmc, MMC_READ_MULTIPLE_BLOCK, 0x100, 1024);
+	if (err)
+		return err;
+
+	dw_mci_rtk_query_protect_cmd(mmc, 0, &src);
+	if(src & BIT(0))
+		dw_mci_rtk_write_protect_cmd(mmc, 0, 0);
+
+	err = dw_mci_rtk_send_tuning(mmc, MMC_WRITE_MULTIPLE_BLOCK, 0xfe, 1024);
+
+	if(src & BIT(0))
+		dw_mci_rtk_write_protect_cmd(mmc, 0, 1);
+
+	return err;
+}
+
 static int dw_mci_rtk_execute_tuning(struct dw_mci_slot *slot, u32 opcode)
 {
 	struct dw_mci *host = slot->host;
@@ -708,6 +864,7 @@ static int dw_mci_rtk_execute_tuning(struct dw_mci_slot *slot, u32 opcode)
 	bool fail = false;
 	bool dqs_retry = false;
 	u32 src = 0x0;
+	struct dw_mci_rtk_tuning *cache = NULL;
 
 	if(mmc->doing_retune == 1) {
 		mmc->can_retune = 0;
@@ -725,6 +882,25 @@ static int dw_mci_rtk_execute_tuning(struct dw_mci_slot *slot, u32 opcode)
 
 	host->tuning = 1;
 
+	if (mmc->card)
+		cache = dw_mci_rtk_tuning_entry(priv, mmc);
+	if (cache && !priv->tuning_force) {
+		if (cache->valid &&
+		    !memcmp(cache->cid, mmc->card->raw_cid, sizeof(cache->cid))) {
+			if (!dw_mci_rtk_tuning_try_cache(host, mmc, cache)) {
+				priv->tuning_hit++;
+				dev_info(mmc_dev(mmc), "%s: reuse tx=0x%x rx=0x%x\n",
+					 __func__, cache->tx_best, cache->rx_best);
+				goto out;
+			}
+			priv->tuning_retune++;
+			cache->valid = false;
+			dw_mci_rtk_set_pinstates(priv, mmc->ios.timing);
+		} else {
+			priv->tuning_miss++;
+		}
+	}
+
 	do {
 		if (mmc->ios.timing == MMC_TIMING_MMC_HS400)
 			loop_cnt=0;
@@ -897,6 +1073,15 @@ static int dw_mci_rtk_execute_tuning(struct dw_mci_slot *slot, u32 opcode)
 	dw_mci_rtk_phase_tuning(host, tx_best, 0xff);
 	printk(KERN_ERR "tx_window=0x%x, tx_best=0x%x\n", tx_window, tx_best);
 
+	if (cache) {
+		memcpy(cache->cid, mmc->card->raw_cid, sizeof(cache->cid));
+		cache->tx_best = tx_best;
+		cache->rx_best = rx_best;
+		cache->dqs = mci_readl(host, DQS_CTRL1);
+		cache->pad_tune4 = fail;
+		cache->valid = true;
+	}
+
 out:
 	/*We send cmd 13 again because the eMMC handling might send command 12 more than twice.
 	  After kernel 5.4, system might send cmd13 first before issuing any command,
@@ -1212,6 +1397,9 @@ static int dw_mci_rtk_init(struct dw_mci *host)
 	priv->protect_unit = 0;
 	priv->protect_cnt = 0;
 
+	if (tuning_cache && dw_mci_rtk_tuning_parse(priv, tuning_cache))
+		dev_warn(host->dev, "invalid tuning_cache \"%s\"\n", tuning_cache);
+
 	/*In Realtek Platform, only using 32bit DMA*/
 	host->dma_64bit_address = 0;
 
@@ -1365,6 +1553,11 @@ static int dw_mci_rtk_probe(struct platform_device *pdev)
 		dev_err(&pdev->dev, "device_create_tuning_info fail (ret=%d)\n",
 			ret);
 	}
+	ret = device_create_file(&pdev->dev, &dev_attr_tuning_cache);
+	if (ret < 0) {
+		dev_err(&pdev->dev, "device_create_tuning_cache fail (ret=%d)\n",
+			ret);
+	}
 	return dw_mci_pltfm_register(pdev, drv_data);
 }
 
@@ -1376,6 +1569,7 @@ int dw_mci_rtk_remove(struct platform_device *pdev)
 	device_remove_file(&pdev->dev, &dev_attr_protect_region_start);
 	device_remove_file(&pdev->dev, &dev_attr_protect_region_unit);
 	device_remove_file(&pdev->dev, &dev_attr_tuning_info);
+	device_remove_file(&pdev->dev, &dev_attr_tuning_cache);
 
 	dw_mci_remove(host);
 	return 0;
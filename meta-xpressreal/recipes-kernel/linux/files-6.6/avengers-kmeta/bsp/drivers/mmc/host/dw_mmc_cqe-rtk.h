@@ -105,6 +105,22 @@ struct backupRegs {
 	u32                     ckgen_ctl;
 };
 
+/* last good phases of a card in one timing mode */
+struct dw_mci_rtk_tuning {
+	u32			cid[4];
+	u32			tx_best;
+	u32			rx_best;
+	u32			dqs;
+	bool			pad_tune4;
+	bool			valid;
+};
+
+enum {
+	DW_MCI_RTK_TUNING_HS200 = 0,
+	DW_MCI_RTK_TUNING_HS400,
+	DW_MCI_RTK_TUNING_NR,
+};
+
 struct dw_mci_rtkemmc_host {
 	struct pinctrl          *pinctrl;
 	struct pinctrl_state    *pins_default;
@@ -128,5 +144,11 @@ struct dw_mci_rtkemmc_host {
 	unsigned int		protect_unit;
 	unsigned int            protect_cnt;
 	unsigned int		enforce;
+
+	struct dw_mci_rtk_tuning tuning_cache[DW_MCI_RTK_TUNING_NR];
+	bool			tuning_force;
+	unsigned long		tuning_hit;
+	unsigned long		tuning_miss;
+	unsigned long		tuning_retune;
 };
 #endif
@@ -26,6 +26,9 @@
 #include <linux/slab.h>
 #include <linux/stat.h>
 #include <linux/delay.h>
+#include <linux/iopoll.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
 #include <linux/irq.h>
 #include <linux/mmc/card.h>
 #include <linux/mmc/host.h>
@@ -52,6 +55,11 @@
 #define DW_MCI_DESC_LEN		0x100000
 #define DW_MCI_MAX_SCRIPT_BLK	128
 #define DW_MCI_TIMEOUT_MS	3000
+#define DW_MCI_STATUS_TIMEOUT_MS	600
+
+#define DW_MCI_WAIT_SPIN_US	10
+#define DW_MCI_WAIT_SLEEP_US	20
+#define DW_MCI_WAIT_TIMEOUT_US	3000000
 #define TUNING_ERR		531
 #define DW_MCI_NOT_READY	9999
 
@@ -595,6 +603,47 @@ static const struct mmc_host_ops dw_mci_ops = {
 	.init_card 			= dw_mci_init_card,
 };
 
+#if defined(CONFIG_DEBUG_FS)
+static int dw_mci_wait_hist_show(struct seq_file *s, void *data)
+{
+	static const char * const names[DW_MCI_WAIT_NR] = {
+		"int_stat", "clk_ctrl", "pstate", "other", "card_busy",
+	};
+	struct dw_mci *host = s->private;
+	struct dw_mci_wait_stats *stats;
+	int i, j;
+
+	for (i = 0; i < DW_MCI_WAIT_NR; i++) {
+		stats = &host->wait_stats[i];
+		seq_printf(s, "%-10s max %llu us, timeout %lu\n", names[i],
+			   stats->max_us, stats->timeout);
+		for (j = 0; j < DW_MCI_WAIT_HIST_NR; j++) {
+			if (!stats->hist[j])
+				continue;
+			if (j == DW_MCI_WAIT_HIST_NR - 1)
+				seq_printf(s, "  >= %6lu us: %lu\n",
+					   1UL << (j - 1), stats->hist[j]);
+			else
+				seq_printf(s, "  <  %6lu us: %lu\n",
+					   1UL << j, stats->hist[j]);
+		}
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(dw_mci_wait_hist);
+
+static void dw_mci_init_debugfs(struct dw_mci_slot *slot)
+{
+	struct mmc_host	*mmc = slot->mmc;
+
+	debugfs_create_file("wait_hist", S_IRUSR, mmc->debugfs_root,
+			    slot->host, &dw_mci_wait_hist_fops);
+}
+#else
+static inline void dw_mci_init_debugfs(struct dw_mci_slot *slot) {}
+#endif /* defined(CONFIG_DEBUG_FS) */
+
 static int dw_mci_init_slot(struct dw_mci *host)
 {
 	struct mmc_host *mmc;
@@ -652,6 +701,8 @@ static int dw_mci_init_slot(struct dw_mci *host)
 	if (ret)
 		goto err_host_allocated;
 
+	dw_mci_init_debugfs(slot);
+
 	return 0;
 
 err_host_allocated:
@@ -839,27 +890,64 @@ static void dw_mci_endup_data(struct dw_mci *host, struct mmc_data *data)
 	host->sg = NULL;
 }
 
+static void dw_mci_wait_account(struct dw_mci *host, int type,
+				ktime_t start, bool timeout)
+{
+	struct dw_mci_wait_stats *stats = &host->wait_stats[type];
+	u64 us = ktime_us_delta(ktime_get(), start);
+	int idx;
+
+	idx = us ? min_t(int, ilog2(us) + 1, DW_MCI_WAIT_HIST_NR - 1) : 0;
+	stats->hist[idx]++;
+	if (us > stats->max_us)
+		stats->max_us = us;
+	if (timeout)
+		stats->timeout++;
+}
+
+static int dw_mci_wait_type(struct dw_mci *host, void __iomem *reg)
+{
+	switch (reg - host->regs) {
+	case SDMMC_NORMAL_INT_STAT_R:
+		return DW_MCI_WAIT_INT_STAT;
+	case SDMMC_CLK_CTRL_R:
+		return DW_MCI_WAIT_CLK_CTRL;
+	case SDMMC_PSTATE_REG:
+		return DW_MCI_WAIT_PSTATE;
+	default:
+		return DW_MCI_WAIT_OTHER;
+	}
+}
+
+static bool dw_mci_wait_cond(struct dw_mci *host, u32 val, u32 mask, u32 value)
+{
+	/*error interrupt detected*/
+	return (val & mask) == value ||
+	       (mci_readw(host, NORMAL_INT_STAT_R) & SDMMC_ERR_INTERRUPT);
+}
+
 void wait_done(struct dw_mci *host, volatile u32 *addr,
 		      u32 mask, u32 value)
 {
-	int n = 0;
-
-	while(1)
-	{
-		if (((*addr) & mask) == value)
-			break;
+	void __iomem *reg = (void __iomem *)addr;
+	ktime_t start = ktime_get();
+	u32 val;
+	int ret;
 
-		/*error interrupt detected*/
-		if((mci_readw(host, NORMAL_INT_STAT_R) & SDMMC_ERR_INTERRUPT)!=0)
-			break;
+	/* most waits finish within a few microseconds, spin before sleeping */
+	ret = read_poll_timeout_atomic(readl, val,
+				       dw_mci_wait_cond(host, val, mask, value),
+				       1, DW_MCI_WAIT_SPIN_US, false, reg);
+	if (ret)
+		ret = read_poll_timeout(readl, val,
+					dw_mci_wait_cond(host, val, mask, value),
+					DW_MCI_WAIT_SLEEP_US,
+					DW_MCI_WAIT_TIMEOUT_US, false, reg);
+	if (ret)
+		pr_err("%s: opcode=%d, addr=%px, *addr=0x%x, mask=0x%x, value=0x%x\n",
+			__func__, host->opcode, addr, readl(reg), mask, value);
 
-		if(n++ > 3000000) {
-			pr_err("%s: opcode=%d, addr=%px, *addr=0x%x, mask=0x%x, value=0x%x\n",
-				__func__, host->opcode, addr, readl(addr), mask, value);
-			break;
-		}
-		udelay(1);
-	}
+	dw_mci_wait_account(host, dw_mci_wait_type(host, reg), start, ret);
 }
 EXPORT_SYMBOL(wait_done);
 
@@ -1084,10 +1172,18 @@ static int dw_mci_wait_status(struct dw_mci *host, u32 *status)
 	u32 cmdr;
 	unsigned long timeend;
 	u8 cur_state;
+	ktime_t start = ktime_get();
+	unsigned int delay_us = DW_MCI_WAIT_SLEEP_US;
+	u32 pstate;
 
 	memset(&cmd, 0, sizeof(struct mmc_command));
 
-	timeend = jiffies + msecs_to_jiffies(600);
+	timeend = jiffies + msecs_to_jiffies(DW_MCI_STATUS_TIMEOUT_MS);
+
+	/* card holds DAT0 low while busy, sleep on it before polling CMD13 */
+	read_poll_timeout(readl, pstate, pstate & BIT(20), DW_MCI_WAIT_SLEEP_US,
+			  DW_MCI_STATUS_TIMEOUT_MS * USEC_PER_MSEC, false,
+			  host->regs + SDMMC_PSTATE_REG);
 
 	do {
 		cmd.opcode = MMC_SEND_STATUS;
@@ -1117,8 +1213,14 @@ static int dw_mci_wait_status(struct dw_mci *host, u32 *status)
 				break;
 			}
 		}
+
+		usleep_range(delay_us, delay_us * 2);
+		delay_us = min(delay_us * 2, 1000U);
 	}while(time_before(jiffies, timeend));
 
+	dw_mci_wait_account(host, DW_MCI_WAIT_CARD_BUSY, start,
+			    err == -DW_MCI_NOT_READY);
+
 	return err;
 }
 
@@ -1145,7 +1247,7 @@ static void dw_mci_err_handle(struct dw_mci *host,
 			do {
 				if(cmd->opcode != MMC_SEND_TUNING_BLOCK_HS200) {
 					dw_mci_send_stop_command(host, cmd);
-					mdelay(1);
+					usleep_range(1000, 1200);
 
 					err = dw_mci_wait_status(host, &status);
 
@@ -15,6 +15,25 @@
 #include <linux/reset.h>
 #include <linux/interrupt.h>
 
+/* register waits, grouped by what is waited on */
+enum dw_mci_wait_type {
+	DW_MCI_WAIT_INT_STAT = 0,
+	DW_MCI_WAIT_CLK_CTRL,
+	DW_MCI_WAIT_PSTATE,
+	DW_MCI_WAIT_OTHER,
+	DW_MCI_WAIT_CARD_BUSY,
+	DW_MCI_WAIT_NR,
+};
+
+/* bucket 0 is < 1us, bucket n covers [2^(n-1), 2^n) us */
+#define DW_MCI_WAIT_HIST_NR	16
+
+struct dw_mci_wait_stats {
+	unsigned long		hist[DW_MCI_WAIT_HIST_NR];
+	unsigned long		timeout;
+	u64			max_us;
+};
+
 struct dw_mci {
 	spinlock_t              lock;
 	spinlock_t              irq_lock;
@@ -66,6 +85,8 @@ struct dw_mci {
 	u8			cqe_reenable;
 	bool			cmd_atomic;
 	struct cqhci_host       *cqe;
+
+	struct dw_mci_wait_stats wait_stats[DW_MCI_WAIT_NR];
 };
 
 enum {
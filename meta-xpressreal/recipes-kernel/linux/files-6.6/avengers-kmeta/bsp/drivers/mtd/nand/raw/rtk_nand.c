@@ -21,6 +21,8 @@
 #include <linux/errno.h>
 #include <linux/interrupt.h>
 #include <linux/iopoll.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/module.h>
@@ -46,6 +48,7 @@
 #define RTK_NAME                "rtk_nand"
 #define RTK_TIMEOUT		(500000)
 #define RTK_RESET_TIMEOUT	(1000000)
+#define RTK_SPIN_US		(20)
 
 #define NF_CTL_ENABLE		1
 #define NF_CTL_DISABLE		0
@@ -53,6 +56,10 @@
 #define OOBON	1
 #define OOBONLY	1
 
+static bool direct_dma = true;
+module_param(direct_dma, bool, 0644);
+MODULE_PARM_DESC(direct_dma, "DMA pages straight to and from cache line aligned caller buffers");
+
 static unsigned char g_rtk_nandinfo_line[128];
 static int g_id_chain;
 static int g_id_chain_2;
@@ -141,19 +148,36 @@ static int rtk_nf_get_nand_info_from_bootcode(struct mtd_info *mtd)
 	return 0;
 }
 
+/*
+ * Register transfers finish within a few microseconds, so spin on those
+ * briefly. Array reads, programs and erases take tens of microseconds to
+ * milliseconds, so sleep on the rest instead of burning the CPU.
+ */
 static int rtk_nf_wait_down(void __iomem *regs, u64 mask, unsigned int value)
 {
 	u32 val;
 	int ret;
 
-	ret = readl_poll_timeout_atomic(regs, val, (val & mask) == value, 10,
-					RTK_TIMEOUT);
+	ret = readl_poll_timeout_atomic(regs, val, (val & mask) == value, 1,
+					RTK_SPIN_US);
+	if (!ret)
+		return 0;
+
+	ret = readl_poll_timeout(regs, val, (val & mask) == value, 20,
+				 RTK_TIMEOUT);
 	if (ret)
 		return -EIO;
 
 	return 0;
 }
 
+static bool rtk_nf_can_dma(struct rtk_nf *nf, const u8 *buf)
+{
+	return direct_dma && buf != nf->nandbuf.dataBuf &&
+	       virt_addr_valid(buf) &&
+	       IS_ALIGNED((uintptr_t)buf, dma_get_cache_alignment());
+}
+
 int rtk_nf_get_mapping_page(struct mtd_info *mtd, int page)
 {
 #if defined(CONFIG_MTD_NAND_RTK_BBM)
@@ -380,12 +404,14 @@ static int rtk_nf_do_write_page_ecc(struct mtd_info *mtd, struct nand_chip *chip
 	struct rtk_buffer *buffer = &nf->nandbuf;
 	dma_addr_t dataPhy = buffer->dataPhys;
 	dma_addr_t oobPhy = buffer->dataPhys + mtd->writesize;
+	bool data_mapped = rtk_nf_can_dma(nf, buf);
+	bool oob_mapped = false;
 	int ret = 0;
 	int i;
 
 	chip->pagecache.page = -1;
 
-	if (buf != buffer->dataBuf && !((uintptr_t)buf & 0xFFF)) {
+	if (data_mapped) {
 		dataPhy = dma_map_single(nf->dev, (u8 *)buf, mtd->writesize,
 					 DMA_TO_DEVICE);
 		ret = dma_mapping_error(nf->dev, dataPhy);
@@ -407,8 +433,12 @@ static int rtk_nf_do_write_page_ecc(struct mtd_info *mtd, struct nand_chip *chip
 		ret = dma_mapping_error(nf->dev, oobPhy);
 		if (ret) {
 			dev_err(nf->dev, "oob dma mapping error\n");
+			if (data_mapped)
+				dma_unmap_single(nf->dev, dataPhy, mtd->writesize,
+						 DMA_TO_DEVICE);
 			return -EINVAL;
 		}
+		oob_mapped = true;
 		dma_sync_single_for_device(nf->dev, oobPhy, mtd->oobsize,
 				   DMA_TO_DEVICE);
 	}
@@ -501,16 +531,21 @@ static int rtk_nf_do_write_page_ecc(struct mtd_info *mtd, struct nand_chip *chip
 		ret = -1;
 
 rtk_nf_do_write_page_exit:
-	if (buf != buffer->dataBuf && !((uintptr_t)buf & 0xFFF)) {
+	if (data_mapped) {
 		dma_sync_single_for_cpu(nf->dev, dataPhy, mtd->writesize,
 					   DMA_TO_DEVICE);
 
 		dma_unmap_single(nf->dev, dataPhy, mtd->writesize,
 				 DMA_TO_DEVICE);
+		nf->stats.wr_direct++;
 	}
 
-	dma_sync_single_for_cpu(nf->dev, oobPhy, mtd->oobsize, DMA_TO_DEVICE);
-	dma_unmap_single(nf->dev, oobPhy, mtd->oobsize, DMA_TO_DEVICE);
+	/* the spare area normally goes out of the coherent buffer */
+	if (oob_mapped) {
+		dma_sync_single_for_cpu(nf->dev, oobPhy, mtd->oobsize,
+					DMA_TO_DEVICE);
+		dma_unmap_single(nf->dev, oobPhy, mtd->oobsize, DMA_TO_DEVICE);
+	}
 
 	return ret;
 }
@@ -538,6 +573,7 @@ static int rtk_nf_write_page(struct mtd_info *mtd, struct nand_chip *chip,
 	struct rtk_nf *nf = nand_get_controller_data(chip);
 	struct rtk_buffer *buffer = &nf->nandbuf;
 	int phy_page = rtk_nf_get_physical_page(mtd, page);
+	ktime_t start = ktime_get();
 	int real_page;
 	int ret;
 	int src_blk;
@@ -548,7 +584,7 @@ rtk_nf_write_page_retry:
 #endif
 	real_page = rtk_nf_get_mapping_page(mtd, phy_page);
 
-	memcpy(buffer->dataBuf, buf, mtd->writesize);
+	/* data is staged in rtk_nf_do_write_page_ecc() only if it can't be DMAed */
 	memcpy(buffer->dataBuf + mtd->writesize, chip->oob_poi, mtd->oobsize);
 
 	ret = rtk_nf_do_write_page(mtd, chip, real_page, buf, oob_on, access_mode);
@@ -559,6 +595,9 @@ rtk_nf_write_page_retry:
 			goto rtk_nf_write_page_retry;
 	}
 #endif
+	nf->stats.wr_pages++;
+	nf->stats.wr_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+
 	return ret;
 }
 
@@ -824,12 +863,13 @@ static int rtk_nf_do_read_page_ecc(struct mtd_info *mtd, int page, u8 *buf,
 	unsigned int eccNum = 0;
 	unsigned int blank_check = 0;
 	unsigned int access_page_len = 0;
+	bool data_mapped = rtk_nf_can_dma(nf, buf);
 	int ret;
 
 	access_page_len = (phase == 1) ? SZ_2K : mtd->writesize;
 	ecc_threshold = (nf->ecc == 0x1) ? 10 : 4;
 
-	if (buf != buffer->dataBuf && !((uintptr_t)buf & 0xFFF)) {
+	if (data_mapped) {
 		dataPhy = dma_map_single(nf->dev, (u8 *)buf, access_page_len, DMA_FROM_DEVICE);
 		ret = dma_mapping_error(nf->dev, dataPhy);
 		if (ret) {
@@ -921,9 +961,8 @@ static int rtk_nf_do_read_page_ecc(struct mtd_info *mtd, int page, u8 *buf,
 		eccNum = rtk_read_status_on_die(chip);
 		if (eccNum > 4) {
 			dev_err(nf->dev, "RTK %s on_die debug: ecc_num:%d, page:%u\n", __func__, eccNum, page);
-			writel(NF_BLANK_CHK_blank_ena(1) | NF_BLANK_CHK_read_ecc_xnor_ena(0),
-				map_base + REG_BLANK_CHK);
-			return -2;
+			ret = -2;
+			goto rtk_nf_do_read_page_ecc_exit;
 		}
 	} else if (readl(map_base + REG_ND_ECC) & 0x8) {
 		if (blank_check & 0x8) {
@@ -955,13 +994,14 @@ rtk_nf_do_read_page_ecc_exit:
 
 	rtk_nf_disable_io_mode(mtd);
 
-	if (buf != buffer->dataBuf && !((uintptr_t)buf & 0xFFF)) {
+	if (data_mapped) {
 		dma_sync_single_for_cpu(nf->dev, dataPhy, access_page_len,
 					DMA_FROM_DEVICE);
 		dma_unmap_single(nf->dev, dataPhy, access_page_len,
 				 DMA_FROM_DEVICE);
 		memcpy(chip->oob_poi, buffer->dataBuf + mtd->writesize,
 		       mtd->oobsize);
+		nf->stats.rd_direct++;
 	} else {
 		if (buf != buffer->dataBuf)
 			memcpy(buf, buffer->dataBuf, access_page_len);
@@ -1016,12 +1056,15 @@ static int rtk_nf_read_page(struct mtd_info *mtd, struct nand_chip *chip,
 	struct rtk_nf *nf = nand_get_controller_data(chip);
 	int phy_page = rtk_nf_get_physical_page(mtd, page);
 	int real_page = rtk_nf_get_mapping_page(mtd, phy_page);
+	ktime_t start = ktime_get();
 	int ret;
 #if defined(CONFIG_MTD_NAND_RTK_BBM)
 	int src_blk = phy_page / (int)nf->ppb;
 #endif /* CONFIG_MTD_NAND_RTK_BBM */
 
 	ret = rtk_nf_do_read_page(mtd, real_page, p, oob_on, access_mode);
+	nf->stats.rd_pages++;
+	nf->stats.rd_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
 #if defined(CONFIG_MTD_NAND_RTK_BBM)
 	src_blk = phy_page / (int)nf->ppb;
 	if (ret < 0)
@@ -1554,12 +1597,48 @@ static const struct proc_ops info_proc_fops = {
 	.proc_release = single_release,
 };
 
+/* KB/s of pages moved, including command and busy time */
+static u64 rtk_nf_rate(struct mtd_info *mtd, u64 pages, u64 ns)
+{
+	return ns ? mul_u64_u64_div_u64(pages * mtd->writesize, NSEC_PER_SEC, ns) >> 10 : 0;
+}
+
+static int rtk_nf_read_proc_stats(struct seq_file *m, void *v)
+{
+	struct rtk_nf *nf = (struct rtk_nf *)m->private;
+	struct mtd_info *mtd = nand_to_mtd(&nf->chip);
+	struct rtk_nf_stats *st = &nf->stats;
+
+	seq_printf(m, "direct dma   : %s\n", direct_dma ? "on" : "off");
+	seq_printf(m, "read pages   : %llu (%llu direct), %llu KB/s\n",
+		   st->rd_pages, st->rd_direct,
+		   rtk_nf_rate(mtd, st->rd_pages, st->rd_ns));
+	seq_printf(m, "write pages  : %llu (%llu direct), %llu KB/s\n",
+		   st->wr_pages, st->wr_direct,
+		   rtk_nf_rate(mtd, st->wr_pages, st->wr_ns));
+	return 0;
+}
+
+static int rtk_nf_stats_proc_open(struct inode *inode, struct  file *file)
+{
+	return single_open(file, rtk_nf_read_proc_stats, pde_data(inode));
+}
+
+static const struct proc_ops stats_proc_fops = {
+	.proc_open = rtk_nf_stats_proc_open,
+	.proc_read = seq_read,
+	.proc_lseek = seq_lseek,
+	.proc_release = single_release,
+};
+
 static void rtk_nf_init_procfs(struct rtk_nf *nf)
 {
 	nf->rtknf_proc_dir = proc_mkdir(RTKNF_PROC_DIR_NAME, NULL);
 	if (nf->rtknf_proc_dir) {
 		proc_create_data("info", 0644, nf->rtknf_proc_dir,
 					&info_proc_fops, nf);
+		proc_create_data("stats", 0444, nf->rtknf_proc_dir,
+					&stats_proc_fops, nf);
 	}
 }
 
@@ -227,6 +227,15 @@ struct rtk_buffer {
 	unsigned char *oobtmp;
 };
 
+struct rtk_nf_stats {
+	u64 rd_pages;
+	u64 rd_direct;
+	u64 rd_ns;
+	u64 wr_pages;
+	u64 wr_direct;
+	u64 wr_ns;
+};
+
 struct rtk_nf {
         struct nand_chip chip;
         struct nand_controller controller;
@@ -260,6 +269,7 @@ struct rtk_nf {
 	u32 bootareashift;
 #endif
 	struct proc_dir_entry *rtknf_proc_dir;
+	struct rtk_nf_stats stats;
 };
 
 int rtk_nf_get_real_page(struct mtd_info *mtd, int page, int type);
@@ -6,15 +6,22 @@
  */
 #include <linux/bitops.h>
 #include <linux/clk.h>
+#include <linux/debugfs.h>
 #include <linux/dma-mapping.h>
 #include <linux/iopoll.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/module.h>
 #include <linux/mtd/mtd.h>
 #include <linux/mtd/partitions.h>
 #include <linux/mtd/spi-nor.h>
 #include <linux/of.h>
 #include <linux/platform_device.h>
+#include <linux/scatterlist.h>
+#include <linux/seq_file.h>
+#include <linux/sizes.h>
 #include <linux/slab.h>
+#include <linux/spi/spi-mem.h>
 #include <linux/regmap.h>
 #include <linux/mfd/syscon.h>
 
@@ -37,7 +44,10 @@
 #define MD_FDMA_CTRL2		(0x14)
 #define MD_FDMA_CTRL1		(0x18)
 
-#define RTKSFC_DMA_MAX_LEN	0x100
+#define RTKSFC_DMA_MAX_LEN	0x100	/* one page program */
+#define RTKSFC_BOUNCE_LEN	SZ_64K
+#define RTKSFC_DIRECT_MIN	SZ_4K
+#define RTKSFC_POLL_SLEEP_LEN	SZ_4K
 #define RTKSFC_MAX_CHIP_NUM	1
 #define RTKSFC_WAIT_TIMEOUT	1000000	
 #define RTKSFC_OP_READ		0x0
@@ -45,14 +55,31 @@
 
 #define NOR_BASE_PHYS		0x88100000
 
+static bool large_dma = true;
+module_param(large_dma, bool, 0644);
+MODULE_PARM_DESC(large_dma, "Read in large and direct DMA chunks (0: 256-byte bounce chunks)");
+
+struct rtksfc_stats {
+	u64 rd_bytes;
+	u64 rd_ns;
+	u64 wr_bytes;
+	u64 wr_ns;
+	u64 direct_bytes;
+	u32 dma_ops;
+	u32 timeouts;
+};
+
 struct rtksfc_host {
 	struct device *dev;
+	struct spi_controller *ctrl;
 	struct mutex lock;
 	struct regmap *sb2;
 	void __iomem *iobase;
 	void __iomem *mdbase;
 	void *buffer;
 	dma_addr_t dma_buffer;
+	struct rtksfc_stats stats;
+	struct dentry *debugfs;
 };
 
 static int rtk_spi_nor_read_status(struct rtksfc_host *host)
@@ -294,18 +321,17 @@ static int rtk_spi_nor_byte_transfer(struct rtksfc_host *host, loff_t offset,
 	return len;
 }
 
-static int rtk_spi_nor_dma_transfer(struct rtksfc_host *host, loff_t offset,
-					size_t len, u8 op_type)
+static int rtk_spi_nor_dma_transfer(struct rtksfc_host *host, dma_addr_t dma,
+				    loff_t offset, size_t len, u8 op_type)
 {
 	unsigned int val;
+	int ret;
 
 	writel(0x0a, host->mdbase + MD_FDMA_CTRL1);
 
 	/* setup MD DDR addr and flash addr */
-	writel((unsigned long)(host->dma_buffer),  
-				host->mdbase + MD_FDMA_DDR_SADDR);
-	writel((unsigned long)((volatile u8*)(NOR_BASE_PHYS + offset)),  
-				host->mdbase + MD_FDMA_FL_SADDR);
+	writel((u32)dma, host->mdbase + MD_FDMA_DDR_SADDR);
+	writel((u32)(NOR_BASE_PHYS + offset), host->mdbase + MD_FDMA_FL_SADDR);
 
 	if (op_type == RTKSFC_OP_READ)
 		val = (0xC000000 | len);
@@ -316,63 +342,141 @@ static int rtk_spi_nor_dma_transfer(struct rtksfc_host *host, loff_t offset,
 	/* go */
 	writel(0x03, host->mdbase + MD_FDMA_CTRL1);
 
-	while (readl(host->mdbase + MD_FDMA_CTRL1) & 0x1)
-		udelay(1);
+	/* a page takes microseconds, a 64K chunk several milliseconds */
+	if (len > RTKSFC_POLL_SLEEP_LEN)
+		ret = readl_poll_timeout(host->mdbase + MD_FDMA_CTRL1, val,
+					 !(val & 0x1), 50, RTKSFC_WAIT_TIMEOUT);
+	else
+		ret = readl_poll_timeout_atomic(host->mdbase + MD_FDMA_CTRL1, val,
+						!(val & 0x1), 1, RTKSFC_WAIT_TIMEOUT);
+
+	host->stats.dma_ops++;
+	if (ret) {
+		host->stats.timeouts++;
+		dev_err(host->dev, "DMA %s timeout at 0x%llx\n",
+			op_type == RTKSFC_OP_READ ? "read" : "write", offset);
+	}
+
+	return ret;
+}
+
+static int rtk_spi_nor_dma_read_bounce(struct rtksfc_host *host, loff_t from,
+				       u8 *buf, size_t len)
+{
+	size_t chunk = large_dma ? RTKSFC_BOUNCE_LEN : RTKSFC_DMA_MAX_LEN;
+	size_t r_len;
+	int ret;
+
+	while (len > 0) {
+		r_len = min(len, chunk);
+
+		ret = rtk_spi_nor_dma_transfer(host, host->dma_buffer, from,
+					       r_len, RTKSFC_OP_READ);
+		if (ret)
+			return ret;
+
+		memcpy(buf, host->buffer, r_len);
 
-	return rtk_spi_nor_read_status(host);
+		len -= r_len;
+		buf += r_len;
+		from += r_len;
+	}
+
+	return 0;
+}
+
+/*
+ * DMA straight into the caller's buffer, one transfer per segment, so
+ * vmalloc buffers work as well. The region is whole cache lines so no
+ * line is shared with the bytes copied by the CPU around it.
+ */
+static int rtk_spi_nor_dma_read_direct(struct rtksfc_host *host,
+				       const struct spi_mem_op *op,
+				       loff_t from, u8 *buf, size_t len)
+{
+	struct spi_mem_op dop = *op;
+	struct scatterlist *sg;
+	struct sg_table sgt;
+	int ret, i;
+
+	dop.data.buf.in = buf;
+	dop.data.nbytes = len;
+
+	ret = spi_controller_dma_map_mem_op_data(host->ctrl, &dop, &sgt);
+	if (ret)
+		return ret;
+
+	for_each_sg(sgt.sgl, sg, sgt.nents, i) {
+		ret = rtk_spi_nor_dma_transfer(host, sg_dma_address(sg), from,
+					       sg_dma_len(sg), RTKSFC_OP_READ);
+		if (ret)
+			break;
+		from += sg_dma_len(sg);
+	}
+
+	spi_controller_dma_unmap_mem_op_data(host->ctrl, &dop, &sgt);
+
+	if (!ret)
+		host->stats.direct_bytes += len;
+
+	return ret;
 }
 
 static ssize_t rtk_spi_nor_read(struct rtksfc_host *host, const struct spi_mem_op *op)
 {
-	loff_t from, n_from;
+	loff_t from;
 	size_t len;
-	size_t n_len = 0, r_len = 0;
-	unsigned int offset;
+	size_t head, direct = 0;
 	u_char *read_buf = op->data.buf.in;
+	unsigned int align = dma_get_cache_alignment();
+	ktime_t start = ktime_get();
 	int ret;
-	int i;
 
 	from = op->addr.val;
 	len = op->data.nbytes;
 
-	offset = from & 0x3;
-
-	/* Byte stage */
-	if (offset != 0) {
-		r_len = (offset > len) ? len : offset;
+	/* Byte stage, up to the first word aligned flash address */
+	head = min_t(size_t, len, (4 - (from & 0x3)) & 0x3);
+	if (head) {
 		rtk_spi_nor_read_mode(host);
-		ret = rtk_spi_nor_byte_transfer(host, from, r_len, (u8 *)read_buf,
-							RTKSFC_OP_READ);
+		rtk_spi_nor_byte_transfer(host, from, head, (u8 *)read_buf,
+					  RTKSFC_OP_READ);
+		from += head;
+		read_buf += head;
+		len -= head;
 	}
 
-	n_from = from + r_len;
-	n_len = len - r_len;
+	if (!len)
+		goto out;
 
 	/* DMA stage */
-	while (n_len > 0) {
-		r_len = (n_len >= RTKSFC_DMA_MAX_LEN) ? RTKSFC_DMA_MAX_LEN : n_len;
-
-		if (op->cmd.opcode == 0x3b)
-			rtk_spi_nor_dualread_mode(host);
-		else
-			rtk_spi_nor_read_mode(host);
+	if (op->cmd.opcode == 0x3b)
+		rtk_spi_nor_dualread_mode(host);
+	else
+		rtk_spi_nor_read_mode(host);
 
-		ret = rtk_spi_nor_dma_transfer(host, n_from, r_len,
-							RTKSFC_OP_READ);
+	if (large_dma && len >= RTKSFC_DIRECT_MIN &&
+	    IS_ALIGNED((unsigned long)read_buf, align)) {
+		direct = round_down(len, align);
+		ret = rtk_spi_nor_dma_read_direct(host, op, from, read_buf, direct);
 		if (ret) {
-			pr_err("DMA read timeout\n");
+			dev_err(host->dev, "DMA read failed\n");
 			return ret;
 		}
+	}
 
-		for (i = 0; i < r_len; i++)
-			*(u8 *)(read_buf + offset + i) = *(u8 *)(host->buffer + i);
-
-		n_len -= r_len;
-		offset += r_len;
-		n_from += r_len;
+	ret = rtk_spi_nor_dma_read_bounce(host, from + direct, read_buf + direct,
+					  len - direct);
+	if (ret) {
+		dev_err(host->dev, "DMA read timeout\n");
+		return ret;
 	}
 
-	return len;
+out:
+	host->stats.rd_bytes += op->data.nbytes;
+	host->stats.rd_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	return op->data.nbytes;
 }
 
 static ssize_t rtk_spi_nor_write(struct rtksfc_host *host, const struct spi_mem_op *op)
@@ -382,12 +486,12 @@ static ssize_t rtk_spi_nor_write(struct rtksfc_host *host, const struct spi_mem_
 	const u_char *write_buf = op->data.buf.out;
 	int r_len = (int)len, w_len = 0;
 	u_char *w_buf = (u_char *)write_buf;
+	ktime_t start = ktime_get();
 	int offset;
-	int ret;
-	int i;
+	int ret = 0;
 
 	rtk_spi_nor_enable_auto_write(host);
-	offset = to & 0x3;
+	offset = (4 - (to & 0x3)) & 0x3;
 
 	/* byte stage */
 	if (offset != 0) {
@@ -406,13 +510,16 @@ static ssize_t rtk_spi_nor_write(struct rtksfc_host *host, const struct spi_mem_
 	while (r_len > 0) {
 		w_len = (r_len >= RTKSFC_DMA_MAX_LEN) ? RTKSFC_DMA_MAX_LEN : r_len;
 
-		for(i = 0; i < w_len; i++)
-			*(u8 *)(host->buffer + i) = *(u8 *)(w_buf + i);
+		memcpy(host->buffer, w_buf, w_len);
 
 		rtk_spi_nor_write_mode(host);
 
-		ret = rtk_spi_nor_dma_transfer(host, to + offset, w_len,
-							RTKSFC_OP_WRITE);
+		ret = rtk_spi_nor_dma_transfer(host, host->dma_buffer, to + offset,
+					       w_len, RTKSFC_OP_WRITE);
+		if (!ret)
+			ret = rtk_spi_nor_read_status(host);
+		if (ret)
+			break;
 
 		r_len = r_len - w_len;
 		offset = offset + w_len;
@@ -422,29 +529,40 @@ static ssize_t rtk_spi_nor_write(struct rtksfc_host *host, const struct spi_mem_
 	rtk_spi_nor_read_mode(host);
 	rtk_spi_nor_disable_auto_write(host);
 
+	if (ret)
+		return ret;
+
+	host->stats.wr_bytes += len;
+	host->stats.wr_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+
 	return len;
 }
 
 static int rtk_nor_exec_op(struct spi_mem *mem, const struct spi_mem_op *op)
 {
 	struct rtksfc_host *host = spi_controller_get_devdata(mem->spi->master);
+	int ret;
+
+	mutex_lock(&host->lock);
 
 	if ((op->data.nbytes == 0) ||
 	    ((op->addr.nbytes != 3) && (op->addr.nbytes != 4))) {
 		if (op->data.dir == SPI_MEM_DATA_IN)
-			return rtkspi_command_read(host, op);
+			ret = rtkspi_command_read(host, op);
 		else
-			return rtkspi_command_write(host, op);
+			ret = rtkspi_command_write(host, op);
+	} else if (op->data.dir == SPI_MEM_DATA_OUT) {
+		ret = rtk_spi_nor_write(host, op);
+	} else if (op->data.dir == SPI_MEM_DATA_IN) {
+		ret = rtk_spi_nor_read(host, op);
+	} else {
+		pr_warn("exec_op, unknow command:0x%x\n", op->cmd.opcode);
+		ret = -EINVAL;
 	}
 
-	if (op->data.dir == SPI_MEM_DATA_OUT)
-		return rtk_spi_nor_write(host, op);
-
-	if (op->data.dir == SPI_MEM_DATA_IN)
-		return rtk_spi_nor_read(host, op);
+	mutex_unlock(&host->lock);
 
-	pr_warn("exec_op, unknow command:0x%x\n", op->cmd.opcode);
-	return -EINVAL;
+	return ret;
 }
 
 static bool rtk_nor_supports_op(struct spi_mem *mem,
@@ -485,6 +603,33 @@ static const struct spi_controller_mem_ops rtk_nor_mem_ops = {
 	.get_name = rtk_nor_get_name,
 };
 
+/* KB/s */
+static u64 rtk_spi_nor_rate(u64 bytes, u64 ns)
+{
+	return ns ? mul_u64_u64_div_u64(bytes, NSEC_PER_SEC, ns) >> 10 : 0;
+}
+
+static int rtk_spi_nor_stats_show(struct seq_file *s, void *data)
+{
+	struct rtksfc_host *host = s->private;
+	struct rtksfc_stats *st = &host->stats;
+
+	mutex_lock(&host->lock);
+	seq_printf(s, "mode: %s\n", large_dma ? "large/direct" : "256-byte bounce");
+	seq_printf(s, "read: %llu bytes, %llu us, %llu KB/s\n", st->rd_bytes,
+		   div_u64(st->rd_ns, NSEC_PER_USEC),
+		   rtk_spi_nor_rate(st->rd_bytes, st->rd_ns));
+	seq_printf(s, "direct: %llu bytes\n", st->direct_bytes);
+	seq_printf(s, "write: %llu bytes, %llu us, %llu KB/s\n", st->wr_bytes,
+		   div_u64(st->wr_ns, NSEC_PER_USEC),
+		   rtk_spi_nor_rate(st->wr_bytes, st->wr_ns));
+	seq_printf(s, "dma_ops: %u\ntimeouts: %u\n", st->dma_ops, st->timeouts);
+	mutex_unlock(&host->lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(rtk_spi_nor_stats);
+
 static int rtk_spi_nor_probe(struct platform_device *pdev)
 {
 	struct spi_controller *ctrl;
@@ -504,6 +649,7 @@ static int rtk_spi_nor_probe(struct platform_device *pdev)
 
 	host = spi_controller_get_devdata(ctrl);
 	host->dev = &pdev->dev;
+	host->ctrl = ctrl;
 
 	host->sb2 = syscon_node_to_regmap(pdev->dev.of_node->parent);
 	if (IS_ERR(host->sb2))
@@ -515,7 +661,7 @@ static int rtk_spi_nor_probe(struct platform_device *pdev)
 		return ret;
 	}
 
-	host->buffer = dmam_alloc_coherent(&pdev->dev, RTKSFC_DMA_MAX_LEN,
+	host->buffer = dmam_alloc_coherent(&pdev->dev, RTKSFC_BOUNCE_LEN,
 			&host->dma_buffer, GFP_KERNEL);
 	if (!host->buffer)
 		return -ENOMEM;
@@ -525,10 +671,16 @@ static int rtk_spi_nor_probe(struct platform_device *pdev)
 	rtk_spi_nor_init(host);
 
 	ret = spi_register_controller(ctrl);
-	if (ret < 0)
+	if (ret < 0) {
 		mutex_destroy(&host->lock);
+		return ret;
+	}
 
-	return ret;
+	host->debugfs = debugfs_create_dir("rtk-sfc", NULL);
+	debugfs_create_file("stats", 0444, host->debugfs, host,
+			    &rtk_spi_nor_stats_fops);
+
+	return 0;
 }
 
 static int rtk_spi_nor_remove(struct platform_device *pdev)
@@ -536,6 +688,7 @@ static int rtk_spi_nor_remove(struct platform_device *pdev)
 	struct spi_controller *ctrl = platform_get_drvdata(pdev);
 	struct rtksfc_host *host = spi_controller_get_devdata(ctrl);
 
+	debugfs_remove_recursive(host->debugfs);
 	mutex_destroy(&host->lock);
 
 	return 0;
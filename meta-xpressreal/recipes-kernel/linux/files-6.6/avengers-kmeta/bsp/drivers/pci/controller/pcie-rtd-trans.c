@@ -24,9 +24,15 @@ struct regmap *pcie0_base;
 struct regmap *pcie1_base;
 struct regmap *pcie2_base;
 
+/*
+ * Accesses below 64K go straight through the fixed translation and only
+ * take the lock shared, so they run in parallel. Accesses above 64K
+ * retarget PCIE_TRANS_0 for everyone and take it exclusively.
+ */
 struct pcie_info {
 	struct regmap *base;
-	spinlock_t spinlock;
+	void __iomem *ctrl_base;
+	rwlock_t lock;
 	void __iomem *mmio_base;
 	struct device *dev;
 };
@@ -41,6 +47,9 @@ u32 rtk_pcie_ctrl_read(struct pcie_info *info, u32 offset)
 {
 	u32 val;
 
+	if (info->ctrl_base)
+		return readl(info->ctrl_base + offset);
+
 	regmap_read(info->base, offset, &val);
 
 	return val;
@@ -48,6 +57,11 @@ u32 rtk_pcie_ctrl_read(struct pcie_info *info, u32 offset)
 
 void rtk_pcie_ctrl_write(struct pcie_info *info, u32 offset, u32 val)
 {
+	if (info->ctrl_base) {
+		writel(val, info->ctrl_base + offset);
+		return;
+	}
+
 	regmap_write(info->base, offset, val);
 }
 
@@ -103,14 +117,24 @@ u32 rtk_pcie_read(struct pcie_info *info, u32 addr, u8 size)
 	int retry_cnt = 0;
 	u8 retry = 5;
 
-	spin_lock_irqsave(&info->spinlock, irqL);
+	if (addr < 0x10000) {
+		read_lock_irqsave(&info->lock, irqL);
+		rval = rtk_pcie_mmio_read(info, addr, size);
+		pci_error_status = rtk_pcie_ctrl_read(info, 0xc7c);
+		read_unlock_irqrestore(&info->lock, irqL);
+		if (!(pci_error_status & 0x1F))
+			return rval;
+		/* clearing 0xc7c and retrying must not race the other readers */
+	}
 
+	write_lock_irqsave(&info->lock, irqL);
 	if (addr >= 0x10000) {
 		mask = PCIE_IO_64K_MASK;
 		translate_val = rtk_pcie_ctrl_read(info, 0xD04);
 		rtk_pcie_ctrl_write(info, 0xD04, translate_val | (addr & mask));
-	} else
+	} else {
 		mask = 0x0;
+	}
 
 pci_read_13xx_retry:
 
@@ -132,9 +156,7 @@ pci_read_13xx_retry:
 
 	if (addr >= 0x10000)
 		rtk_pcie_ctrl_write(info, 0xD04, translate_val);
-
-
-	spin_unlock_irqrestore(&info->spinlock, irqL);
+	write_unlock_irqrestore(&info->lock, irqL);
 
 	return rval;
 }
@@ -146,22 +168,24 @@ void rtk_pcie_write(struct pcie_info *info, u32 addr, u8 size, u32 wval)
 	u32 translate_val = 0;
 	unsigned long irqL;
 
-	spin_lock_irqsave(&info->spinlock, irqL);
+	if (addr < 0x10000) {
+		read_lock_irqsave(&info->lock, irqL);
+		rtk_pcie_mmio_write(info, addr, wval, size);
+		read_unlock_irqrestore(&info->lock, irqL);
+		return;
+	}
 
-	if (addr >= 0x10000) {
-		mask = PCIE_IO_64K_MASK;
-		translate_val = rtk_pcie_ctrl_read(info, 0xD04);
-		rtk_pcie_ctrl_write(info, 0xD04, translate_val | (addr & mask));
-	} else
-		mask = 0x0;
+	write_lock_irqsave(&info->lock, irqL);
 
-	rtk_pcie_mmio_write(info, addr & ~mask, wval, size);
+	mask = PCIE_IO_64K_MASK;
+	translate_val = rtk_pcie_ctrl_read(info, 0xD04);
+	rtk_pcie_ctrl_write(info, 0xD04, translate_val | (addr & mask));
 
-	if (addr >= 0x10000)
-		rtk_pcie_ctrl_write(info, 0xD04, translate_val);
+	rtk_pcie_mmio_write(info, addr & ~mask, wval, size);
 
+	rtk_pcie_ctrl_write(info, 0xD04, translate_val);
 
-	spin_unlock_irqrestore(&info->spinlock, irqL);
+	write_unlock_irqrestore(&info->lock, irqL);
 }
 
 u32 rtk_pcie_13xx_read(u32 addr, u8 size)
@@ -228,7 +252,9 @@ static int rtd_pcie_trans_probe(struct platform_device *pdev)
 		return -EINVAL;
 	}
 
-	spin_lock_init(&pcie0_info->spinlock);
+	/* map the controller too so the hot path skips the regmap lock */
+	pcie0_info->ctrl_base = of_iomap(syscon_np, 0);
+	rwlock_init(&pcie0_info->lock);
 
 	syscon_np = of_parse_phandle(pdev->dev.of_node, "syscon", 1);
 	if (IS_ERR_OR_NULL(syscon_np))
@@ -247,7 +273,8 @@ static int rtd_pcie_trans_probe(struct platform_device *pdev)
 		return -EINVAL;
 	}
 
-	spin_lock_init(&pcie1_info->spinlock);
+	pcie1_info->ctrl_base = of_iomap(syscon_np, 0);
+	rwlock_init(&pcie1_info->lock);
 
 	syscon_np = of_parse_phandle(pdev->dev.of_node, "syscon", 2);
 	if (IS_ERR_OR_NULL(syscon_np))
@@ -266,7 +293,8 @@ static int rtd_pcie_trans_probe(struct platform_device *pdev)
 		dev_err(&pdev->dev, "failed to get pcie2 mmio address\n");
 		return -EINVAL;
 	}
-	spin_lock_init(&pcie2_info->spinlock);
+	pcie2_info->ctrl_base = of_iomap(syscon_np, 0);
+	rwlock_init(&pcie2_info->lock);
 
 	dev_info(&pdev->dev, "\n===========rtd13xx pcie mmio translate ready\n");
 
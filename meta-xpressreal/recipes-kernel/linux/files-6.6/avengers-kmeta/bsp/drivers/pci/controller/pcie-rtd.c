@@ -37,9 +37,19 @@
 #include <linux/sys_soc.h>
 #include <linux/arm-smccc.h>
 #include <linux/nvmem-consumer.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/percpu.h>
+#include <linux/iopoll.h>
+#include <linux/pci-ecam.h>
+#include <linux/ktime.h>
 
 #include "pcie-rtd.h"
 
+static bool indirect_cfg;
+module_param(indirect_cfg, bool, 0444);
+MODULE_PARM_DESC(indirect_cfg, "Use indirect config access even when the DT provides a \"cfg\" window");
+
 static void rtd_msi_ack_irq(struct irq_data *d)
 {
 	irq_chip_ack_parent(d);
@@ -69,35 +79,50 @@ static struct msi_domain_info rtd_pcie_msi_domain_info = {
 	.chip	= &rtd_pcie_msi_irq_chip,
 };
 
-/* MSI int handler */
-irqreturn_t rtd_handle_mac_msi_irq(struct rtd_pcie_port *pp)
+static void rtd_msi_handle_vector(struct rtd_pcie_port *pp, int hwirq)
 {
-	int i, pos, irq;
-	unsigned long val;
-	u32 status, num_ctrls;
-	irqreturn_t ret = IRQ_NONE;
+	int irq;
 
-	num_ctrls = RTK_MAX_MSI_IRQS / RTK_MAX_MSI_IRQS_PER_CTRL;
+	if (pp->msi_stats)
+		this_cpu_inc(pp->msi_stats->count[hwirq]);
 
-	for (i = 0; i < num_ctrls; i++) {
-		status = readl(pp->ctrl_base + PCIE_MSI_INTR0_STATUS +
-					(i * RTK_MSI_REG_CTRL_BLOCK_SIZE));
-		if (!status)
-			continue;
+	irq = irq_find_mapping(pp->irq_domain, hwirq);
+	generic_handle_irq(irq);
+}
 
-		ret = IRQ_HANDLED;
-		val = status;
-		pos = 0;
-		while ((pos = find_next_bit(&val, RTK_MAX_MSI_IRQS_PER_CTRL,
-					    pos)) != RTK_MAX_MSI_IRQS_PER_CTRL) {
-			irq = irq_find_mapping(pp->irq_domain,
-					       (i * RTK_MAX_MSI_IRQS_PER_CTRL) +
-					       pos);
-			generic_handle_irq(irq);
-			pos++;
-		}
+static irqreturn_t rtd_handle_mac_msi_ctrl(struct rtd_pcie_port *pp, int ctrl)
+{
+	unsigned long val;
+	u32 status;
+	int pos;
+
+	status = readl(pp->ctrl_base + PCIE_MSI_INTR0_STATUS +
+				(ctrl * RTK_MSI_REG_CTRL_BLOCK_SIZE));
+	if (!status)
+		return IRQ_NONE;
+
+	val = status;
+	pos = 0;
+	while ((pos = find_next_bit(&val, RTK_MAX_MSI_IRQS_PER_CTRL,
+				    pos)) != RTK_MAX_MSI_IRQS_PER_CTRL) {
+		rtd_msi_handle_vector(pp, (ctrl * RTK_MAX_MSI_IRQS_PER_CTRL) + pos);
+		pos++;
 	}
 
+	return IRQ_HANDLED;
+}
+
+/* MSI int handler */
+irqreturn_t rtd_handle_mac_msi_irq(struct rtd_pcie_port *pp)
+{
+	int i;
+	irqreturn_t ret = IRQ_NONE;
+
+	/* only the blocks vectors are allocated from */
+	for (i = 0; i < pp->num_msi_ctrls; i++)
+		if (rtd_handle_mac_msi_ctrl(pp, i) == IRQ_HANDLED)
+			ret = IRQ_HANDLED;
+
 	return ret;
 }
 
@@ -131,6 +156,8 @@ irqreturn_t rtd_handle_wrapper_msi_irq(struct rtd_pcie_port *pp)
 	pos = 0;
 	irq = irq_find_mapping(pp->irq_domain, pos);
 	if (irq != 0) {
+		if (pp->msi_stats)
+			this_cpu_inc(pp->msi_stats->count[pos]);
 		generic_handle_irq(irq);
 		return IRQ_HANDLED;
 	}
@@ -140,7 +167,7 @@ irqreturn_t rtd_handle_wrapper_msi_irq(struct rtd_pcie_port *pp)
 
 irqreturn_t rtd_handle_wrapper_msix_irq(struct rtd_pcie_port *pp)
 {
-	int i, pos, irq;
+	int i, pos;
 	unsigned long val;
 	u32 status, num_ctrls;
 	irqreturn_t ret = IRQ_NONE;
@@ -158,10 +185,8 @@ irqreturn_t rtd_handle_wrapper_msix_irq(struct rtd_pcie_port *pp)
 		pos = 0;
 		while ((pos = find_next_bit(&val, RTK_MAX_MSIX_IRQS_PER_CTRL,
 					    pos)) != RTK_MAX_MSIX_IRQS_PER_CTRL) {
-			irq = irq_find_mapping(pp->irq_domain,
-					       (i * RTK_MAX_MSIX_IRQS_PER_CTRL) +
-					       pos);
-			generic_handle_irq(irq);
+			rtd_msi_handle_vector(pp,
+					      (i * RTK_MAX_MSIX_IRQS_PER_CTRL) + pos);
 			pos++;
 		}
 	}
@@ -185,6 +210,20 @@ static void rtd_chained_msi_isr(struct irq_desc *desc)
 	chained_irq_exit(chip, desc);
 }
 
+/* Chained ISR of one MSI block when each block has its own parent */
+static void rtd_chained_msi_ctrl_isr(struct irq_desc *desc)
+{
+	struct irq_chip *chip = irq_desc_get_chip(desc);
+	struct rtd_msi_parent *parent;
+
+	chained_irq_enter(chip, desc);
+
+	parent = irq_desc_get_handler_data(desc);
+	rtd_handle_mac_msi_ctrl(parent->pp, parent->ctrl);
+
+	chained_irq_exit(chip, desc);
+}
+
 static void rtd_pci_setup_msi_msg(struct irq_data *d, struct msi_msg *msg)
 {
 	struct rtd_pcie_port *pp = irq_data_get_irq_chip_data(d);
@@ -205,13 +244,26 @@ static int rtd_pci_msi_set_affinity(struct irq_data *d,
 				   const struct cpumask *mask, bool force)
 {
 	struct rtd_pcie_port *pp = irq_data_get_irq_chip_data(d);
-	struct irq_chip *parent_chip = irq_get_chip(pp->msi_irq);
-	struct irq_data *parent_data = irq_get_irq_data(pp->msi_irq);
+	int parent_irq = pp->msi_irq;
+	struct irq_chip *parent_chip;
+	struct irq_data *parent_data;
+	int ret;
 
-	if (parent_chip && parent_chip->irq_set_affinity)
-		return parent_chip->irq_set_affinity(parent_data, mask, force);
-	else
+	/* with a parent per block only the vectors of that block follow */
+	if (pp->num_msi_ctrls > 1)
+		parent_irq = pp->msi_parent[d->hwirq / RTK_MAX_MSI_IRQS_PER_CTRL].irq;
+
+	parent_chip = irq_get_chip(parent_irq);
+	parent_data = irq_get_irq_data(parent_irq);
+	if (!parent_chip || !parent_chip->irq_set_affinity)
 		return -EINVAL;
+
+	ret = parent_chip->irq_set_affinity(parent_data, mask, force);
+	if (ret >= 0)
+		irq_data_update_effective_affinity(d,
+				irq_data_get_effective_affinity_mask(parent_data));
+
+	return ret;
 }
 
 static void rtd_pci_mac_bottom_mask(struct irq_data *d)
@@ -388,12 +440,32 @@ static int rtd_pcie_irq_domain_alloc(struct irq_domain *domain,
 	struct rtd_pcie_port *pp = domain->host_data;
 	unsigned long flags;
 	u32 i;
-	int bit;
+	int bit = -ENOSPC, ctrl, best;
 
 	raw_spin_lock_irqsave(&pp->lock, flags);
 
-	bit = bitmap_find_free_region(pp->irq_bitmap, pp->msi_max_vector,
-				      order_base_2(nr_irqs));
+	if (nr_irqs == 1 && pp->num_msi_ctrls > 1) {
+		/* spread single vectors over the blocks so each can be steered */
+		for (best = -1, ctrl = 0; ctrl < pp->num_msi_ctrls; ctrl++) {
+			if (pp->msi_ctrl_used[ctrl] >= RTK_MAX_MSI_IRQS_PER_CTRL)
+				continue;
+			if (best < 0 || pp->msi_ctrl_used[ctrl] < pp->msi_ctrl_used[best])
+				best = ctrl;
+		}
+		if (best >= 0) {
+			bit = find_next_zero_bit(pp->irq_bitmap,
+					(best + 1) * RTK_MAX_MSI_IRQS_PER_CTRL,
+					best * RTK_MAX_MSI_IRQS_PER_CTRL);
+			set_bit(bit, pp->irq_bitmap);
+		}
+	} else {
+		bit = bitmap_find_free_region(pp->irq_bitmap, pp->msi_max_vector,
+					      order_base_2(nr_irqs));
+	}
+
+	if (bit >= 0)
+		for (i = 0; i < nr_irqs; i++)
+			pp->msi_ctrl_used[(bit + i) / RTK_MAX_MSI_IRQS_PER_CTRL]++;
 
 	raw_spin_unlock_irqrestore(&pp->lock, flags);
 
@@ -416,11 +488,14 @@ static void rtd_pcie_irq_domain_free(struct irq_domain *domain,
 	struct irq_data *d = irq_domain_get_irq_data(domain, virq);
 	struct rtd_pcie_port *pp = irq_data_get_irq_chip_data(d);
 	unsigned long flags;
+	u32 i;
 
 	raw_spin_lock_irqsave(&pp->lock, flags);
 
 	bitmap_release_region(pp->irq_bitmap, d->hwirq,
 			      order_base_2(nr_irqs));
+	for (i = 0; i < nr_irqs; i++)
+		pp->msi_ctrl_used[(d->hwirq + i) / RTK_MAX_MSI_IRQS_PER_CTRL]--;
 
 	raw_spin_unlock_irqrestore(&pp->lock, flags);
 }
@@ -455,13 +530,86 @@ int rtd_pcie_allocate_domains(struct rtd_pcie_port *pp)
 	return 0;
 }
 
+#ifdef CONFIG_DEBUG_FS
+static int rtd_pcie_msi_show(struct seq_file *s, void *unused)
+{
+	struct rtd_pcie_port *pp = s->private;
+	struct irq_data *d;
+	unsigned int hwirq, virq, cpu;
+	int parent;
+
+	if (pp->num_msi_ctrls > 1)
+		seq_printf(s, "mode: per-block, %d parent irqs\n", pp->num_msi_ctrls);
+	else
+		seq_printf(s, "mode: chained, parent irq %d\n", pp->msi_irq);
+
+	seq_puts(s, "hwirq  virq parent eff_cpu");
+	for_each_online_cpu(cpu)
+		seq_printf(s, " %10s%u", "CPU", cpu);
+	seq_putc(s, '\n');
+
+	for_each_set_bit(hwirq, pp->irq_bitmap, pp->msi_max_vector) {
+		virq = irq_find_mapping(pp->irq_domain, hwirq);
+		if (!virq)
+			continue;
+		d = irq_get_irq_data(virq);
+		parent = pp->num_msi_ctrls > 1 ?
+			 pp->msi_parent[hwirq / RTK_MAX_MSI_IRQS_PER_CTRL].irq :
+			 pp->msi_irq;
+		seq_printf(s, "%5u %5u %6d %7d", hwirq, virq, parent,
+			   cpumask_first(irq_data_get_effective_affinity_mask(d)));
+		for_each_online_cpu(cpu)
+			seq_printf(s, " %13u",
+				   per_cpu_ptr(pp->msi_stats, cpu)->count[hwirq]);
+		seq_putc(s, '\n');
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(rtd_pcie_msi);
+
+static void rtd_pcie_msi_debugfs_init(struct rtd_pcie_port *pp)
+{
+	if (!pp->msi_stats)
+		return;
+
+	pp->debugfs = debugfs_create_dir(dev_name(pp->dev), NULL);
+	debugfs_create_file("msi", 0444, pp->debugfs, pp, &rtd_pcie_msi_fops);
+}
+#else
+static inline void rtd_pcie_msi_debugfs_init(struct rtd_pcie_port *pp) {}
+#endif
+
+static int rtd_pcie_msi_stats_init(struct rtd_pcie_port *pp)
+{
+	pp->msi_stats = alloc_percpu(struct rtd_msi_stats);
+	if (!pp->msi_stats)
+		return -ENOMEM;
+
+	rtd_pcie_msi_debugfs_init(pp);
+
+	return 0;
+}
+
 void rtd_pcie_free_msi(struct rtd_pcie_port *pp)
 {
-	if (pp->msi_irq) {
+	int i;
+
+	if (pp->num_msi_ctrls > 1) {
+		for (i = 0; i < pp->num_msi_ctrls; i++) {
+			irq_set_chained_handler(pp->msi_parent[i].irq, NULL);
+			irq_set_handler_data(pp->msi_parent[i].irq, NULL);
+		}
+	} else if (pp->msi_irq) {
 		irq_set_chained_handler(pp->msi_irq, NULL);
 		irq_set_handler_data(pp->msi_irq, NULL);
 	}
 
+	debugfs_remove_recursive(pp->debugfs);
+	pp->debugfs = NULL;
+	free_percpu(pp->msi_stats);
+	pp->msi_stats = NULL;
+
 	irq_domain_remove(pp->msi_domain);
 	irq_domain_remove(pp->irq_domain);
 
@@ -472,20 +620,63 @@ void rtd_pcie_free_msi(struct rtd_pcie_port *pp)
 static void rtd_pcie_mac_msi_host_init(struct rtd_pcie_port *pp)
 {
 	u64 msi_target;
+	int i;
 
 	msi_target = (u64)pp->msi_data;
 	writel(upper_32_bits(msi_target), pp->ctrl_base + PCIE_MSI_ADDR_HI);
 	writel(lower_32_bits(msi_target), pp->ctrl_base + PCIE_MSI_ADDR_LO);
 
-	writel(~0x0, pp->ctrl_base + PCIE_MSI_INTR0_ENABLE);
+	for (i = 0; i < pp->num_msi_ctrls; i++) {
+		writel(~0x0, pp->ctrl_base + PCIE_MSI_INTR0_ENABLE +
+		       i * RTK_MSI_REG_CTRL_BLOCK_SIZE);
+	}
+}
+
+/*
+ * Each block of 32 vectors has its own status register. When the DT names
+ * extra "msi1".."msi7" interrupts, give every block its own parent so
+ * vectors can be steered to different CPUs, otherwise keep all vectors in
+ * the first block behind the single chained parent.
+ */
+static void rtd_pcie_mac_msi_parents_init(struct rtd_pcie_port *pp)
+{
+	char name[8];
+	int i, irq;
+
+	pp->num_msi_ctrls = 1;
+	pp->msi_parent[0].pp = pp;
+	pp->msi_parent[0].irq = pp->msi_irq;
+	pp->msi_parent[0].ctrl = 0;
+
+	if (!pp->msi_irq)
+		return;
+
+	for (i = 1; i < RTK_MAX_MSI_CTRLS; i++) {
+		snprintf(name, sizeof(name), "msi%d", i);
+		irq = of_irq_get_byname(pp->dev->of_node, name);
+		if (irq <= 0)
+			break;
+		pp->msi_parent[i].pp = pp;
+		pp->msi_parent[i].irq = irq;
+		pp->msi_parent[i].ctrl = i;
+		pp->num_msi_ctrls++;
+	}
+
+	if (pp->num_msi_ctrls > 1)
+		dev_info(pp->dev, "%d MSI parent irqs, per-block affinity\n",
+			 pp->num_msi_ctrls);
 }
 
 
 static int rtd_pcie_mac_msi_init(struct rtd_pcie_port *pp)
 {
-	int ret;
+	int ret, i;
+
+	rtd_pcie_mac_msi_parents_init(pp);
 
 	pp->msi_max_vector = RTK_MSI_DEF_NUM_VECTORS;
+	if (pp->num_msi_ctrls > 1)
+		pp->msi_max_vector = pp->num_msi_ctrls * RTK_MAX_MSI_IRQS_PER_CTRL;
 	pp->msi_page = alloc_page(GFP_KERNEL);
 	pp->msi_data = dma_map_page(pp->dev, pp->msi_page, 0, PAGE_SIZE,
 				    DMA_FROM_DEVICE);
@@ -502,9 +693,18 @@ static int rtd_pcie_mac_msi_init(struct rtd_pcie_port *pp)
 	if (ret)
 		return ret;
 
-	if (pp->msi_irq)
+	if (rtd_pcie_msi_stats_init(pp))
+		dev_warn(pp->dev, "no MSI statistics\n");
+
+	if (pp->num_msi_ctrls > 1) {
+		for (i = 0; i < pp->num_msi_ctrls; i++)
+			irq_set_chained_handler_and_data(pp->msi_parent[i].irq,
+					rtd_chained_msi_ctrl_isr,
+					&pp->msi_parent[i]);
+	} else if (pp->msi_irq) {
 		irq_set_chained_handler_and_data(pp->msi_irq,
 				rtd_chained_msi_isr, pp);
+	}
 
 	return 0;
 
@@ -544,6 +744,9 @@ static int rtd_pcie_wrapper_msi_init(struct rtd_pcie_port *pp)
 	if (ret)
 		return ret;
 
+	if (rtd_pcie_msi_stats_init(pp))
+		dev_warn(pp->dev, "no MSI statistics\n");
+
 	if (pp->msi_irq) {
 		if (soc_att_match) {
 			ret = request_irq(pp->msi_irq, rtd13xx_handle_wrapper_msi_irq, IRQF_SHARED, pp->ops->name, pp);
@@ -585,6 +788,9 @@ static int rtd_pcie_wrapper_msix_init(struct rtd_pcie_port *pp)
 	if (ret)
 		return ret;
 
+	if (rtd_pcie_msi_stats_init(pp))
+		dev_warn(pp->dev, "no MSI statistics\n");
+
 	if (pp->msi_irq)
 		irq_set_chained_handler_and_data(pp->msi_irq,
 				rtd_chained_msi_isr, pp);
@@ -643,9 +849,8 @@ static unsigned long pci_bit_shift(unsigned long addr)
 static int indirect_cfg_read(struct rtd_pcie_port *pp, struct pci_bus *bus, unsigned long addr, u32 *pdata,
 						unsigned char size)
 {
-	unsigned long status;
+	u32 status;
 	unsigned char mask;
-	int try_count = 20000;
 
 	if (pci_is_root_bus(bus) && ADDR_TO_DEVICE_NO(addr) != 0)
 		return PCIBIOS_DEVICE_NOT_FOUND;
@@ -665,12 +870,9 @@ static int indirect_cfg_read(struct rtd_pcie_port *pp, struct pci_bus *bus, unsi
 	writel(BYTE_CNT(mask) | BYTE_EN | WRRD_EN(0), pp->ctrl_base + PCIE_CFG_EN);
 	writel(GO_CT, pp->ctrl_base + PCIE_CFG_CT);
 
-	do {
-		status = readl(pp->ctrl_base + PCIE_CFG_ST);
-		udelay(50);
-	} while (!(status & CFG_ST_DONE) && try_count--);
-
-	if (try_count < 0) {
+	/* a request completes in about a microsecond, don't sleep 50us first */
+	if (readl_poll_timeout_atomic(pp->ctrl_base + PCIE_CFG_ST, status,
+				      status & CFG_ST_DONE, 1, 1000000)) {
 		dev_err(pp->dev, "Read config data (%p) failed - timeout\n",
 											(void *) addr);
 		goto error_occur;
@@ -712,6 +914,7 @@ static int rtd_pcie_rd_conf(struct pci_bus *bus, unsigned int devfn,
 	u8 retry = 5;
 	struct rtd_pcie_port *pp = bus->sysdata;
 
+	pp->cfg_reads++;
 again:
 
 	address = pci_address_conversion(bus, devfn, reg);
@@ -753,9 +956,8 @@ static int indirect_cfg_write(struct rtd_pcie_port *pp,
 					struct pci_bus *bus, unsigned long addr,
 					unsigned long data, unsigned char size)
 {
-	unsigned long status;
+	u32 status;
 	unsigned char mask;
-	int try_count = 1000;
 
 	if (pci_is_root_bus(bus) && ADDR_TO_DEVICE_NO(addr) != 0)
 		return PCIBIOS_DEVICE_NOT_FOUND;
@@ -783,12 +985,8 @@ static int indirect_cfg_write(struct rtd_pcie_port *pp,
 
 	writel(GO_CT, pp->ctrl_base + PCIE_CFG_CT);
 
-	do {
-		status = readl(pp->ctrl_base + PCIE_CFG_ST);
-		udelay(50);
-	} while (!(status & CFG_ST_DONE) && try_count--);
-
-	if (try_count < 0) {
+	if (readl_poll_timeout_atomic(pp->ctrl_base + PCIE_CFG_ST, status,
+				      status & CFG_ST_DONE, 1, 50000)) {
 		dev_err(pp->dev, "Write config data (%p) failed - timeout\n",
 							(void *) addr);
 		goto error_occur;
@@ -821,6 +1019,7 @@ static int rtd_pcie_wr_conf(struct pci_bus *bus, unsigned int devfn,
 	//dev_info(&bus->dev, "wr_conf bus:%d reg = 0x%x, val = 0x%x\n",
 	//						bus->number, reg, val);
 
+	pp->cfg_writes++;
 	address = pci_address_conversion(bus, devfn, reg);
 	ret = indirect_cfg_write(pp, bus, address, val, size);
 
@@ -832,6 +1031,79 @@ static struct pci_ops rtd_pcie_cfg_ops = {
 	.write = rtd_pcie_wr_conf,
 };
 
+/*
+ * The root port's own config space is the DBI view at the start of the
+ * controller registers, and the "cfg" window maps the downstream buses
+ * ECAM style. Both are plain loads and stores, no handshake, and no
+ * PCIE_RCPL_ST retry either, so they are only used when the DT opts in
+ * with a "cfg" window.
+ */
+static void __iomem *rtd_pcie_map_bus(struct pci_bus *bus,
+				      unsigned int devfn, int where)
+{
+	struct rtd_pcie_port *pp = bus->sysdata;
+	unsigned int busn;
+
+	if (pci_is_root_bus(bus))
+		return PCI_SLOT(devfn) ? NULL : pp->ctrl_base + where;
+
+	busn = bus->number - pp->root_busnr - 1;
+	if (busn >= pp->cfg_buses)
+		return NULL;
+
+	return pp->cfg_base + PCIE_ECAM_OFFSET(busn, devfn, where);
+}
+
+static int rtd_pcie_direct_rd_conf(struct pci_bus *bus, unsigned int devfn,
+				   int reg, int size, u32 *pval)
+{
+	struct rtd_pcie_port *pp = bus->sysdata;
+
+	pp->cfg_reads++;
+
+	return pci_generic_config_read(bus, devfn, reg, size, pval);
+}
+
+static int rtd_pcie_direct_wr_conf(struct pci_bus *bus, unsigned int devfn,
+				   int reg, int size, u32 val)
+{
+	struct rtd_pcie_port *pp = bus->sysdata;
+
+	pp->cfg_writes++;
+
+	return pci_generic_config_write(bus, devfn, reg, size, val);
+}
+
+static struct pci_ops rtd_pcie_direct_cfg_ops = {
+	.map_bus = rtd_pcie_map_bus,
+	.read = rtd_pcie_direct_rd_conf,
+	.write = rtd_pcie_direct_wr_conf,
+};
+
+static void rtd_pcie_cfg_init(struct rtd_pcie_port *pp)
+{
+	struct platform_device *pdev = to_platform_device(pp->dev);
+	struct resource *res;
+
+	if (indirect_cfg)
+		return;
+
+	res = platform_get_resource_byname(pdev, IORESOURCE_MEM, "cfg");
+	if (!res)
+		return;
+
+	pp->cfg_base = devm_ioremap_resource(pp->dev, res);
+	if (IS_ERR(pp->cfg_base)) {
+		dev_warn(pp->dev, "cannot map config window, using indirect access\n");
+		pp->cfg_base = NULL;
+		return;
+	}
+
+	pp->cfg_buses = resource_size(res) >> 20;
+	dev_info(pp->dev, "direct config window %pR, %u buses\n", res,
+		 pp->cfg_buses);
+}
+
 static u32 get_pcie_mac_stat(struct rtd_pcie_port *pp)
 {
 	int timeout = 10000;
@@ -879,7 +1151,8 @@ static int pcie_link_init(struct rtd_pcie_port *pp)
 	if (ret)
 		dev_err(pp->dev, "cannot set gpio\n");
 
-	writel(0x001E0022, pp->ctrl_base + PCIE_SYS_CTR);
+	writel(0x001E0022 | (pp->cfg_base ? DIR_CFG_EN : 0),
+	       pp->ctrl_base + PCIE_SYS_CTR);
 	writel(0x00010120, pp->ctrl_base + PORT_LINK_CTRL_OFF);
 
 	timeout = PCIE_CONNECT_TIMEOUT;
@@ -990,6 +1263,7 @@ int rtd_pci_get_host_bridge_resources(struct rtd_pcie_port *pp,
 			bus_range->end = bus_range->start + bus_max;
 	}
 	pci_add_resource(resources, bus_range);
+	pp->root_busnr = bus_range->start;
 
 	/* Check for ranges property */
 	err = of_pci_range_parser_init(&parser, dev_node);
@@ -1071,6 +1345,7 @@ static int rtd_pcie_probe(struct platform_device *pdev)
 	u16 child_lnkctl;
 	u16 aspm_support;
 	u32 tmp;
+	ktime_t start;
 
 
 	resource_size_t iobase = 0;
@@ -1095,6 +1370,8 @@ static int rtd_pcie_probe(struct platform_device *pdev)
 		pp->ops->get_ca_type(pp);
 	}
 
+	rtd_pcie_cfg_init(pp);
+
 	ret = pp->ops->init(pp);
 	if (ret) {
 		dev_err(dev, "init failed.\n");
@@ -1137,16 +1414,21 @@ static int rtd_pcie_probe(struct platform_device *pdev)
 		goto failed;
 	}
 	bridge->dev.parent = &pdev->dev;
-	bridge->ops = &rtd_pcie_cfg_ops;
+	bridge->ops = pp->cfg_base ? &rtd_pcie_direct_cfg_ops : &rtd_pcie_cfg_ops;
+	bridge->child_ops = bridge->ops;
 	bridge->map_irq = of_irq_parse_and_map_pci;
 	bridge->swizzle_irq = pci_common_swizzle;
 	bridge->sysdata = pp;
 
+	start = ktime_get();
 	ret = pci_scan_root_bus_bridge(bridge);
 	if (ret) {
 		dev_err(pp->dev, "scan root bus failed\n");
 		goto failed;
 	}
+	dev_info(dev, "bus scan %lld us, %u config reads, %u writes (%s)\n",
+		 ktime_us_delta(ktime_get(), start), pp->cfg_reads, pp->cfg_writes,
+		 pp->cfg_base ? "direct" : "indirect");
 	bus = bridge->bus;
 
 	pci_bus_size_bridges(bus);
@@ -40,6 +40,18 @@
 #define MAX_RTK_MSIX_CTRLS	(MAX_RTK_MSI_IRQS / 32)
 
 
+struct rtd_pcie_port;
+
+/* one parent interrupt demultiplexing a block of 32 MSI vectors */
+struct rtd_msi_parent {
+	struct rtd_pcie_port *pp;
+	int irq;
+	int ctrl;
+};
+
+struct rtd_msi_stats {
+	u32 count[RTK_MAX_MSI_IRQS];
+};
 
 struct rtd_pcie_port {
 	struct rtd_pcie_ops *ops;
@@ -76,6 +88,15 @@ struct rtd_pcie_port {
 	raw_spinlock_t lock;
 	DECLARE_BITMAP(irq_bitmap, RTK_MAX_MSI_IRQS);
 	int ca_type;
+	struct rtd_msi_parent msi_parent[RTK_MAX_MSI_CTRLS];
+	int num_msi_ctrls;
+	u32 msi_ctrl_used[RTK_MAX_MSI_CTRLS];
+	struct rtd_msi_stats __percpu *msi_stats;
+	struct dentry *debugfs;
+	unsigned int cfg_buses;
+	int root_busnr;
+	u32 cfg_reads;
+	u32 cfg_writes;
 };
 
 struct rtd_pcie_ops {
@@ -23,6 +23,10 @@
 #include <linux/arm-smccc.h>
 #include <linux/delay.h>
 #include <linux/slab.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/ktime.h>
+#include <linux/io.h>
 #include <soc/realtek/rtk_tee.h>
 #include <soc/realtek/memory.h>
 #include <soc/realtek/rtk_ipc_shm.h>
@@ -36,12 +40,24 @@
 #define HIFI_FW   0xff0a
 #define AFW_CERT  21
 #define TOT_NR_FWS 8
+#define VE3_ENTRY_SIZE 0x1000
 
 struct rtk_fw_rproc {
 	struct rproc *rproc;
 	struct device_node *node;
 	unsigned int cert_type;
 	const char *fw_name;
+
+	/* ve3 carve-out, mapped once */
+	void *carveout;
+	size_t carveout_size;
+	size_t fw_offset;
+
+	/* boot phase timing in ns */
+	u64 load_ns;
+	u64 auth_ns;
+	u64 start_ns;
+	u64 boot_ns;
 };
 
 static uint32_t log_addr[TOT_NR_FWS] = { 0 };
@@ -169,6 +185,26 @@ static void log_shm_setup(unsigned int id)
 	}
 }
 
+static int trust_fw_auth(struct rproc *rproc, phys_addr_t paddr, size_t size)
+{
+	struct rtk_fw_rproc *rtk_rproc = rproc->priv;
+	struct arm_smccc_res res;
+	ktime_t start = ktime_get();
+	int ret;
+
+	arm_smccc_smc(0x8400ff39, paddr, size,
+		rtk_rproc->cert_type, 0, 0, 0, 0, &res);
+	rtk_rproc->auth_ns = ktime_get_ns() - ktime_to_ns(start);
+
+	ret = (unsigned int)res.a0;
+	if (ret) {
+		dev_err(&rproc->dev, "process fwtype: %d fail\n", rtk_rproc->cert_type);
+		return ret;
+	}
+
+	return 0;
+}
+
 static int trust_fw_load(struct rproc *rproc, const struct firmware *fw)
 {
 	struct device *dev = &rproc->dev;
@@ -177,12 +213,16 @@ static int trust_fw_load(struct rproc *rproc, const struct firmware *fw)
 	unsigned int size;
 	dma_addr_t dma;
 	void *vaddr = NULL;
-	struct arm_smccc_res res;
+	ktime_t start = ktime_get();
 
 	dev_info(dev->parent, "Find FW Name: %s\n", rtk_rproc->fw_name);
 	dev_info(dev->parent, "size 0x%x\n", (unsigned int)fw->size);
 
-	/* Prepare for dma alloc */
+	/*
+	 * The trust SMC authenticates a physically contiguous copy. These
+	 * nodes have no carve-out to load into, so unlike ve3 the image is
+	 * bounced through a coherent buffer.
+	 */
 	size = PAGE_ALIGN(fw->size);
 
 	/* alloc uncached memory */
@@ -191,17 +231,10 @@ static int trust_fw_load(struct rproc *rproc, const struct firmware *fw)
 		return -ENOMEM;
 
 	memcpy(vaddr, fw->data, fw->size);
+	rtk_rproc->load_ns = ktime_get_ns() - ktime_to_ns(start);
 
-	arm_smccc_smc(0x8400ff39, dma, fw->size,
-		rtk_rproc->cert_type, 0, 0, 0, 0, &res);
-	ret = (unsigned int)res.a0;
-	if (ret) {
-		dev_err(dev, "process fwtype: %d fail\n", rtk_rproc->cert_type);
-		goto err;
-	}
+	ret = trust_fw_auth(rproc, dma, fw->size);
 
-	ret = 0;
-err:
 	dma_free_coherent(dev->parent, size, vaddr, dma);
 
 	return ret;
@@ -450,51 +483,49 @@ static int vcpu_stop(struct rproc *rproc)
 #define VE3_A_ENTRY   0x04200000
 #define VE3_MEM_START 0x04201000
 
-static int ve3_fw_load(struct rproc *rproc, const struct firmware *fw)
+static int ve3_entry_load(struct rproc *rproc)
 {
 	struct device *dev = &rproc->dev;
-	struct device_node *node;
 	struct rtk_fw_rproc *rtk_rproc = rproc->priv;
-	unsigned int size;
-	struct reserved_mem *rmem;
-	phys_addr_t paddr;
-	void __iomem *vaddr;
 	const struct firmware *ve3_entry_fw;
-	unsigned int ve3_entry_size;
 	int ret;
 
-	dev_info(dev->parent, "Find FW Name: %s\n", rtk_rproc->fw_name);
-	dev_info(dev->parent, "size 0x%x\n", (unsigned int)fw->size);
-
-	ret = request_firmware(&ve3_entry_fw, "ve3_entry.img", dev);
+	ret = request_firmware_into_buf(&ve3_entry_fw, "ve3_entry.img", dev,
+					rtk_rproc->carveout, VE3_ENTRY_SIZE);
 	if (ret < 0) {
 		dev_err(dev, "request_firmware failed: %d\n", ret);
 		return ret;
 	}
+	release_firmware(ve3_entry_fw);
 
-	ve3_entry_size = PAGE_ALIGN(ve3_entry_fw->size);
+	return 0;
+}
 
-	size = PAGE_ALIGN(fw->size);
+static int ve3_fw_load(struct rproc *rproc, const struct firmware *fw)
+{
+	struct device *dev = &rproc->dev;
+	struct rtk_fw_rproc *rtk_rproc = rproc->priv;
+	ktime_t start = ktime_get();
+	int ret;
+
+	dev_info(dev->parent, "Find FW Name: %s\n", rtk_rproc->fw_name);
+	dev_info(dev->parent, "size 0x%x\n", (unsigned int)fw->size);
 
-	node = of_parse_phandle(rtk_rproc->node, "memory-region", 0);
-	rmem = of_reserved_mem_lookup(node);
-	if (!rmem) {
+	if (!rtk_rproc->carveout) {
 		dev_err(dev->parent, "Failed to find reserved memory region for VE3FW\n");
 		return -ENOMEM;
 	}
 
-	paddr = rmem->base;
+	if (fw->size > rtk_rproc->carveout_size - rtk_rproc->fw_offset)
+		return -EFBIG;
 
-	vaddr = ioremap(paddr, rmem->size);
-	if (!vaddr) {
-		dev_err(dev->parent, "Failed to ioremap reserved memory\n");
-		return -ENOMEM;
-	}
+	ret = ve3_entry_load(rproc);
+	if (ret)
+		return ret;
 
-	memcpy(vaddr, ve3_entry_fw->data, ve3_entry_size);
-	memcpy(vaddr + 0x1000, fw->data, size);
+	memcpy(rtk_rproc->carveout + rtk_rproc->fw_offset, fw->data, fw->size);
+	rtk_rproc->load_ns = ktime_get_ns() - ktime_to_ns(start);
 
-	release_firmware(ve3_entry_fw);
 	return 0;
 }
 
@@ -791,6 +822,60 @@ static const struct rproc_ops ve3_ops = {
 	.stop = ve3_stop,
 };
 
+static int rtk_fw_carveout_init(struct device *dev, struct rtk_fw_rproc *rtk_rproc)
+{
+	struct device_node *np;
+	struct reserved_mem *rmem;
+
+	np = of_parse_phandle(rtk_rproc->node, "memory-region", 0);
+	if (!np)
+		return 0;
+
+	rmem = of_reserved_mem_lookup(np);
+	of_node_put(np);
+	if (!rmem || rmem->size <= rtk_rproc->fw_offset) {
+		dev_err(dev, "Invalid reserved memory region for %s\n",
+			rtk_rproc->fw_name);
+		return -EINVAL;
+	}
+
+	/* mapped once and reused by every later load */
+	rtk_rproc->carveout = devm_memremap(dev, rmem->base, rmem->size,
+					    MEMREMAP_WC);
+	if (IS_ERR(rtk_rproc->carveout)) {
+		dev_err(dev, "Failed to map reserved memory\n");
+		rtk_rproc->carveout = NULL;
+		return -ENOMEM;
+	}
+	rtk_rproc->carveout_size = rmem->size;
+
+	return 0;
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int rtk_fw_timing_show(struct seq_file *s, void *unused)
+{
+	struct rtk_fw_rproc *rtk_rproc = s->private;
+
+	seq_printf(s, "load : %llu us\n", div_u64(rtk_rproc->load_ns, NSEC_PER_USEC));
+	seq_printf(s, "auth : %llu us\n", div_u64(rtk_rproc->auth_ns, NSEC_PER_USEC));
+	seq_printf(s, "start: %llu us\n", div_u64(rtk_rproc->start_ns, NSEC_PER_USEC));
+	seq_printf(s, "total: %llu us\n", div_u64(rtk_rproc->boot_ns, NSEC_PER_USEC));
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(rtk_fw_timing);
+
+static void rtk_fw_create_debugfs(struct rproc *rproc)
+{
+	if (rproc->dbg_dir)
+		debugfs_create_file("boot_timing", 0400, rproc->dbg_dir,
+				    rproc->priv, &rtk_fw_timing_fops);
+}
+#else
+static inline void rtk_fw_create_debugfs(struct rproc *rproc) {}
+#endif
+
 static int rtk_register_rproc(struct device *dev, struct device_node *node)
 {
 	struct rtk_fw_rproc *rtk_rproc;
@@ -798,6 +883,7 @@ static int rtk_register_rproc(struct device *dev, struct device_node *node)
 	int ret = 0;
 	const char *fw_name, *fw_type;
 	const struct rproc_ops *ops;
+	ktime_t boot_start;
 
 	ret = of_property_read_string(node, "type-firmware",
 				      &fw_type);
@@ -850,14 +936,25 @@ static int rtk_register_rproc(struct device *dev, struct device_node *node)
 		rtk_rproc->cert_type = HIFI_FW;
 	else if (!strcmp(fw_type, "avcert"))
 		rtk_rproc->cert_type = AFW_CERT;
+	else if (!strcmp(fw_type, "ve3"))
+		rtk_rproc->fw_offset = VE3_ENTRY_SIZE;
 
 	dev_set_drvdata(dev, rproc);
 
+	if (ops == &ve3_ops) {
+		ret = rtk_fw_carveout_init(dev, rtk_rproc);
+		if (ret)
+			goto err_free_rproc;
+	}
+
+	boot_start = ktime_get();
+
 	ret = rproc_add(rproc);
 	if (ret) {
 		dev_err(&rproc->dev, "rproc_add failed\n");
-		goto err_put_rproc;
+		goto err_free_rproc;
 	}
+	rtk_fw_create_debugfs(rproc);
 
 	ret = rproc_boot(rproc);
 	if (ret) {
@@ -866,11 +963,17 @@ static int rtk_register_rproc(struct device *dev, struct device_node *node)
 		dev_err(&rproc->dev, "rproc_boot failed\n");
 		goto err_put_rproc;
 	}
+	rtk_rproc->boot_ns = ktime_get_ns() - ktime_to_ns(boot_start);
+	rtk_rproc->start_ns = rtk_rproc->boot_ns - rtk_rproc->load_ns -
+			      rtk_rproc->auth_ns;
+	dev_info(dev, "%s boot done in %llu us\n", fw_type,
+		 div_u64(rtk_rproc->boot_ns, NSEC_PER_USEC));
 
 	return 0;
 
 err_put_rproc:
 	rproc_del(rproc);
+err_free_rproc:
 	rproc_free(rproc);
 err:
 	return ret;
@@ -974,6 +1077,8 @@ static struct platform_driver rtk_rproc_driver = {
 		.name = "rtk-rproc",
 		.of_match_table = rtk_rproc_of_match,
 		.pm = &rtk_fw_rproc_pm_ops,
+		/* co-processors are independent, bring them up concurrently */
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 };
 
@@ -4,7 +4,9 @@
  */
 
 #include <linux/kref.h>
+#include <linux/bitmap.h>
 #include <linux/cdev.h>
+#include <linux/delay.h>
 #include <linux/device.h>
 #include <linux/mutex.h>
 #include <linux/kthread.h>
@@ -25,6 +27,7 @@
 #include "buflock.h"
 
 #define OFFSET_FROM_ID(id) (id * 4)
+#define ID_FROM_FWID(module, fwid) ((size_t)((fwid) - (module)->uStatusPhyAddr) / 4)
 
 #define MODULE_TAG "buflock :"
 
@@ -80,7 +83,10 @@ struct buflock_module {
     struct list_head        handles;
     struct list_head        free_handles;
     wait_queue_head_t       free_queue;
+    size_t                  free_count;
     size_t                  next_id;
+    unsigned long *         id_map;     /* ids owned by handles + free_handles */
+    struct buflock_handle **id_table;   /* active handles indexed by id */
 
     struct mutex            clients_lock;
     struct list_head        clients; /* buflock_client */
@@ -109,6 +115,8 @@ static unsigned int             buflock_handle_refCount             (struct bufl
 static int                      buflock_handle_setStatus            (struct buflock_handle * handle, buflock_status_t status);
 static buflock_status_t         buflock_handle_getStatus            (struct buflock_handle * handle);
 static size_t                   buflock_module_get_unused_id_unlock (struct buflock_module * module);
+static void                     buflock_module_put_id_unlock        (struct buflock_module * module, struct buflock_handle * handle);
+static void                     buflock_module_reclaim_unlock       (struct buflock_module * module, bool force);
 static struct buflock_handle *  buflock_module_handle_create        (struct buflock_module * module);
 static struct buflock_handle *  buflock_module_handle_get_by_fwid   (struct buflock_module * module, buflock_fwid_t fwid);
 static int                      buflock_module_independent          (struct buflock_module * module, buflock_fwid_t fwid, struct buflock_client * pClient);
@@ -148,6 +156,8 @@ static struct buflock_handle * buflock_handle_create(struct buflock_module * mod
     struct buflock_handle * ret = NULL;
     do {
         ret = (struct buflock_handle *) kzalloc(sizeof(struct buflock_handle), GFP_KERNEL);
+        if (!ret)
+            break;
 
         kref_init       (&ret->ref);
         mutex_init      (&ret->mutex);
@@ -233,23 +243,35 @@ static struct buflock_handle * buflock_module_handle_create        (struct buflo
     struct buflock_handle * ret = NULL;
     mutex_lock(&module->handles_lock);
     do {
-        size_t              id      = buflock_module_get_unused_id_unlock(module);
-        buflock_fwid_t      fwid    = module->uStatusPhyAddr + OFFSET_FROM_ID(id);
-        buflock_status_t *  pStatus = &module->pStatusMemory[OFFSET_FROM_ID(id)];
+        size_t              id;
+        buflock_fwid_t      fwid;
+        buflock_status_t *  pStatus;
         struct buflock_handle * handle;
 
+        id = buflock_module_get_unused_id_unlock(module);
+        if (id >= module->max_handles && module->free_count) {
+            /* out of ids, take back the ones the consumer has released */
+            buflock_module_reclaim_unlock(module, false);
+            id = buflock_module_get_unused_id_unlock(module);
+        }
         if (id >= module->max_handles)
             break;
 
-        module->next_id = id + 1;
-        if (module->next_id >= module->max_handles)
-            module->next_id = 0;
+        fwid    = module->uStatusPhyAddr + OFFSET_FROM_ID(id);
+        pStatus = &module->pStatusMemory[OFFSET_FROM_ID(id)];
 
         handle = buflock_handle_create(module, id, fwid, pStatus);
 
         if (!handle)
             break;
 
+        set_bit(id, module->id_map);
+        module->id_table[id] = handle;
+
+        module->next_id = id + 1;
+        if (module->next_id >= module->max_handles)
+            module->next_id = 0;
+
         handle->sTime.create = ktime_get();
 
         handle->module  = module;
@@ -266,31 +288,54 @@ static struct buflock_handle * buflock_module_handle_create        (struct buflo
     return ret;
 }
 
+/* returns max_handles when every id is taken */
 static size_t buflock_module_get_unused_id_unlock (struct buflock_module * module)
 {
-    size_t ret = module->next_id;
+    size_t ret;
+
+    ret = find_next_zero_bit(module->id_map, module->max_handles, module->next_id);
+    if (ret >= module->max_handles && module->next_id != 0)
+        ret = find_first_zero_bit(module->id_map, module->max_handles);
+
+    return ret;
+}
+
+static void buflock_module_put_id_unlock (struct buflock_module * module, struct buflock_handle * handle)
+{
+    handle->setStatus(handle, E_BUFLOCK_ST_ERROR);
+    clear_bit(handle->id, module->id_map);
+    buflock_handle_destroy(&handle->ref);
+}
+
+/* destroy handles whose lock was cleared by the consumer, or timed out */
+static void buflock_module_reclaim_unlock (struct buflock_module * module, bool force)
+{
     struct buflock_handle * handle, * tmp_handle;
-REDISCOVER:
-    list_for_each_entry_safe(handle,  tmp_handle, &module->handles, list) {
-        if (handle && handle->id == ret) {
-            ret++;
-            goto REDISCOVER;
-        }
-    }
+    ktime_t now = ktime_get();
+
     list_for_each_entry_safe(handle,  tmp_handle, &module->free_handles, list) {
-        if (handle && handle->id == ret) {
-            ret++;
-            goto REDISCOVER;
+        bool remove = false;
+        switch (handle->getStatus(handle)) {
+            case E_BUFLOCK_ST_NORMAL:
+            case E_BUFLOCK_ST_RELEASE:
+                remove = true;
+                break;
+            default:
+                if (force || ktime_ms_delta(now, handle->sTime.destroy) > module->destroy_timeout_ms) {
+                    remove = true;
+                    pr_err("%s Destroy handle(%p) timeout! ***FORCED RELEASE*** (id=%zu fwid=%u, status=%s)\n",
+                            MODULE_TAG, handle,
+                            handle->id, handle->getFWID(handle), getStatusStr(handle->getStatus(handle)));
+                }
+                break;
         }
-    }
 
-    if (ret == module->max_handles && module->next_id != 0) {
-        module->next_id = 0;
-        ret = 0;
-        goto REDISCOVER;
+        if (remove) {
+            list_del(&handle->list);
+            module->free_count--;
+            buflock_module_put_id_unlock(module, handle);
+        }
     }
-
-    return ret;
 }
 
 static void buflock_module_handle_destroy (struct kref *kref)
@@ -301,6 +346,7 @@ static void buflock_module_handle_destroy (struct kref *kref)
 
     mutex_lock(&module->handles_lock);
     list_del(&handle->list);
+    module->id_table[handle->id] = NULL;
 
     pr_debug("%s [-] handle=%p (id=%zu fwid=%u, status=%s)\n", MODULE_TAG, handle,
             handle->id, handle->getFWID(handle), getStatusStr(handle->getStatus(handle)));
@@ -327,75 +373,32 @@ static void buflock_module_handle_destroy (struct kref *kref)
 
     if (delayed_release) {
         list_add(&handle->list, &module->free_handles);
+        if (module->free_count++ == 0)
+            wake_up(&module->free_queue);
     } else {
-        handle->setStatus(handle, E_BUFLOCK_ST_ERROR);
-        buflock_handle_destroy(&handle->ref);
+        buflock_module_put_id_unlock(module, handle);
     }
 
-    wake_up(&module->free_queue);
     mutex_unlock(&module->handles_lock);
 }
 
-static size_t buflock_module_free_count (struct buflock_module * module)
-{
-    size_t ret = 0;
-    mutex_lock(&module->handles_lock);
-    {
-        struct buflock_handle * handle, * tmp_handle;
-        list_for_each_entry_safe(handle,  tmp_handle, &module->free_handles, list) {
-            if (handle)
-                ret++;
-        }
-    }
-    mutex_unlock(&module->handles_lock);
-    return ret;
-}
-
 static int buflock_module_free_thread(void *data)
 {
     struct buflock_module * module = (struct buflock_module *)data;
-    size_t free_cnt = 0;
     for (;;) {
+        /* sleep until a locked handle is destroyed, poll only while some are pending */
+        if (!READ_ONCE(module->free_count))
+            wait_event_interruptible(module->free_queue,
+                    READ_ONCE(module->free_count) || kthread_should_stop());
+        else
+            msleep_interruptible(module->release_loop_ms);
+
         if (kthread_should_stop())
             break;
 
-        wait_event_interruptible_timeout(module->free_queue,
-                (free_cnt != buflock_module_free_count(module)),
-                msecs_to_jiffies(module->release_loop_ms));
-
         mutex_lock(&module->handles_lock);
-        {
-            struct buflock_handle * handle, * tmp_handle;
-            list_for_each_entry_safe(handle,  tmp_handle, &module->free_handles, list) {
-                bool remove = false;
-                switch (handle->getStatus(handle)) {
-                    case E_BUFLOCK_ST_NORMAL:
-                    case E_BUFLOCK_ST_RELEASE:
-                        remove = true;
-                        break;
-                    default:
-                        {
-                            ktime_t now = ktime_get();
-                            if (ktime_ms_delta(now, handle->sTime.destroy) > module->destroy_timeout_ms) {
-                                remove = true;
-                                pr_err("%s Destroy handle(%p) timeout! ***FORCED RELEASE*** (id=%zu fwid=%u, status=%s)\n",
-                                        MODULE_TAG, handle,
-                                        handle->id, handle->getFWID(handle), getStatusStr(handle->getStatus(handle)));
-                            }
-                        }
-                        break;
-                }
-
-                if (remove) {
-                    handle->setStatus(handle, E_BUFLOCK_ST_ERROR);
-                    list_del(&handle->list);
-                    buflock_handle_destroy(&handle->ref);
-                }
-            }
-        }
+        buflock_module_reclaim_unlock(module, false);
         mutex_unlock(&module->handles_lock);
-
-        free_cnt = buflock_module_free_count(module);
     }
 
     return 0;
@@ -404,18 +407,16 @@ static int buflock_module_free_thread(void *data)
 static struct buflock_handle * buflock_module_handle_get_by_fwid (struct buflock_module * module, buflock_fwid_t fwid)
 {
     struct buflock_handle * ret = NULL;
+    size_t id = ID_FROM_FWID(module, fwid);
+
+    if (fwid < module->uStatusPhyAddr || id >= module->max_handles ||
+            fwid != module->uStatusPhyAddr + OFFSET_FROM_ID(id))
+        return NULL;
 
     mutex_lock(&module->handles_lock);
-    {
-        struct buflock_handle * handle, * tmp_handle;
-        list_for_each_entry_safe(handle,  tmp_handle, &module->handles, list) {
-            if (handle && buflock_handle_get_fwid(handle) == fwid) {
-                buflock_handle_get(handle);
-                ret = handle;
-                break;
-            }
-        }
-    }
+    ret = module->id_table[id];
+    if (ret)
+        buflock_handle_get(ret);
     mutex_unlock(&module->handles_lock);
     return ret;
 }
@@ -459,6 +460,15 @@ static int __init buflock_module_init (void)
         module->destroy_timeout_ms = 5000;
         module->max_handles = 4096;
         module->next_id = 0;
+        module->id_map = bitmap_zalloc(module->max_handles, GFP_KERNEL);
+        module->id_table = kcalloc(module->max_handles, sizeof(*module->id_table), GFP_KERNEL);
+        if (!module->id_map || !module->id_table) {
+            bitmap_free(module->id_map);
+            kfree(module->id_table);
+            kfree(module);
+            gModule = NULL;
+            break;
+        }
         INIT_LIST_HEAD(&module->handles);
         INIT_LIST_HEAD(&module->free_handles);
         mutex_init(&module->handles_lock);
@@ -535,22 +545,19 @@ static void __exit buflock_module_exit(void)
 
     kthread_stop(module->kthread);
 
+    mutex_lock(&module->handles_lock);
+    buflock_module_reclaim_unlock(module, true);
     {
         struct buflock_handle * handle, * tmp_handle;
-        list_for_each_entry_safe(handle,  tmp_handle, &module->free_handles, list) {
-            if (handle) {
-                list_del(&handle->list);
-                buflock_handle_destroy(&handle->ref);
-            }
-        }
-
         list_for_each_entry_safe(handle,  tmp_handle, &module->handles, list) {
             if (handle) {
                 list_del(&handle->list);
-                buflock_handle_destroy(&handle->ref);
+                module->id_table[handle->id] = NULL;
+                buflock_module_put_id_unlock(module, handle);
             }
         }
     }
+    mutex_unlock(&module->handles_lock);
 
     {
         device_destroy(module->dev_class, module->device->devt);
@@ -575,6 +582,8 @@ static void __exit buflock_module_exit(void)
     mutex_destroy(&module->handles_lock);
     mutex_destroy(&module->clients_lock);
 
+    bitmap_free(module->id_map);
+    kfree(module->id_table);
     kfree(module);
     gModule = NULL;
 }
@@ -864,10 +873,12 @@ static ssize_t buflock_fops_read (struct file *file, char *buf, size_t size, lof
             break;
 
         s += snprintf(s, size, "#%s phy=%08zx max=%zu checkloop_ms=%d"
-			"\n destroy_timeout_ms=%d\n", MODULE_NAME,
+			"\n destroy_timeout_ms=%d used=%u pending=%zu\n", MODULE_NAME,
 			 (long unsigned int) module->uStatusPhyAddr,
 			 module->max_handles,
-			 module->release_loop_ms, module->destroy_timeout_ms);
+			 module->release_loop_ms, module->destroy_timeout_ms,
+			 bitmap_weight(module->id_map, module->max_handles),
+			 module->free_count);
 
         s += snprintf(s, size, "    clients:\n");
         mutex_lock(&module->clients_lock);
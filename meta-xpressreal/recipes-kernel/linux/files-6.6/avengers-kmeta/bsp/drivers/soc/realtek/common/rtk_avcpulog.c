@@ -13,7 +13,6 @@
 #include <linux/device.h>
 #include <linux/sched.h>
 #include <linux/workqueue.h>
-#include <linux/completion.h>
 #include <linux/of.h>
 #include <linux/delay.h>
 #include <linux/sched.h>
@@ -22,6 +21,11 @@
 #include <linux/hwspinlock.h>
 #include <linux/timer.h>
 #include <linux/sched/clock.h>
+#include <linux/interrupt.h>
+#include <linux/of_irq.h>
+#include <linux/poll.h>
+#include <linux/uio.h>
+#include <linux/wait.h>
 #include <soc/realtek/rtk_ipc_shm.h>
 
 static unsigned int tag_rfsh = 30;
@@ -29,6 +33,11 @@ module_param(tag_rfsh, uint, 0444);
 MODULE_PARM_DESC(tag_rfsh,
 		 "Refresh time of Ktime tag in seconds, default 30s;");
 
+static bool line_ts;
+module_param(line_ts, bool, 0644);
+MODULE_PARM_DESC(line_ts,
+		 "Prefix every log line with the kernel time it was read;");
+
 struct log_device_info_t {
 	char name[16];
 	unsigned int offset;
@@ -43,6 +52,7 @@ static const struct log_device_info_t log_device_info_list[] = {
 #define MODULE_NAME "avlog"
 #define MODULE_NUM (ARRAY_SIZE(log_device_info_list))
 #define WORK_DEF_DELAY_TIME 500 /* msec */
+#define WORK_MIN_DELAY_TIME 10 /* msec */
 #define SYSDBG_MAP_BASE 0x980076E4
 #define TAG_LINE_MAX 128
 
@@ -62,16 +72,27 @@ struct log_device_t {
 	struct avcpu_syslog_struct *syslog_p;
 	struct delayed_work log_check_work;
 	void __iomem *log_buf;
+	int irq;
 	/* dynamic vars */
 	spinlock_t dev_lock;
 	atomic_t cnt;
 	enum LOG_STAT stat;
 	struct task_struct *tsk;
 	unsigned int record_start;
-	struct completion completion;
+	wait_queue_head_t wq;
 	/* dynamic vars doesn't require lock */
 	unsigned int work_delay;
+	unsigned int work_min_delay;
+	unsigned int cur_delay;
 	bool tag_updt;
+	bool line_start;
+	/* statistics */
+	u64 read_bytes;
+	u64 lost_bytes;
+	unsigned long drop_cnt;
+	unsigned long doorbell_cnt;
+	unsigned long poll_cnt;
+	unsigned long wakeup_cnt;
 };
 
 struct avlog_ctl_t {
@@ -105,39 +126,62 @@ static int log_buf_check_adjust(unsigned int *rec_start, unsigned int *end,
 	return ret;
 }
 
+static bool log_avail(struct log_device_t *log_device)
+{
+	return log_device->record_start != log_device->syslog_p->log_end ||
+	       log_device->stat != L_RUNNING;
+}
+
+static void log_wakeup(struct log_device_t *log_device)
+{
+	log_device->wakeup_cnt++;
+	wake_up_interruptible(&log_device->wq);
+}
+
+/*
+ * Fallback for log buffers without a doorbell interrupt. Polls while the
+ * device is open, quickly while firmware keeps logging and backing off
+ * to work_delay once it goes quiet. The reader arms this before it joins
+ * the waitqueue, so finding no sleeper is no reason to stop.
+ */
 static void log_check_work_fn(struct work_struct *work)
 {
 	struct log_device_t *log_device =
 		container_of(work, struct log_device_t, log_check_work.work);
-	uint32_t log_end;
-
-	/* check if log had updated, if yes wake up reader. If not,	*/
-	/* schedule another work and keeps reader sleep.		*/
-	log_end = log_device->syslog_p->log_end;
 
-	spin_lock(&log_device->dev_lock);
-
-	/* Don't do anything if current reader is not in waiting stat */
-	if (log_device->stat != L_WAITING) {
-		spin_unlock(&log_device->dev_lock);
+	log_device->poll_cnt++;
+	if (wq_has_sleeper(&log_device->wq) && log_avail(log_device)) {
+		log_device->cur_delay = log_device->work_min_delay;
+		log_wakeup(log_device);
 		return;
 	}
 
-	if (log_device->record_start != log_end) {
-		complete_all(&log_device->completion);
-		log_device->stat = L_RUNNING;
-	} else {
-		if (!schedule_delayed_work(
-			    &log_device->log_check_work,
-			    msecs_to_jiffies(log_device->work_delay))) {
-			/* wake up reader directly or reader may sleep forever */
-			pr_err("%s: fail to schedule work\n", __func__);
-			log_device->stat = L_ERR;
-			complete_all(&log_device->completion);
-		}
-	}
+	if (log_device->stat != L_RUNNING)
+		return;
 
-	spin_unlock(&log_device->dev_lock);
+	log_device->cur_delay = min(log_device->cur_delay * 2,
+				    log_device->work_delay);
+	schedule_delayed_work(&log_device->log_check_work,
+			      msecs_to_jiffies(log_device->cur_delay));
+}
+
+static irqreturn_t log_doorbell_isr(int irq, void *data)
+{
+	struct log_device_t *log_device = data;
+
+	log_device->doorbell_cnt++;
+	log_wakeup(log_device);
+
+	return IRQ_HANDLED;
+}
+
+static void log_arm_check(struct log_device_t *log_device)
+{
+	/* doorbell wakes the reader, keep a slow poll in case one is missed */
+	schedule_delayed_work(&log_device->log_check_work,
+			      msecs_to_jiffies(log_device->irq > 0 ?
+					       log_device->work_delay :
+					       log_device->cur_delay));
 }
 
 static int rtk_avcpu_log_open(struct inode *inode, struct file *filp)
@@ -162,13 +206,15 @@ static int rtk_avcpu_log_open(struct inode *inode, struct file *filp)
 
 	log_device->tsk = current;
 	log_device->stat = L_RUNNING;
+	log_device->cur_delay = log_device->work_min_delay;
+	log_device->line_start = true;
 	log_buf_check_adjust(&log_device->record_start, &log_end,
 			     log_device->syslog_p->log_buf_len);
 	filp->private_data = log_device;
 	atomic_inc(&log_device->cnt);
 	spin_unlock(&log_device->dev_lock);
 
-	return 0;
+	return stream_open(inode, filp);
 }
 
 static int rtk_avcpu_log_release(struct inode *inode, struct file *filp)
@@ -189,52 +235,69 @@ static int rtk_avcpu_log_release(struct inode *inode, struct file *filp)
 	spin_unlock(&log_device->dev_lock);
 	atomic_dec(&log_device->cnt);
 
-	if (delayed_work_pending(&log_device->log_check_work))
-		cancel_delayed_work_sync(&log_device->log_check_work);
+	cancel_delayed_work_sync(&log_device->log_check_work);
 
 	return 0;
 }
 
-static ssize_t rtk_avcpu_log_read(struct file *filp, char __user *buf,
-				  size_t count, loff_t *f_pos)
+/* copy ring data, prefixing each line with the kernel time when line_ts */
+static size_t log_copy_to_iter(struct log_device_t *log_device,
+			       const char *src, size_t len, struct iov_iter *to,
+			       const char *ts, int ts_len)
 {
+	size_t done = 0, n;
+	const char *nl;
+
+	if (!line_ts)
+		return copy_to_iter(src, len, to);
+
+	while (done < len) {
+		if (log_device->line_start) {
+			if (iov_iter_count(to) <= ts_len)
+				break;
+			if (copy_to_iter(ts, ts_len, to) != ts_len)
+				break;
+			log_device->line_start = false;
+		}
+
+		nl = memchr(src + done, '\n', len - done);
+		n = nl ? nl - (src + done) + 1 : len - done;
+		n = copy_to_iter(src + done, n, to);
+		if (!n)
+			break;
+		if (src[done + n - 1] == '\n')
+			log_device->line_start = true;
+		done += n;
+	}
+
+	return done;
+}
+
+static ssize_t rtk_avcpu_log_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct file *filp = iocb->ki_filp;
 	struct log_device_t *log_device =
 		(struct log_device_t *)filp->private_data;
 	struct avcpu_syslog_struct *p_syslog = log_device->syslog_p;
-	static const char drop_msg[] = "*** LOG DROP ***\n";
-	char *iter = NULL, *tmp_buf = NULL;
-	int err = 0, rcount = 0, log_count = 0, cp_count = 0, tag_cnt;
-	unsigned int idx_start, idx_end;
+	char drop_msg[48];
+	int err = 0, tag_cnt, ts_len = 0;
+	size_t count = iov_iter_count(to), rcount = 0, consumed = 0;
+	unsigned int idx_start, log_count, cp_count, lost = 0;
 	unsigned long flags, rem_nsec;
-	unsigned int log_start, log_end;
+	unsigned int log_start, log_end, new_end;
 	u64 ts_nsec;
-	bool drop = false;
 	u32 sysdbg_ts_usec;
-	char tag_buf[TAG_LINE_MAX];
+	char tag_buf[TAG_LINE_MAX], ts_buf[24];
 
-again:
-	/* if reader wake up by any signal under sleep stat,		*/
-	/* switch back to running stat since it's not cause by error.	*/
-	if (signal_pending(current)) {
-		spin_lock(&log_device->dev_lock);
-		if (log_device->stat == L_WAITING)
-			log_device->stat = L_RUNNING;
-		spin_unlock(&log_device->dev_lock);
-		if (delayed_work_pending(&log_device->log_check_work))
-			cancel_delayed_work(&log_device->log_check_work);
-		return -EINTR;
-	}
-
-	if (!tmp_buf)
-		tmp_buf = vmalloc(count);
-	if (!tmp_buf)
-		return -ENOMEM;
+	if (!count)
+		return 0;
 
+again:
 	spin_lock_irqsave(&log_device->dev_lock, flags);
 
 	if (log_device->stat != L_RUNNING) {
-		err = -EFAULT;
-		goto out;
+		spin_unlock_irqrestore(&log_device->dev_lock, flags);
+		return -EFAULT;
 	}
 
 	log_end = p_syslog->log_end;
@@ -242,19 +305,15 @@ again:
 
 	/* Log buf empty, go to sleep until new log came in */
 	if (log_start == log_end) {
-		log_device->stat = L_WAITING;
-		reinit_completion(&log_device->completion);
-		if (!schedule_delayed_work(
-			    &log_device->log_check_work,
-			    msecs_to_jiffies(log_device->work_delay))) {
-			pr_err("%s: fail to schedule work\n", __func__);
-			log_device->stat = L_ERR;
-			err = -EFAULT;
-			goto out;
-		}
 		spin_unlock_irqrestore(&log_device->dev_lock, flags);
-		/* work should switch stat back to L_RUNNING */
-		wait_for_completion_interruptible(&log_device->completion);
+		if (iocb->ki_flags & IOCB_NOWAIT || filp->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+
+		log_arm_check(log_device);
+		/* if reader wake up by any signal, it's not caused by error */
+		if (wait_event_interruptible(log_device->wq,
+					     log_avail(log_device)))
+			return -EINTR;
 		goto again;
 	}
 
@@ -264,24 +323,17 @@ again:
 	 */
 	if (log_buf_check_adjust(&log_device->record_start, &log_end,
 				 p_syslog->log_buf_len)) {
+		lost = log_device->record_start - log_start;
 		pr_info_ratelimited("%s: drop start:0x%x end:0x%x\n", __func__,
 				    log_start, log_end);
 		log_start = log_device->record_start;
-		drop = true;
+		log_device->lost_bytes += lost;
+		log_device->drop_cnt++;
 	}
-
-	/* Only emit log if no error or DROP happened.			*/
-	/* Ok, now there is valid log inside log buffer. Try to read	*/
-	/* as much as we could.						*/
-	log_count = log_end - log_start;
-	/* make sure if user buffer is enough, if not, fill the buffer */
-	if (log_count > count)
-		cp_count = count;
-	else
-		cp_count = log_count;
+	spin_unlock_irqrestore(&log_device->dev_lock, flags);
 
 	/* Append ktime tag */
-	if (log_device->tag_updt) {
+	if (log_device->tag_updt && avlog_ctl->sysdbg_p) {
 		/* Below two lines should NOT be separated */
 		ts_nsec = local_clock();
 		sysdbg_ts_usec = ioread32(avlog_ctl->sysdbg_p);
@@ -291,84 +343,117 @@ again:
 				   "\n[%5lu.%06lu] SYSDBG:%08x\n\n",
 				   (unsigned long)ts_nsec, rem_nsec / 1000,
 				   sysdbg_ts_usec);
-		if ((tag_cnt > 0) && (count > tag_cnt)) {
-			if ((cp_count + tag_cnt) > count)
-				cp_count -= tag_cnt;
-			rcount += tag_cnt;
-			memcpy(tmp_buf, tag_buf, tag_cnt);
+		if (tag_cnt > 0 && count > tag_cnt) {
+			rcount += copy_to_iter(tag_buf, tag_cnt, to);
 			log_device->tag_updt = false;
 		}
 	}
 
-	if (drop) {
-		int drop_cp_cnt;
-
-		if (count <= strlen(drop_msg)) {
-			pr_info("%s: read buf size %d too small\n", __func__,
-				(int)count);
-			cp_count = 0;
-			rcount += count;
-			drop_cp_cnt = count;
-		} else {
-			cp_count -= strlen(drop_msg);
-			rcount += strlen(drop_msg);
-			drop_cp_cnt = strlen(drop_msg);
-		}
+	if (lost) {
+		tag_cnt = snprintf(drop_msg, sizeof(drop_msg),
+				   "*** LOG DROP %u bytes ***\n", lost);
+		rcount += copy_to_iter(drop_msg,
+				       min_t(size_t, tag_cnt, iov_iter_count(to)), to);
+	}
 
-		memcpy(tmp_buf + rcount, drop_msg, drop_cp_cnt);
+	if (line_ts) {
+		ts_nsec = local_clock();
+		rem_nsec = do_div(ts_nsec, 1000000000);
+		ts_len = snprintf(ts_buf, sizeof(ts_buf), "[%5lu.%06lu] ",
+				  (unsigned long)ts_nsec, rem_nsec / 1000);
 	}
 
-	/* since log_start/end is incremental, need to figure out the	*/
-	/* correct position in the buffer				*/
+	/*
+	 * Ring data is copied without holding the lock, firmware is the only
+	 * writer and there is a single reader.
+	 */
+	log_count = log_end - log_start;
+	cp_count = min_t(size_t, log_count, iov_iter_count(to));
 	idx_start = log_start % p_syslog->log_buf_len;
-	idx_end = log_end % p_syslog->log_buf_len;
-
-	while (!err && cp_count) {
-		int tmp_cnt;
-		bool wrap;
-
-		wrap = (cp_count + idx_start >= p_syslog->log_buf_len) ? true :
-									       false;
-		tmp_cnt = wrap ? (p_syslog->log_buf_len - idx_start) : cp_count;
-
-		iter = log_device->log_buf + idx_start;
-		pr_debug(
-			"%s: tmp_buf:0x%p, rcount:%d, log_buf:0x%p, log_start:0x%x, tmp_cnt:%d\n",
-			__func__, tmp_buf, rcount, log_device->log_buf,
-			idx_start, tmp_cnt);
-		memcpy(tmp_buf + rcount, iter, tmp_cnt);
-		rcount += tmp_cnt;
-		log_start += tmp_cnt;
-		if (log_start > UINT_MAX)
-			log_start -= (UINT_MAX + 1);
+
+	while (cp_count) {
+		size_t tmp_cnt, n;
+
+		tmp_cnt = min_t(unsigned int, cp_count,
+				p_syslog->log_buf_len - idx_start);
+		n = log_copy_to_iter(log_device,
+				     (__force const char *)log_device->log_buf + idx_start,
+				     tmp_cnt, to, ts_buf, ts_len);
+		consumed += n;
+		if (n != tmp_cnt)
+			break;
 		cp_count -= tmp_cnt;
 		idx_start = (idx_start + tmp_cnt) % p_syslog->log_buf_len;
 	}
+	rcount += consumed;
 
-	log_device->record_start = log_start;
-
-out:
+	spin_lock_irqsave(&log_device->dev_lock, flags);
+	/* firmware may have lapped the reader while copying */
+	new_end = p_syslog->log_end;
+	if (new_end - log_start > p_syslog->log_buf_len) {
+		log_device->lost_bytes += new_end - log_start -
+					  p_syslog->log_buf_len;
+		log_device->drop_cnt++;
+	}
+	log_device->record_start = log_start + consumed;
+	log_device->read_bytes += consumed;
 	spin_unlock_irqrestore(&log_device->dev_lock, flags);
 
-	if (!err) {
-		if (copy_to_user(buf, tmp_buf, rcount)) {
-			pr_err("%s: copy fail\n", __func__);
-			err = -EFAULT;
-		}
-	}
+	if (!rcount)
+		err = -EFAULT;
 
-	if (tmp_buf)
-		vfree(tmp_buf);
 	return err ? err : rcount;
 }
 
+static __poll_t rtk_avcpu_log_poll(struct file *filp, poll_table *wait)
+{
+	struct log_device_t *log_device =
+		(struct log_device_t *)filp->private_data;
+
+	poll_wait(filp, &log_device->wq, wait);
+	if (log_device->stat != L_RUNNING)
+		return EPOLLERR;
+	if (log_avail(log_device))
+		return EPOLLIN | EPOLLRDNORM;
+
+	log_arm_check(log_device);
+
+	return 0;
+}
+
 static const struct file_operations rtk_avcpu_log_fops = {
 	.owner = THIS_MODULE,
 	.open = rtk_avcpu_log_open,
-	.read = rtk_avcpu_log_read,
+	.read_iter = rtk_avcpu_log_read_iter,
+	.splice_read = copy_splice_read,
+	.poll = rtk_avcpu_log_poll,
+	.llseek = no_llseek,
 	.release = rtk_avcpu_log_release,
 };
 
+static ssize_t stats_show(struct device *dev, struct device_attribute *attr,
+			  char *buf)
+{
+	struct log_device_t *log_dev = dev_get_drvdata(dev);
+
+	return sysfs_emit(buf,
+			  "read_bytes:%llu\nlost_bytes:%llu\ndrops:%lu\n"
+			  "doorbells:%lu\npolls:%lu\nwakeups:%lu\n"
+			  "pending:%u\n",
+			  log_dev->read_bytes, log_dev->lost_bytes,
+			  log_dev->drop_cnt, log_dev->doorbell_cnt,
+			  log_dev->poll_cnt, log_dev->wakeup_cnt,
+			  min_t(u32, log_dev->syslog_p->log_end - log_dev->record_start,
+				log_dev->syslog_p->log_buf_len));
+}
+static DEVICE_ATTR_RO(stats);
+
+static struct attribute *rtk_avcpu_log_attrs[] = {
+	&dev_attr_stats.attr,
+	NULL,
+};
+ATTRIBUTE_GROUPS(rtk_avcpu_log);
+
 static int parse_dtb(struct log_device_t *log_dev, struct device_node *node)
 {
 	unsigned int val = 0;
@@ -385,6 +470,10 @@ static int parse_dtb(struct log_device_t *log_dev, struct device_node *node)
 	}
 	log_dev->work_delay = val;
 
+	if (of_property_read_u32(node, "log_check_min_period", &val))
+		val = WORK_MIN_DELAY_TIME;
+	log_dev->work_min_delay = min(val, log_dev->work_delay);
+
 	return 0;
 }
 
@@ -452,9 +541,9 @@ static int rtk_avcpu_log_device_init(struct platform_device *pdev,
 		goto out;
 	}
 
-	device = device_create(avlog_ctl->class, NULL,
-			       MKDEV(avlog_major, dev_idx), log_dev,
-			       log_dev->name);
+	device = device_create_with_groups(avlog_ctl->class, NULL,
+					   MKDEV(avlog_major, dev_idx), log_dev,
+					   rtk_avcpu_log_groups, log_dev->name);
 	if (IS_ERR(device)) {
 		pr_err("%s: device_create with ret %d\n", __func__, ret);
 		ret = PTR_ERR(device);
@@ -464,10 +553,25 @@ static int rtk_avcpu_log_device_init(struct platform_device *pdev,
 	log_dev->device = device;
 	atomic_set(&log_dev->cnt, 0);
 	INIT_DELAYED_WORK(&log_dev->log_check_work, log_check_work_fn);
-	init_completion(&log_dev->completion);
+	init_waitqueue_head(&log_dev->wq);
+	log_dev->cur_delay = log_dev->work_min_delay;
 	log_dev->stat = L_PENDING;
 	log_dev->tag_updt = false;
 
+	/* optional doorbell raised by firmware when it logs */
+	log_dev->irq = irq_of_parse_and_map(np, 0);
+	if (log_dev->irq > 0) {
+		ret = devm_request_irq(&pdev->dev, log_dev->irq,
+				       log_doorbell_isr, 0, log_dev->name,
+				       log_dev);
+		if (ret) {
+			pr_info("%s: %s doorbell irq fail %d, polling\n",
+				__func__, log_dev->name, ret);
+			log_dev->irq = 0;
+			ret = 0;
+		}
+	}
+
 out:
 	if (pages)
 		vfree(pages);
@@ -596,6 +700,7 @@ static int rtk_avcpu_shm_log_remove(struct platform_device *pdev)
 		if (log_dev->tsk)
 			send_sig(SIGKILL, log_dev->tsk, 1);
 		spin_unlock(&log_dev->dev_lock);
+		wake_up_interruptible(&log_dev->wq);
 
 		/* wait for 1 sec before reader killed */
 		timeout = jiffies + msecs_to_jiffies(1000);
@@ -12,11 +12,57 @@
 #include <linux/of.h>
 #include <linux/of_address.h>
 #include <linux/clk.h>
+#include <linux/crc32.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/nvmem-consumer.h>
 #include <linux/regulator/consumer.h>
 #include <linux/iopoll.h>
+#include <linux/slab.h>
+#include <linux/thermal.h>
 #include <linux/workqueue.h>
 #include <soc/realtek/rtk_fss.h>
 
+/*
+ * Scan results are cached per temperature band, keyed by the chip id and
+ * the scan config. The cache lives in the optional "fss-cache" nvmem cell
+ * and is also readable/writable as scan/cache, so it can be kept in a file
+ * and loaded before the scan is started. A cached band is only checked at
+ * a few points; the full scan runs when there is no entry or a point fails.
+ * Without a "chip-id" nvmem cell the key cannot tell units apart, so the
+ * cache is not used at all.
+ *
+ * Layout: struct fss_scan_cache_hdr, FSS_SCAN_TEMP_BANDS x num_freqs
+ * voltages (__le32) and a crc32 (__le32) of everything before it.
+ */
+#define FSS_SCAN_CACHE_MAGIC          0x43535346 /* "FSSC" */
+#define FSS_SCAN_CACHE_VERSION        1
+#define FSS_SCAN_TEMP_BANDS           4
+#define FSS_SCAN_TEMP_BAND_WIDTH      20000
+#define FSS_SCAN_SPOT_POINTS          3
+
+struct fss_scan_cache_hdr {
+	__le32 magic;
+	__le16 version;
+	__le16 num_freqs;
+	__le32 key;
+	__le32 valid_bands;
+};
+
+enum {
+	FSS_SCAN_CACHE_NONE,
+	FSS_SCAN_CACHE_HIT,
+	FSS_SCAN_CACHE_MISS,
+	FSS_SCAN_CACHE_STALE,
+};
+
+static const char * const fss_scan_cache_status_names[] = {
+	[FSS_SCAN_CACHE_NONE]  = "none",
+	[FSS_SCAN_CACHE_HIT]   = "hit",
+	[FSS_SCAN_CACHE_MISS]  = "miss",
+	[FSS_SCAN_CACHE_STALE] = "stale",
+};
+
 struct fss_scan_freq {
 	int freq;
 	int target_cdl0;
@@ -42,6 +88,17 @@ struct fss_scan_device {
 
 	struct work_struct        work;
 	int                       freeze_task;
+	int                       force_rescan;
+
+	struct mutex              cache_lock;
+	void                      *cache;
+	size_t                    cache_size;
+	u32                       cache_key;
+	bool                      cache_keyed;
+	struct nvmem_cell         *cache_cell;
+	int                       cache_status;
+	int                       temp_band;
+	unsigned int              duration_ms;
 };
 
 static int fss_scan_set_freq_volt(struct fss_scan_device *fdev, int freq, int volt)
@@ -235,28 +292,166 @@ static int fss_scan(struct fss_scan_device *fdev, struct fss_scan_freq *fc, int
 	return ret;
 }
 
-static void fss_scan_work(struct work_struct *work)
+static __le32 *fss_scan_cache_volts(struct fss_scan_device *fdev, int band)
 {
-	struct fss_scan_device *fdev = container_of(work, struct fss_scan_device, work);
-	int i, j;
-	int volt;
-	int error;
-	int freeze_task = fdev->freeze_task;
+	return fdev->cache + sizeof(struct fss_scan_cache_hdr) +
+		band * fdev->num_freqs * sizeof(__le32);
+}
 
-	fdev->supply = regulator_get(fdev->dev, "cpu");
-	if (IS_ERR(fdev->supply)) {
-		dev_err(fdev->dev, "failed to get regulator: %ld\n",
-				PTR_ERR(fdev->supply));
+static u32 fss_scan_cache_crc(struct fss_scan_device *fdev, const void *cache)
+{
+	return crc32_le(~0, cache, fdev->cache_size - sizeof(__le32));
+}
+
+static int fss_scan_cache_valid(struct fss_scan_device *fdev, const void *cache, size_t size)
+{
+	const struct fss_scan_cache_hdr *hdr = cache;
+	const __le32 *crc = cache + fdev->cache_size - sizeof(__le32);
+
+	return size == fdev->cache_size &&
+		le32_to_cpu(hdr->magic) == FSS_SCAN_CACHE_MAGIC &&
+		le16_to_cpu(hdr->version) == FSS_SCAN_CACHE_VERSION &&
+		le16_to_cpu(hdr->num_freqs) == fdev->num_freqs &&
+		le32_to_cpu(hdr->key) == fdev->cache_key &&
+		le32_to_cpu(*crc) == fss_scan_cache_crc(fdev, cache);
+}
+
+static void fss_scan_cache_seal(struct fss_scan_device *fdev)
+{
+	__le32 *crc = fdev->cache + fdev->cache_size - sizeof(__le32);
+
+	*crc = cpu_to_le32(fss_scan_cache_crc(fdev, fdev->cache));
+}
+
+static void fss_scan_cache_reset(struct fss_scan_device *fdev)
+{
+	struct fss_scan_cache_hdr *hdr = fdev->cache;
+
+	memset(fdev->cache, 0, fdev->cache_size);
+	hdr->magic = cpu_to_le32(FSS_SCAN_CACHE_MAGIC);
+	hdr->version = cpu_to_le16(FSS_SCAN_CACHE_VERSION);
+	hdr->num_freqs = cpu_to_le16(fdev->num_freqs);
+	hdr->key = cpu_to_le32(fdev->cache_key);
+	fss_scan_cache_seal(fdev);
+}
+
+static int fss_scan_cache_lookup(struct fss_scan_device *fdev, int band)
+{
+	struct fss_scan_cache_hdr *hdr = fdev->cache;
+	__le32 *v = fss_scan_cache_volts(fdev, band);
+	int i;
+
+	if (!fdev->cache_keyed || !(le32_to_cpu(hdr->valid_bands) & BIT(band)))
+		return 0;
+
+	for (i = 0; i < fdev->num_freqs; i++)
+		fdev->volts[i] = le32_to_cpu(v[i]);
+	return 1;
+}
+
+static void fss_scan_cache_store(struct fss_scan_device *fdev)
+{
+	int ret;
+
+	fss_scan_cache_seal(fdev);
+
+	if (!fdev->cache_cell)
 		return;
+
+	ret = nvmem_cell_write(fdev->cache_cell, fdev->cache, fdev->cache_size);
+	if (ret < 0)
+		dev_warn(fdev->dev, "failed to write cache cell: %d\n", ret);
+}
+
+static void fss_scan_cache_update(struct fss_scan_device *fdev, int band)
+{
+	struct fss_scan_cache_hdr *hdr = fdev->cache;
+	__le32 *v = fss_scan_cache_volts(fdev, band);
+	int i;
+
+	if (!fdev->cache_keyed)
+		return;
+
+	for (i = 0; i < fdev->num_freqs; i++)
+		v[i] = cpu_to_le32(fdev->volts[i]);
+	hdr->valid_bands = cpu_to_le32(le32_to_cpu(hdr->valid_bands) | BIT(band));
+	fss_scan_cache_store(fdev);
+}
+
+static void fss_scan_cache_invalidate(struct fss_scan_device *fdev, int band)
+{
+	struct fss_scan_cache_hdr *hdr = fdev->cache;
+
+	if (!(le32_to_cpu(hdr->valid_bands) & BIT(band)))
+		return;
+
+	hdr->valid_bands = cpu_to_le32(le32_to_cpu(hdr->valid_bands) & ~BIT(band));
+	fss_scan_cache_store(fdev);
+}
+
+static int fss_scan_temp_band(struct fss_scan_device *fdev)
+{
+	struct thermal_zone_device *tz;
+	int temp;
+
+	tz = thermal_zone_get_zone_by_name("cpu-thermal");
+	if (IS_ERR(tz) || thermal_zone_get_temp(tz, &temp))
+		return 0;
+
+	return clamp(temp / FSS_SCAN_TEMP_BAND_WIDTH, 0, FSS_SCAN_TEMP_BANDS - 1);
+}
+
+/* run the cached voltages once at the first, middle and last frequency */
+static int fss_scan_spot_check(struct fss_scan_device *fdev)
+{
+	int points[FSS_SCAN_SPOT_POINTS] = { 0, fdev->num_freqs / 2, fdev->num_freqs - 1 };
+	int i;
+	int ret;
+
+	for (i = 0; i < FSS_SCAN_SPOT_POINTS; i++) {
+		struct fss_scan_freq *fc = &fdev->freqs[points[i]];
+		struct fss_scan_info info = { 0 };
+		int volt = fdev->volts[points[i]];
+
+		if (i && points[i] == points[i - 1])
+			continue;
+
+		if (!volt)
+			return 0;
+
+		ret = fss_scan_set_freq_volt(fdev, fc->freq, volt);
+		if (ret) {
+			dev_err(fdev->dev, "failed to set freq=%dMHz, volt=%d\n",
+				fc->freq / 1000000, volt);
+			return 0;
+		}
+
+		msleep(200);
+
+		info.fc = fc;
+		info.volt = regulator_get_voltage(fdev->supply);
+		if (!fss_scan_calibrate_and_check(fdev, &info)) {
+			dev_info(fdev->dev, "spot check failed at freq=%d, volt=%d\n",
+				 fc->freq, volt);
+			return 0;
+		}
 	}
 
-	fss_scan_save_state(fdev);
+	return 1;
+}
+
+static int fss_scan_all(struct fss_scan_device *fdev)
+{
+	int i, j;
+	int volt;
+	int error = 0;
+	int freeze_task = fdev->freeze_task;
 
 	if (freeze_task) {
 		error = freeze_processes();
 		if (error) {
 			dev_err(fdev->dev, "failed to freeze processes: %d\n", error);
-			return;
+			return error;
 		}
 	}
 
@@ -276,6 +471,7 @@ static void fss_scan_work(struct work_struct *work)
 
 		if (!best) {
 			dev_err(fdev->dev, "no voltage found\n");
+			error = -ERANGE;
 			break;
 		}
 		volt = fdev->volts[i] = best;
@@ -284,9 +480,57 @@ static void fss_scan_work(struct work_struct *work)
 	if (freeze_task)
 		thaw_processes();
 
+	return error;
+}
+
+static void fss_scan_work(struct work_struct *work)
+{
+	struct fss_scan_device *fdev = container_of(work, struct fss_scan_device, work);
+	ktime_t start = ktime_get();
+	int band;
+	int status;
+
+	fdev->supply = regulator_get(fdev->dev, "cpu");
+	if (IS_ERR(fdev->supply)) {
+		dev_err(fdev->dev, "failed to get regulator: %ld\n",
+				PTR_ERR(fdev->supply));
+		return;
+	}
+
+	fss_scan_save_state(fdev);
+
+	band = fss_scan_temp_band(fdev);
+
+	mutex_lock(&fdev->cache_lock);
+
+	status = FSS_SCAN_CACHE_MISS;
+	if (!fdev->force_rescan && fss_scan_cache_lookup(fdev, band)) {
+		if (fss_scan_spot_check(fdev))
+			status = FSS_SCAN_CACHE_HIT;
+		else
+			status = FSS_SCAN_CACHE_STALE;
+	}
+	fdev->force_rescan = 0;
+
+	if (status != FSS_SCAN_CACHE_HIT) {
+		memset(fdev->volts, 0, fdev->num_freqs * sizeof(*fdev->volts));
+		if (!fss_scan_all(fdev))
+			fss_scan_cache_update(fdev, band);
+		else if (status == FSS_SCAN_CACHE_STALE)
+			fss_scan_cache_invalidate(fdev, band);
+	}
+
+	mutex_unlock(&fdev->cache_lock);
+
 	fss_scan_restore_state(fdev);
 
 	regulator_put(fdev->supply);
+
+	fdev->temp_band = band;
+	fdev->cache_status = status;
+	fdev->duration_ms = ktime_ms_delta(ktime_get(), start);
+	dev_info(fdev->dev, "scan done in %ums, band=%d, cache %s\n", fdev->duration_ms,
+		 band, fss_scan_cache_status_names[status]);
 }
 
 static void fss_scan_wait(struct fss_scan_device *fdev)
@@ -334,6 +578,10 @@ static ssize_t control_store(struct device *dev, struct device_attribute *attr,
 
 	if (!strncmp("start", buf, 5))
 		ret = fss_scan_start(fdev);
+	else if (!strncmp("rescan", buf, 6)) {
+		fdev->force_rescan = 1;
+		ret = fss_scan_start(fdev);
+	}
 	else if (!strncmp("wait", buf, 4))
 		fss_scan_wait(fdev);
 	else
@@ -394,18 +642,91 @@ static ssize_t target_show(struct device *dev, struct device_attribute *attr,
 }
 static DEVICE_ATTR_RO(target);
 
+static ssize_t cache_status_show(struct device *dev, struct device_attribute *attr,
+				 char *buf)
+{
+	struct fss_scan_device *fdev = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%s\n", fss_scan_cache_status_names[fdev->cache_status]);
+}
+static DEVICE_ATTR_RO(cache_status);
+
+static ssize_t duration_ms_show(struct device *dev, struct device_attribute *attr,
+				char *buf)
+{
+	struct fss_scan_device *fdev = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%u\n", fdev->duration_ms);
+}
+static DEVICE_ATTR_RO(duration_ms);
+
+static ssize_t temp_band_show(struct device *dev, struct device_attribute *attr,
+			      char *buf)
+{
+	struct fss_scan_device *fdev = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%d\n", fdev->temp_band);
+}
+static DEVICE_ATTR_RO(temp_band);
+
+static ssize_t cache_read(struct file *filp, struct kobject *kobj,
+			  struct bin_attribute *attr, char *buf,
+			  loff_t off, size_t count)
+{
+	struct fss_scan_device *fdev = dev_get_drvdata(kobj_to_dev(kobj));
+	ssize_t ret;
+
+	mutex_lock(&fdev->cache_lock);
+	ret = memory_read_from_buffer(buf, count, &off, fdev->cache, fdev->cache_size);
+	mutex_unlock(&fdev->cache_lock);
+
+	return ret;
+}
+
+static ssize_t cache_write(struct file *filp, struct kobject *kobj,
+			   struct bin_attribute *attr, char *buf,
+			   loff_t off, size_t count)
+{
+	struct fss_scan_device *fdev = dev_get_drvdata(kobj_to_dev(kobj));
+
+	if (!fdev->cache_keyed)
+		return -ENODEV;
+
+	/* the blob is small, so it has to come in one piece */
+	if (off != 0 || !fss_scan_cache_valid(fdev, buf, count)) {
+		dev_warn(fdev->dev, "cache rejected\n");
+		return -EINVAL;
+	}
+
+	mutex_lock(&fdev->cache_lock);
+	memcpy(fdev->cache, buf, count);
+	mutex_unlock(&fdev->cache_lock);
+
+	return count;
+}
+static BIN_ATTR_RW(cache, 0);
+
 static struct attribute *fss_scan_attrs[] = {
 	&dev_attr_control.attr,
 	&dev_attr_voltages.attr,
 	&dev_attr_frequencies_mhz.attr,
 	&dev_attr_freeze_task.attr,
 	&dev_attr_target.attr,
+	&dev_attr_cache_status.attr,
+	&dev_attr_duration_ms.attr,
+	&dev_attr_temp_band.attr,
+	NULL
+};
+
+static struct bin_attribute *fss_scan_bin_attrs[] = {
+	&bin_attr_cache,
 	NULL
 };
 
 static struct attribute_group fss_scan_attr_group = {
 	.name = "scan",
 	.attrs = fss_scan_attrs,
+	.bin_attrs = fss_scan_bin_attrs,
 };
 
 static int of_parse_config(struct fss_scan_device *fdev, struct device_node *np, int prop_version)
@@ -472,6 +793,88 @@ static int of_parse_config(struct fss_scan_device *fdev, struct device_node *np,
 	return 0;
 }
 
+static int fss_scan_cache_key(struct fss_scan_device *fdev)
+{
+	struct nvmem_cell *cell;
+	u32 key = ~0;
+	u32 cfg[3];
+	void *buf;
+	size_t len;
+	int i;
+
+	cell = nvmem_cell_get(fdev->dev, "chip-id");
+	if (IS_ERR(cell))
+		return PTR_ERR(cell);
+
+	buf = nvmem_cell_read(cell, &len);
+	nvmem_cell_put(cell);
+	if (IS_ERR(buf))
+		return PTR_ERR(buf);
+
+	key = crc32_le(key, buf, len);
+	kfree(buf);
+
+	cfg[0] = fss_control_get_hw_version(fdev->fss_ctl);
+	cfg[1] = fdev->volt_max;
+	cfg[2] = fdev->volt_min;
+	key = crc32_le(key, (void *)cfg, sizeof(cfg));
+
+	for (i = 0; i < fdev->num_freqs; i++) {
+		cfg[0] = fdev->freqs[i].freq;
+		cfg[1] = fdev->freqs[i].target_cdl0;
+		cfg[2] = fdev->freqs[i].target_min_cdl1;
+		key = crc32_le(key, (void *)cfg, sizeof(cfg));
+	}
+
+	fdev->cache_key = key;
+	return 0;
+}
+
+static int fss_scan_cache_init(struct fss_scan_device *fdev)
+{
+	struct nvmem_cell *cell;
+	void *buf;
+	size_t len;
+	int ret;
+
+	mutex_init(&fdev->cache_lock);
+
+	fdev->cache_size = sizeof(struct fss_scan_cache_hdr) +
+		(FSS_SCAN_TEMP_BANDS * fdev->num_freqs + 1) * sizeof(__le32);
+	fdev->cache = devm_kzalloc(fdev->dev, fdev->cache_size, GFP_KERNEL);
+	if (!fdev->cache)
+		return -ENOMEM;
+
+	ret = fss_scan_cache_key(fdev);
+	if (ret == -EPROBE_DEFER)
+		return ret;
+	fdev->cache_keyed = !ret;
+	fss_scan_cache_reset(fdev);
+	if (!fdev->cache_keyed) {
+		dev_info(fdev->dev, "no chip-id, cache disabled\n");
+		return 0;
+	}
+
+	cell = devm_nvmem_cell_get(fdev->dev, "fss-cache");
+	if (IS_ERR(cell)) {
+		if (PTR_ERR(cell) == -EPROBE_DEFER)
+			return -EPROBE_DEFER;
+		return 0;
+	}
+	fdev->cache_cell = cell;
+
+	buf = nvmem_cell_read(cell, &len);
+	if (IS_ERR(buf))
+		return 0;
+
+	if (fss_scan_cache_valid(fdev, buf, len))
+		memcpy(fdev->cache, buf, len);
+	else
+		dev_info(fdev->dev, "no valid cache in nvmem\n");
+	kfree(buf);
+	return 0;
+}
+
 static int fss_scan_probe(struct platform_device *pdev)
 {
 	struct device *dev = &pdev->dev;
@@ -511,6 +914,10 @@ static int fss_scan_probe(struct platform_device *pdev)
 		return ret;
 	}
 
+	ret = fss_scan_cache_init(fdev);
+	if (ret)
+		return ret;
+
 	platform_set_drvdata(pdev, fdev);
 	INIT_WORK(&fdev->work, fss_scan_work);
 
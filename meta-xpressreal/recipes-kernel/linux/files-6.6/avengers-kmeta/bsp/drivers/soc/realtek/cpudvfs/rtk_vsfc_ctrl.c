@@ -60,6 +60,7 @@ struct vsfc_ctrl_data {
 	struct clk            *clk;
 	struct regulator      *supply;
 	enum clk_output_sel   output;
+	uint32_t              fss_ctrl0;
 
 	const struct vsfc_ctrl_desc *desc;
 };
@@ -325,6 +326,7 @@ static int vsfc_ctrl_set_vsfc_freq(struct vsfc_ctrl_data *data, unsigned long ta
 {
 	const struct vsfc_ctrl_desc *desc = data->desc;
 	uint32_t val = freq_to_lowf(desc->map, target);
+	uint32_t ctrl0;
 
 	if (!val)
 		return -EINVAL;
@@ -338,7 +340,17 @@ static int vsfc_ctrl_set_vsfc_freq(struct vsfc_ctrl_data *data, unsigned long ta
 
 	regulator_set_voltage(data->supply, desc->threshold_volt, desc->threshold_volt);
 
-	vsfc_ctrl_setup_fss(data);
+	/*
+	 * the fss reset sequence has fixed 400us of settle time and nothing
+	 * to poll, so the sensor is left running while the output is direct.
+	 * FSS_CTRL0 is shared with the fss calibration and lost in suspend,
+	 * so the sequence runs again whenever it no longer holds our value.
+	 */
+	regmap_read(data->sc_wrap, FSS_CTRL0, &ctrl0);
+	if (!data->fss_ctrl0 || ctrl0 != data->fss_ctrl0) {
+		vsfc_ctrl_setup_fss(data);
+		regmap_read(data->sc_wrap, FSS_CTRL0, &data->fss_ctrl0);
+	}
 
 	vsfc_ctrl_set_output_vsfc(data);
 
@@ -353,8 +365,6 @@ static int vsfc_ctrl_set_pll_freq(struct vsfc_ctrl_data *data, unsigned long tar
 		vsfc_ctrl_teardown_vsfc(data);
 
 		vsfc_ctrl_set_output_direct(data);
-
-		vsfc_ctrl_teardown_fss(data);
 	}
 
 	return clk_set_rate(data->clk, target);
@@ -19,13 +19,30 @@ static struct pm_qos_constraints rtk_cpuhp_constraints = {
 	.notifiers           = &rtk_cpuhp_notifiers,
 };
 
+/* minimum number of online CPUs, from the named QoS classes */
+static struct pm_qos_constraints rtk_cpuhp_floor_constraints = {
+	.list                = PLIST_HEAD_INIT(rtk_cpuhp_floor_constraints.list),
+	.target_value        = RTK_CPUHP_DEFAULT_VALUE,
+	.default_value       = RTK_CPUHP_DEFAULT_VALUE,
+	.no_constraint_value = RTK_CPUHP_DEFAULT_VALUE,
+	.type                = PM_QOS_MAX,
+	.notifiers           = &rtk_cpuhp_notifiers,
+};
+
 s32 rtk_cpuhp_qos_read_value(void)
 {
 	return pm_qos_read_value(&rtk_cpuhp_constraints);
 }
 EXPORT_SYMBOL_GPL(rtk_cpuhp_qos_read_value);
 
-int rtk_cpuhp_qos_add_request(struct rtk_cpuhp_qos_request *req, s32 value)
+s32 rtk_cpuhp_floor_read_value(void)
+{
+	return pm_qos_read_value(&rtk_cpuhp_floor_constraints);
+}
+EXPORT_SYMBOL_GPL(rtk_cpuhp_floor_read_value);
+
+static int __rtk_cpuhp_add_request(struct pm_qos_constraints *qos,
+				   struct rtk_cpuhp_qos_request *req, s32 value)
 {
 	int ret;
 
@@ -36,14 +53,25 @@ int rtk_cpuhp_qos_add_request(struct rtk_cpuhp_qos_request *req, s32 value)
 		"%s() called for active request\n", __func__))
 		return -EINVAL;
 
-	req->qos = &rtk_cpuhp_constraints;
+	req->qos = qos;
 	ret = pm_qos_update_target(req->qos, &req->pnode, PM_QOS_ADD_REQ, value);
 	if (ret < 0)
 		req->qos = NULL;
 	return ret;
 }
+
+int rtk_cpuhp_qos_add_request(struct rtk_cpuhp_qos_request *req, s32 value)
+{
+	return __rtk_cpuhp_add_request(&rtk_cpuhp_constraints, req, value);
+}
 EXPORT_SYMBOL_GPL(rtk_cpuhp_qos_add_request);
 
+int rtk_cpuhp_floor_add_request(struct rtk_cpuhp_qos_request *req, s32 value)
+{
+	return __rtk_cpuhp_add_request(&rtk_cpuhp_floor_constraints, req, value);
+}
+EXPORT_SYMBOL_GPL(rtk_cpuhp_floor_add_request);
+
 int rtk_cpuhp_qos_update_request(struct rtk_cpuhp_qos_request *req, s32 new_value)
 {
 	if (!req)
@@ -9,16 +9,110 @@
 #include <linux/cpu.h>
 #include <linux/cpuhotplug.h>
 #include <linux/cpumask.h>
+#include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/device.h>
+#include <linux/kernel_stat.h>
 #include <linux/kthread.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/platform_device.h>
+#include <linux/sched.h>
+#include <linux/sched/stat.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/suspend.h>
 #include <linux/notifier.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
 #include <soc/realtek/rtk_cpuhp.h>
 
+#ifdef CONFIG_RTK_CPUHP_LOAD
+/*
+ * Load mode: every sample_ms the controller sums the PELT utilisation of
+ * the online CPUs and counts the runnable tasks. A CPU is brought up as
+ * soon as the load would push the online CPUs past up_threshold percent,
+ * or when more tasks are runnable than there are CPUs, so a core is ready
+ * before the others saturate. A CPU is parked only after the load has fit
+ * in one CPU fewer at down_threshold percent for down_delay_ms. The result
+ * is kept between the floor set by the QoS classes and the ceiling left
+ * by the offline requests.
+ *
+ * Loads are in percent of one CPU, so 250 is two and a half busy CPUs.
+ */
+#define RTK_CPUHP_TRACE_LEN          512
+#define RTK_CPUHP_SIM_OUT_SIZE       (128 * 1024)
+
+enum {
+	RTK_CPUHP_HOLD,
+	RTK_CPUHP_UP_UTIL,
+	RTK_CPUHP_UP_NR,
+	RTK_CPUHP_DOWN,
+	RTK_CPUHP_FLOOR,
+	RTK_CPUHP_CEILING,
+};
+
+static const char * const rtk_cpuhp_reasons[] = {
+	[RTK_CPUHP_HOLD]    = "hold",
+	[RTK_CPUHP_UP_UTIL] = "up-util",
+	[RTK_CPUHP_UP_NR]   = "up-nr",
+	[RTK_CPUHP_DOWN]    = "down",
+	[RTK_CPUHP_FLOOR]   = "floor",
+	[RTK_CPUHP_CEILING] = "ceiling",
+};
+
+struct rtk_cpuhp_sample {
+	u64                           t_ms;
+	unsigned int                  util;
+	unsigned int                  irq;
+	unsigned int                  nr;
+	unsigned int                  online;
+};
+
+struct rtk_cpuhp_gov {
+	bool                          below;
+	u64                           below_since;
+};
+
+struct rtk_cpuhp_trace {
+	struct rtk_cpuhp_sample       s;
+	unsigned int                  target;
+	unsigned int                  reason;
+	unsigned int                  latency_us;
+};
+
+struct rtk_cpuhp_latency {
+	unsigned int                  n;
+	unsigned int                  last;
+	unsigned int                  max;
+	u64                           sum;
+};
+
+struct rtk_cpuhp_sim {
+	struct rtk_cpuhp_gov          gov;
+	unsigned int                  online;
+	char                          line[128];
+	size_t                        len;
+	char                          *out;
+	size_t                        out_len;
+};
+
+static bool load_mode;
+static unsigned int sample_ms = 50;
+module_param(sample_ms, uint, 0644);
+MODULE_PARM_DESC(sample_ms, "load mode sampling period");
+static unsigned int up_threshold = 70;
+module_param(up_threshold, uint, 0644);
+MODULE_PARM_DESC(up_threshold, "busy percent per online CPU that brings one more up");
+static unsigned int down_threshold = 45;
+module_param(down_threshold, uint, 0644);
+MODULE_PARM_DESC(down_threshold, "busy percent per CPU, one CPU fewer, that allows parking");
+static unsigned int down_delay_ms = 1000;
+module_param(down_delay_ms, uint, 0644);
+MODULE_PARM_DESC(down_delay_ms, "time the load must stay low before a CPU is parked");
+#endif
+
 struct rtk_cpuhp_ctrl_data {
 	struct device                 *dev;
 	struct completion             complete;
@@ -27,6 +121,19 @@ struct rtk_cpuhp_ctrl_data {
 	struct notifier_block         pm_nb;
 	int                           dyn_state;
 	atomic_t                      suspended;
+#ifdef CONFIG_RTK_CPUHP_LOAD
+	struct mutex                  lock;
+	struct rtk_cpuhp_gov          gov;
+	u64                           last_ns;
+	u64                           last_irq_ns;
+	unsigned int                  last_irq;
+	struct rtk_cpuhp_trace        *trace;
+	unsigned int                  trace_pos;
+	unsigned int                  trace_num;
+	struct rtk_cpuhp_latency      up_lat;
+	struct rtk_cpuhp_latency      down_lat;
+	struct dentry                 *debugfs;
+#endif
 };
 
 static struct rtk_cpuhp_ctrl_data *ctrl_data;
@@ -77,21 +184,21 @@ static int cpu_device_online(struct device *dev)
 #define cpu_device_online    device_online
 #endif
 
-static void set_cpu_device_offline(int cpu_id)
+static int set_cpu_device_offline(int cpu_id)
 {
 	struct device *cpu_dev = get_cpu_device(cpu_id);
 
 	if (WARN_ON(cpu_id == 0))
-		return;
+		return -EPERM;
 
-	cpu_device_offline(cpu_dev);
+	return cpu_device_offline(cpu_dev);
 }
 
-static void set_cpu_device_online(int cpu_id)
+static int set_cpu_device_online(int cpu_id)
 {
 	struct device *cpu_dev = get_cpu_device(cpu_id);
 
-	cpu_device_online(cpu_dev);
+	return cpu_device_online(cpu_dev);
 }
 
 static int next_cpu_to_online(void)
@@ -134,6 +241,411 @@ static void __rtk_cpuhp_ctrl_do_cpuhp(struct rtk_cpuhp_ctrl_data *c, const char
 }
 #define rtk_cpuhp_ctrl_do_cpuhp(_c) __rtk_cpuhp_ctrl_do_cpuhp(_c, __func__)
 
+#ifdef CONFIG_RTK_CPUHP_LOAD
+static int load_mode_set(const char *val, const struct kernel_param *kp)
+{
+	int ret = param_set_bool(val, kp);
+
+	if (!ret)
+		rtk_cpuhp_ctrl_do_cpuhp(ctrl_data);
+	return ret;
+}
+
+static const struct kernel_param_ops load_mode_ops = {
+	.set = load_mode_set,
+	.get = param_get_bool,
+};
+module_param_cb(load, &load_mode_ops, &load_mode, 0644);
+MODULE_PARM_DESC(load, "follow the CPU load instead of the offline requests only");
+
+static unsigned int rtk_cpuhp_ceiling(void)
+{
+	s32 off = rtk_cpuhp_qos_read_value();
+
+	if (off <= 0)
+		return num_possible_cpus();
+	if (off >= num_possible_cpus())
+		return 1;
+	return num_possible_cpus() - off;
+}
+
+static unsigned int rtk_cpuhp_floor(void)
+{
+	s32 floor = rtk_cpuhp_floor_read_value();
+
+	return clamp_t(s32, floor, 1, num_possible_cpus());
+}
+
+/*
+ * PELT utilisation already carries the irq pressure when irq time is
+ * accounted; otherwise the irq/softirq time has to be added on top.
+ */
+static unsigned int rtk_cpuhp_load_of(const struct rtk_cpuhp_sample *s)
+{
+	if (IS_ENABLED(CONFIG_HAVE_SCHED_AVG_IRQ))
+		return s->util;
+	return s->util + s->irq;
+}
+
+static unsigned int rtk_cpuhp_gov_target(struct rtk_cpuhp_gov *g,
+					 const struct rtk_cpuhp_sample *s,
+					 unsigned int floor, unsigned int ceiling,
+					 unsigned int *reason)
+{
+	unsigned int load = rtk_cpuhp_load_of(s);
+	unsigned int online = s->online;
+	unsigned int up = max(up_threshold, 1U);
+	unsigned int target = online;
+
+	*reason = RTK_CPUHP_HOLD;
+
+	if (load > online * up) {
+		target = max(DIV_ROUND_UP(load, up), online + 1);
+		*reason = RTK_CPUHP_UP_UTIL;
+		g->below = false;
+	} else if (s->nr > online) {
+		target = online + 1;
+		*reason = RTK_CPUHP_UP_NR;
+		g->below = false;
+	} else if (online > 1 && load <= (online - 1) * down_threshold &&
+		   s->nr <= online - 1) {
+		if (!g->below) {
+			g->below = true;
+			g->below_since = s->t_ms;
+		} else if (s->t_ms - g->below_since >= down_delay_ms) {
+			/* park one at a time, each after a full delay */
+			target = online - 1;
+			*reason = RTK_CPUHP_DOWN;
+			g->below_since = s->t_ms;
+		}
+	} else {
+		g->below = false;
+	}
+
+	if (target < floor) {
+		target = floor;
+		*reason = RTK_CPUHP_FLOOR;
+	}
+	if (target > ceiling) {
+		target = ceiling;
+		*reason = RTK_CPUHP_CEILING;
+	}
+	return target;
+}
+
+static void rtk_cpuhp_load_sample(struct rtk_cpuhp_ctrl_data *c,
+				  struct rtk_cpuhp_sample *s)
+{
+	u64 now = ktime_get_ns();
+	u64 irq_ns = 0;
+	unsigned long util = 0;
+	unsigned int nr;
+	int cpu;
+
+	for_each_online_cpu(cpu)
+		util += sched_cpu_util(cpu);
+
+	/* offline CPUs keep their counters, so the sum never goes back */
+	for_each_possible_cpu(cpu)
+		irq_ns += kcpustat_cpu(cpu).cpustat[CPUTIME_IRQ] +
+			  kcpustat_cpu(cpu).cpustat[CPUTIME_SOFTIRQ];
+
+	/* a kick right after the last sample is too short to measure irq */
+	if (now - c->last_ns >= NSEC_PER_MSEC) {
+		c->last_irq = div64_u64((irq_ns - c->last_irq_ns) * 100,
+					now - c->last_ns);
+		c->last_irq_ns = irq_ns;
+		c->last_ns = now;
+	}
+
+	/* this thread is one of the runnable tasks */
+	nr = nr_running();
+
+	s->t_ms = div_u64(now, NSEC_PER_MSEC);
+	s->util = (util * 100) >> SCHED_CAPACITY_SHIFT;
+	s->irq = c->last_irq;
+	s->nr = nr ? nr - 1 : 0;
+	s->online = num_online_cpus();
+}
+
+static void rtk_cpuhp_latency_add(struct rtk_cpuhp_latency *l, unsigned int us)
+{
+	l->n++;
+	l->last = us;
+	l->max = max(l->max, us);
+	l->sum += us;
+}
+
+static void rtk_cpuhp_load_update(struct rtk_cpuhp_ctrl_data *c)
+{
+	struct rtk_cpuhp_sample s;
+	struct rtk_cpuhp_trace *t;
+	unsigned int target, reason, online;
+	unsigned int latency_us = 0;
+	ktime_t start;
+	int cpu;
+
+	mutex_lock(&c->lock);
+
+	rtk_cpuhp_load_sample(c, &s);
+	target = rtk_cpuhp_gov_target(&c->gov, &s, rtk_cpuhp_floor(),
+				      rtk_cpuhp_ceiling(), &reason);
+
+	for (online = s.online; online < target; online++) {
+		cpu = next_cpu_to_online();
+		if (cpu >= nr_cpu_ids)
+			break;
+		start = ktime_get();
+		if (set_cpu_device_online(cpu))
+			break;
+		latency_us = ktime_us_delta(ktime_get(), start);
+		rtk_cpuhp_latency_add(&c->up_lat, latency_us);
+		pr_debug("set cpu%d online in %uus (%s)\n", cpu, latency_us,
+			 rtk_cpuhp_reasons[reason]);
+	}
+
+	if (target < s.online) {
+		cpu = next_cpu_to_offline();
+		start = ktime_get();
+		if (!set_cpu_device_offline(cpu)) {
+			latency_us = ktime_us_delta(ktime_get(), start);
+			rtk_cpuhp_latency_add(&c->down_lat, latency_us);
+			pr_debug("set cpu%d offline in %uus (%s)\n", cpu,
+				 latency_us, rtk_cpuhp_reasons[reason]);
+		}
+	}
+
+	t = &c->trace[c->trace_pos];
+	t->s = s;
+	t->target = target;
+	t->reason = reason;
+	t->latency_us = latency_us;
+	c->trace_pos = (c->trace_pos + 1) % RTK_CPUHP_TRACE_LEN;
+	if (c->trace_num < RTK_CPUHP_TRACE_LEN)
+		c->trace_num++;
+
+	mutex_unlock(&c->lock);
+}
+
+/*
+ * debugfs: "trace" holds the last samples and what was decided for
+ * them, "latency" the time taken by the hotplug calls, and "simulate"
+ * replays a trace written to it through the same decision code with the
+ * current tunables and QoS values, without touching any CPU. A trace
+ * read back from "trace" can be written to "simulate" as is.
+ */
+static int rtk_cpuhp_trace_show(struct seq_file *m, void *v)
+{
+	struct rtk_cpuhp_ctrl_data *c = m->private;
+	struct rtk_cpuhp_trace *t;
+	unsigned int i, pos;
+
+	seq_puts(m, "# t_ms util irq nr online target reason latency_us\n");
+
+	mutex_lock(&c->lock);
+	pos = (c->trace_pos + RTK_CPUHP_TRACE_LEN - c->trace_num) % RTK_CPUHP_TRACE_LEN;
+	for (i = 0; i < c->trace_num; i++) {
+		t = &c->trace[(pos + i) % RTK_CPUHP_TRACE_LEN];
+		seq_printf(m, "%llu %u %u %u %u %u %s %u\n", t->s.t_ms,
+			   t->s.util, t->s.irq, t->s.nr, t->s.online,
+			   t->target, rtk_cpuhp_reasons[t->reason],
+			   t->latency_us);
+	}
+	mutex_unlock(&c->lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(rtk_cpuhp_trace);
+
+static void rtk_cpuhp_latency_show_one(struct seq_file *m, const char *name,
+				       struct rtk_cpuhp_latency *l)
+{
+	seq_printf(m, "%-4s n=%u last=%uus avg=%lluus max=%uus\n", name, l->n,
+		   l->last, l->n ? div_u64(l->sum, l->n) : 0, l->max);
+}
+
+static int rtk_cpuhp_latency_show(struct seq_file *m, void *v)
+{
+	struct rtk_cpuhp_ctrl_data *c = m->private;
+
+	mutex_lock(&c->lock);
+	rtk_cpuhp_latency_show_one(m, "up", &c->up_lat);
+	rtk_cpuhp_latency_show_one(m, "down", &c->down_lat);
+	mutex_unlock(&c->lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(rtk_cpuhp_latency);
+
+static DEFINE_MUTEX(rtk_cpuhp_sim_lock);
+static struct rtk_cpuhp_sim rtk_cpuhp_sim;
+
+static void rtk_cpuhp_sim_line(struct rtk_cpuhp_sim *sim)
+{
+	struct rtk_cpuhp_sample s;
+	unsigned int target, reason;
+	int n;
+
+	sim->line[sim->len] = '\0';
+	n = sscanf(sim->line, "%llu %u %u %u %u", &s.t_ms, &s.util, &s.irq,
+		   &s.nr, &s.online);
+	if (n < 4)
+		return;
+
+	/* start from the recorded CPU count, then follow the decisions */
+	if (!sim->online)
+		sim->online = n == 5 ? s.online : num_possible_cpus();
+	s.online = clamp_t(unsigned int, sim->online, 1, num_possible_cpus());
+
+	target = rtk_cpuhp_gov_target(&sim->gov, &s, rtk_cpuhp_floor(),
+				      rtk_cpuhp_ceiling(), &reason);
+	if (target < s.online)
+		target = s.online - 1;
+	sim->online = target;
+
+	sim->out_len += scnprintf(sim->out + sim->out_len,
+				  RTK_CPUHP_SIM_OUT_SIZE - sim->out_len,
+				  "%llu %u %u %u %u %u %s\n", s.t_ms, s.util,
+				  s.irq, s.nr, s.online, target,
+				  rtk_cpuhp_reasons[reason]);
+}
+
+static int rtk_cpuhp_sim_open(struct inode *inode, struct file *file)
+{
+	struct rtk_cpuhp_sim *sim = &rtk_cpuhp_sim;
+
+	mutex_lock(&rtk_cpuhp_sim_lock);
+	if (!sim->out)
+		sim->out = vmalloc(RTK_CPUHP_SIM_OUT_SIZE);
+	if (!sim->out) {
+		mutex_unlock(&rtk_cpuhp_sim_lock);
+		return -ENOMEM;
+	}
+
+	if (file->f_mode & FMODE_WRITE) {
+		memset(&sim->gov, 0, sizeof(sim->gov));
+		sim->online = 0;
+		sim->len = 0;
+		sim->out_len = 0;
+	}
+	mutex_unlock(&rtk_cpuhp_sim_lock);
+
+	file->private_data = sim;
+	return 0;
+}
+
+static ssize_t rtk_cpuhp_sim_read(struct file *file, char __user *ubuf,
+				  size_t count, loff_t *ppos)
+{
+	struct rtk_cpuhp_sim *sim = file->private_data;
+	ssize_t ret;
+
+	mutex_lock(&rtk_cpuhp_sim_lock);
+	ret = simple_read_from_buffer(ubuf, count, ppos, sim->out, sim->out_len);
+	mutex_unlock(&rtk_cpuhp_sim_lock);
+
+	return ret;
+}
+
+static ssize_t rtk_cpuhp_sim_write(struct file *file, const char __user *ubuf,
+				   size_t count, loff_t *ppos)
+{
+	struct rtk_cpuhp_sim *sim = file->private_data;
+	char *buf, *p, *eol;
+	size_t len;
+	ssize_t ret = count;
+
+	buf = memdup_user_nul(ubuf, count);
+	if (IS_ERR(buf))
+		return PTR_ERR(buf);
+
+	mutex_lock(&rtk_cpuhp_sim_lock);
+	for (p = buf; *p; p = eol + 1) {
+		eol = strchrnul(p, '\n');
+		len = eol - p;
+		if (sim->len + len >= sizeof(sim->line)) {
+			ret = -EINVAL;
+			break;
+		}
+		memcpy(sim->line + sim->len, p, len);
+		sim->len += len;
+
+		/* a line split across writes is finished by the next one */
+		if (!*eol)
+			break;
+
+		rtk_cpuhp_sim_line(sim);
+		sim->len = 0;
+	}
+	mutex_unlock(&rtk_cpuhp_sim_lock);
+
+	kfree(buf);
+	return ret;
+}
+
+static int rtk_cpuhp_sim_release(struct inode *inode, struct file *file)
+{
+	struct rtk_cpuhp_sim *sim = file->private_data;
+
+	mutex_lock(&rtk_cpuhp_sim_lock);
+	if ((file->f_mode & FMODE_WRITE) && sim->len) {
+		rtk_cpuhp_sim_line(sim);
+		sim->len = 0;
+	}
+	mutex_unlock(&rtk_cpuhp_sim_lock);
+
+	return 0;
+}
+
+static const struct file_operations rtk_cpuhp_sim_fops = {
+	.owner   = THIS_MODULE,
+	.open    = rtk_cpuhp_sim_open,
+	.read    = rtk_cpuhp_sim_read,
+	.write   = rtk_cpuhp_sim_write,
+	.release = rtk_cpuhp_sim_release,
+	.llseek  = default_llseek,
+};
+
+static int rtk_cpuhp_load_init(struct rtk_cpuhp_ctrl_data *c)
+{
+	mutex_init(&c->lock);
+
+	c->trace = kcalloc(RTK_CPUHP_TRACE_LEN, sizeof(*c->trace), GFP_KERNEL);
+	if (!c->trace)
+		return -ENOMEM;
+
+	c->debugfs = debugfs_create_dir("rtk_cpuhp", NULL);
+	debugfs_create_file("trace", 0444, c->debugfs, c, &rtk_cpuhp_trace_fops);
+	debugfs_create_file("latency", 0444, c->debugfs, c, &rtk_cpuhp_latency_fops);
+	debugfs_create_file("simulate", 0644, c->debugfs, NULL, &rtk_cpuhp_sim_fops);
+	return 0;
+}
+
+static void rtk_cpuhp_load_exit(struct rtk_cpuhp_ctrl_data *c)
+{
+	debugfs_remove_recursive(c->debugfs);
+	vfree(rtk_cpuhp_sim.out);
+	rtk_cpuhp_sim.out = NULL;
+	kfree(c->trace);
+}
+
+static unsigned long rtk_cpuhp_ctrl_timeout(void)
+{
+	return load_mode ? msecs_to_jiffies(max(sample_ms, 10U)) : 2 * HZ;
+}
+#else
+static inline int rtk_cpuhp_load_init(struct rtk_cpuhp_ctrl_data *c) { return 0; }
+static inline void rtk_cpuhp_load_exit(struct rtk_cpuhp_ctrl_data *c) {}
+static inline void rtk_cpuhp_load_update(struct rtk_cpuhp_ctrl_data *c) {}
+
+static unsigned long rtk_cpuhp_ctrl_timeout(void)
+{
+	return 2 * HZ;
+}
+
+#define load_mode false
+#endif
+
 static int rtk_cpuhp_ctrl_do_task(void *data)
 {
 	struct rtk_cpuhp_ctrl_data *c = data;
@@ -142,14 +654,22 @@ static int rtk_cpuhp_ctrl_do_task(void *data)
 	int cpu;
 
 	for (;;) {
-		ret = wait_for_completion_timeout(&c->complete, 2 * HZ);
+		ret = wait_for_completion_timeout(&c->complete, rtk_cpuhp_ctrl_timeout());
 		if (kthread_should_stop()) {
 			pr_debug("stop %s\n", __func__);
 			break;
 		}
 
 		reinit_completion(&c->complete);
-		if (ret == 0 || rtk_cpuhp_ctrl_suspeneded(c))
+		if (rtk_cpuhp_ctrl_suspeneded(c))
+			continue;
+
+		if (load_mode) {
+			rtk_cpuhp_load_update(c);
+			continue;
+		}
+
+		if (ret == 0)
 			continue;
 
 		excepted = rtk_cpuhp_qos_read_value();
@@ -222,11 +742,15 @@ static __init int rtk_cpuhp_ctrl_init(void)
 
 	init_completion(&c->complete);
 
+	ret = rtk_cpuhp_load_init(c);
+	if (ret)
+		goto free_data;
+
 	c->task = kthread_create(rtk_cpuhp_ctrl_do_task, c, "cpuhp_ctrl_task");
 	if (IS_ERR(c->task)) {
 		ret = PTR_ERR(c->task);
 		pr_err("failed to create kthread: %d\n", ret);
-		return ret;
+		goto load_exit;
 	}
 	kthread_bind(c->task, 0);
 	wake_up_process(c->task);
@@ -262,6 +786,9 @@ remove_cpuhp_state:
 	cpuhp_remove_state_nocalls(c->dyn_state);
 remove_kthread:
 	kthread_stop(c->task);
+load_exit:
+	rtk_cpuhp_load_exit(c);
+free_data:
 	kfree(c);
 	return ret;
 }
@@ -275,6 +802,7 @@ static __exit void rtk_cpuhp_ctrl_exit(void)
 	rtk_cpuhp_qos_remove_notifier(&c->cpuhp_nb);
 	cpuhp_remove_state_nocalls(c->dyn_state);
 	kthread_stop(c->task);
+	rtk_cpuhp_load_exit(c);
 
 	kfree(c);
 	ctrl_data = NULL;
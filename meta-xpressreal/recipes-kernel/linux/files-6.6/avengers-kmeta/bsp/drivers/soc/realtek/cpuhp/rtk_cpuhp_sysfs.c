@@ -3,9 +3,11 @@
  * Copyright (c) 2021 Realtek Semiconductor Corp.
  */
 
+#include <linux/cpumask.h>
 #include <linux/init.h>
 #include <linux/kobject.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/sysfs.h>
 #include <soc/realtek/rtk_cpuhp.h>
 
@@ -13,6 +15,28 @@ static struct kobject *rtk_cpuhp_sysfs_kobj;
 static struct rtk_cpuhp_qos_request rtk_cpuhp_sysfs_request;
 static unsigned int rtk_cpuhp_sysfs_request_val;
 
+/*
+ * Named QoS classes, /sys/kernel/rtk_cpuhp/classes/<name>/{active,floor}.
+ * While a class is active the controller keeps at least floor CPUs
+ * online in load mode; a floor of 0 means all of them.
+ */
+struct rtk_cpuhp_class {
+	const char                    *name;
+	unsigned int                  floor;
+	bool                          active;
+	struct kobject                *kobj;
+	struct rtk_cpuhp_qos_request  req;
+};
+
+static struct rtk_cpuhp_class rtk_cpuhp_classes[] = {
+	{ .name = "media-playback", .floor = 2, },
+	{ .name = "nas-io",         .floor = 4, },
+	{ .name = "performance",    .floor = 0, },
+};
+
+static struct kobject *rtk_cpuhp_classes_kobj;
+static DEFINE_MUTEX(rtk_cpuhp_classes_lock);
+
 static int update_request(unsigned int val)
 {
 	int ret;
@@ -51,6 +75,140 @@ static struct attribute_group rtk_cpuhp_sysfs_attr_group = {
 	.attrs      = rtk_cpuhp_sysfs_attrs,
 };
 
+static struct rtk_cpuhp_class *kobj_to_class(struct kobject *kobj)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(rtk_cpuhp_classes); i++)
+		if (rtk_cpuhp_classes[i].kobj == kobj)
+			return &rtk_cpuhp_classes[i];
+	return NULL;
+}
+
+static int update_class(struct rtk_cpuhp_class *cls)
+{
+	unsigned int floor = cls->floor ?: num_possible_cpus();
+
+	return rtk_cpuhp_qos_update_request(&cls->req, cls->active ? floor : 0);
+}
+
+static ssize_t active_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", kobj_to_class(kobj)->active);
+}
+
+static ssize_t active_store(struct kobject *kobj, struct kobj_attribute *attr,
+			    const char *buf, size_t count)
+{
+	struct rtk_cpuhp_class *cls = kobj_to_class(kobj);
+	bool val;
+	int ret;
+
+	ret = kstrtobool(buf, &val);
+	if (ret)
+		return ret;
+
+	mutex_lock(&rtk_cpuhp_classes_lock);
+	cls->active = val;
+	ret = update_class(cls);
+	mutex_unlock(&rtk_cpuhp_classes_lock);
+	return ret < 0 ? ret : count;
+}
+
+static ssize_t floor_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", kobj_to_class(kobj)->floor);
+}
+
+static ssize_t floor_store(struct kobject *kobj, struct kobj_attribute *attr,
+			   const char *buf, size_t count)
+{
+	struct rtk_cpuhp_class *cls = kobj_to_class(kobj);
+	unsigned int val;
+	int ret;
+
+	ret = kstrtouint(buf, 0, &val);
+	if (ret)
+		return ret;
+	if (val > num_possible_cpus())
+		return -EINVAL;
+
+	mutex_lock(&rtk_cpuhp_classes_lock);
+	cls->floor = val;
+	ret = update_class(cls);
+	mutex_unlock(&rtk_cpuhp_classes_lock);
+	return ret < 0 ? ret : count;
+}
+
+static struct kobj_attribute active_attr = __ATTR_RW(active);
+static struct kobj_attribute floor_attr = __ATTR_RW(floor);
+
+static struct attribute *rtk_cpuhp_class_attrs[] = {
+	&active_attr.attr,
+	&floor_attr.attr,
+	NULL,
+};
+
+static struct attribute_group rtk_cpuhp_class_attr_group = {
+	.attrs      = rtk_cpuhp_class_attrs,
+};
+
+static void rtk_cpuhp_classes_remove(void)
+{
+	struct rtk_cpuhp_class *cls;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(rtk_cpuhp_classes); i++) {
+		cls = &rtk_cpuhp_classes[i];
+		if (!cls->kobj)
+			continue;
+		sysfs_remove_group(cls->kobj, &rtk_cpuhp_class_attr_group);
+		kobject_put(cls->kobj);
+		cls->kobj = NULL;
+		rtk_cpuhp_qos_remove_request(&cls->req);
+	}
+	kobject_put(rtk_cpuhp_classes_kobj);
+}
+
+static int rtk_cpuhp_classes_create(void)
+{
+	struct rtk_cpuhp_class *cls;
+	int i;
+	int ret;
+
+	rtk_cpuhp_classes_kobj = kobject_create_and_add("classes", rtk_cpuhp_sysfs_kobj);
+	if (!rtk_cpuhp_classes_kobj)
+		return -ENOMEM;
+
+	for (i = 0; i < ARRAY_SIZE(rtk_cpuhp_classes); i++) {
+		cls = &rtk_cpuhp_classes[i];
+
+		ret = rtk_cpuhp_floor_add_request(&cls->req, 0);
+		if (ret)
+			goto remove_classes;
+
+		cls->kobj = kobject_create_and_add(cls->name, rtk_cpuhp_classes_kobj);
+		if (!cls->kobj) {
+			rtk_cpuhp_qos_remove_request(&cls->req);
+			ret = -ENOMEM;
+			goto remove_classes;
+		}
+
+		ret = sysfs_create_group(cls->kobj, &rtk_cpuhp_class_attr_group);
+		if (ret) {
+			kobject_put(cls->kobj);
+			cls->kobj = NULL;
+			rtk_cpuhp_qos_remove_request(&cls->req);
+			goto remove_classes;
+		}
+	}
+	return 0;
+
+remove_classes:
+	rtk_cpuhp_classes_remove();
+	return ret;
+}
+
 static int __init rtk_cpuhp_sysfs_init(void)
 {
 	int ret;
@@ -67,8 +225,14 @@ static int __init rtk_cpuhp_sysfs_init(void)
 	if (ret)
 		goto remove_qos_request;
 
+	ret = rtk_cpuhp_classes_create();
+	if (ret)
+		goto remove_group;
+
 	return 0;
 
+remove_group:
+	sysfs_remove_group(rtk_cpuhp_sysfs_kobj, &rtk_cpuhp_sysfs_attr_group);
 remove_qos_request:
 	rtk_cpuhp_qos_remove_request(&rtk_cpuhp_sysfs_request);
 put_kobj:
@@ -81,6 +245,7 @@ module_init(rtk_cpuhp_sysfs_init);
 
 static void __exit rtk_cpuhp_sysfs_exit(void)
 {
+	rtk_cpuhp_classes_remove();
 	sysfs_remove_group(rtk_cpuhp_sysfs_kobj, &rtk_cpuhp_sysfs_attr_group);
 	rtk_cpuhp_qos_remove_request(&rtk_cpuhp_sysfs_request);
 	kobject_put(rtk_cpuhp_sysfs_kobj);
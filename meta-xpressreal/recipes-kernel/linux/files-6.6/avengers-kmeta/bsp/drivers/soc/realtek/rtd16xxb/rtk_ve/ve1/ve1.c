@@ -47,6 +47,8 @@
 #include <linux/clk.h>
 #include <linux/reset.h>
 #include <linux/dma-map-ops.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <soc/realtek/memory.h>
 #include <soc/realtek/rtk_media_heap.h>
 
@@ -117,6 +119,9 @@
 #include "vmm.h"
 static video_mm_t s_vmem;
 static vpudrv_buffer_t s_video_memory = {0};
+#ifdef CONFIG_DEBUG_FS
+static struct dentry *s_vmem_debugfs;
+#endif
 #endif /*VPU_SUPPORT_RESERVED_VIDEO_MEMORY*/
 
 static int vpu_hw_reset(u32 coreIdx);
@@ -255,7 +260,7 @@ int rtd16xxb_vpu_alloc_dma_buffer(vpudrv_buffer_t *vb)
 		return -1;
 
 #ifdef VPU_SUPPORT_RESERVED_VIDEO_MEMORY
-	vb->phys_addr = (unsigned long)vmem_alloc(&s_vmem, vb->size, 0);
+	vb->phys_addr = (unsigned long)vmem_alloc(&s_vmem, vb->size, task_tgid_nr(current));
 	if ((unsigned long)vb->phys_addr  == (unsigned long)-1) {
 		pr_err("%s Physical memory allocation error size=%d\n", DEV_NAME, vb->size);
 		return -1;
@@ -284,7 +289,7 @@ static int rtd16xxb_vpu_alloc_dma_buffer2(vpudrv_buffer_t *vb)
 		return -1;
 
 #ifdef VPU_SUPPORT_RESERVED_VIDEO_MEMORY
-	vb->phys_addr = (unsigned long)vmem_alloc(&s_vmem, vb->size, 0);
+	vb->phys_addr = (unsigned long)vmem_alloc(&s_vmem, vb->size, task_tgid_nr(current));
 	if ((unsigned long)vb->phys_addr  == (unsigned long)-1) {
 		pr_err("%s Physical memory allocation error size=%d\n", DEV_NAME, vb->size);
 		return -1;
@@ -321,6 +326,37 @@ void rtd16xxb_vpu_free_dma_buffer(vpudrv_buffer_t *vb)
 #endif /* VPU_SUPPORT_RESERVED_VIDEO_MEMORY */
 }
 
+#if defined(VPU_SUPPORT_RESERVED_VIDEO_MEMORY) && defined(CONFIG_DEBUG_FS)
+static int vpu_vmem_show(struct seq_file *s, void *unused)
+{
+	int ret;
+
+	ret = rtd16xxb_vpu_down_interruptible();
+	if (ret)
+		return ret;
+	vmem_show(&s_vmem, s);
+	rtd16xxb_vpu_sem_up();
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(vpu_vmem);
+
+static void vpu_vmem_create_debugfs(void)
+{
+	s_vmem_debugfs = debugfs_create_file("ve1_vmem", 0444, NULL, NULL,
+					     &vpu_vmem_fops);
+}
+
+static void vpu_vmem_remove_debugfs(void)
+{
+	debugfs_remove(s_vmem_debugfs);
+	s_vmem_debugfs = NULL;
+}
+#else
+static inline void vpu_vmem_create_debugfs(void) {}
+static inline void vpu_vmem_remove_debugfs(void) {}
+#endif
+
 /* size=40 for Android M */
 #define PTHREAD_MUTEX_T_HANDLE_SIZE 40
 
@@ -1755,6 +1791,7 @@ static int vpu_probe(struct platform_device *pdev)
 		pr_err("%s fail to init vmem system\n", DEV_NAME);
 		goto ERROR_PROVE_DEVICE;
 	}
+	vpu_vmem_create_debugfs();
 	pr_info("%s success to probe vpu device with reserved video memory phys_addr=0x%x, base = 0x%x\n", DEV_NAME, (int) s_video_memory.phys_addr, (int)s_video_memory.base);
 #else
 	pr_info("%s success to probe vpu device with non reserved video memory\n", DEV_NAME);
@@ -1805,6 +1842,7 @@ static int vpu_remove(struct platform_device *pdev)
 
 #ifdef VPU_SUPPORT_RESERVED_VIDEO_MEMORY
 	if (s_video_memory.base) {
+		vpu_vmem_remove_debugfs();
 		iounmap((void *)s_video_memory.base);
 		s_video_memory.base = 0;
 		vmem_exit(&s_vmem);
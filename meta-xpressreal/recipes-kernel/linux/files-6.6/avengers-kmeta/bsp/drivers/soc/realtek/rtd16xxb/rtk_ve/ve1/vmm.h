@@ -25,6 +25,11 @@
 #ifndef __RTK_VIDEO_MEMORY_MANAGEMENT_H__
 #define __RTK_VIDEO_MEMORY_MANAGEMENT_H__
 
+#include <linux/bitops.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/seq_file.h>
+
 typedef struct _video_mm_info_struct {
 	unsigned long   total_pages;
 	unsigned long   alloc_pages;
@@ -32,347 +37,129 @@ typedef struct _video_mm_info_struct {
 	unsigned long   page_size;
 } vmem_info_t;
 
-typedef unsigned long long  vmem_key_t;
-
 #define VMEM_PAGE_SIZE (16*1024)
-#define MAKE_KEY(_a, _b) (((vmem_key_t)_a)<<32 | _b)
-#define KEY_TO_VALUE(_key) (_key>>32)
+
+/*
+ * Free blocks are kept in segregated size classes (two level, TLSF style):
+ * the first level is the power of two of the block size in pages, the
+ * second level splits each power of two into VMEM_SL_COUNT linear ranges.
+ * Bitmaps of non-empty classes make both alloc and free O(1).
+ */
+#define VMEM_SL_BITS	3
+#define VMEM_SL_COUNT	(1 << VMEM_SL_BITS)
+#define VMEM_FL_COUNT	(32 - VMEM_SL_BITS)
 
 typedef struct page_struct {
 	int pageno;
 	unsigned long addr;
 	int used;
-	int alloc_pages;
-	int first_pageno;
+	int alloc_pages;	/* valid on the first page of a block */
+	int first_pageno;	/* valid on the last page of a block */
+	unsigned long owner;	/* pid owning an allocated block */
+	struct list_head list;	/* size class link of a free block */
 } page_t;
 
-typedef struct avl_node_struct {
-	vmem_key_t key;
-	int height;
-	page_t *page;
-	struct avl_node_struct *left;
-	struct avl_node_struct *right;
-} avl_node_t;
-
 typedef struct _video_mm_struct {
-	avl_node_t *free_tree;
-	avl_node_t *alloc_tree;
+	struct list_head free_list[VMEM_FL_COUNT][VMEM_SL_COUNT];
+	unsigned int fl_bitmap;
+	unsigned int sl_bitmap[VMEM_FL_COUNT];
 	page_t *page_list;
 	int num_pages;
 	unsigned long base_addr;
 	unsigned long mem_size;
 	int free_page_count;
 	int  alloc_page_count;
-} video_mm_t;
-
-#define VMEM_P_ALLOC(_x) vmalloc(_x)
-#define VMEM_P_FREE(_x) vfree(_x)
 
-#define VMEM_ASSERT(_exp) if (!(_exp)) { printk(KERN_INFO "VMEM_ASSERT at %s:%d\n", __FILE__, __LINE__); /*while(1);*/
-#define VMEM_HEIGHT(_tree) (_tree == NULL ? -1 : _tree->height)
-
-#define MAX(_a, _b) (_a >= _b ? _a : _b)
+	/* statistics */
+	int peak_page_count;
+	int alloc_block_count;
+	unsigned long alloc_count;
+	unsigned long free_count;
+	unsigned long fail_count;
+} video_mm_t;
 
-typedef enum {
-	LEFT,
-	RIGHT
-} rotation_dir_t;
+#define VMEM_P_ALLOC(_x) kvcalloc(_x, sizeof(page_t), GFP_KERNEL)
+#define VMEM_P_FREE(_x) kvfree(_x)
 
-typedef struct avl_node_data_struct {
-	int	 key;
-	page_t *page;
-} avl_node_data_t;
+#define VMEM_ASSERT(_exp) if (!(_exp)) { printk(KERN_INFO "VMEM_ASSERT at %s:%d\n", __FILE__, __LINE__); /*while(1);*/ }
 
-static avl_node_t* make_avl_node( vmem_key_t key, page_t *page)
+static void vmem_mapping(int npages, int *fl, int *sl)
 {
-	avl_node_t *node = (avl_node_t *)VMEM_P_ALLOC(sizeof(avl_node_t));
-	node->key	 = key;
-	node->page	= page;
-	node->height  = 0;
-	node->left	= NULL;
-	node->right   = NULL;
-
-	return node;
-}
+	int f = fls(npages) - 1;
 
-static int get_balance_factor(avl_node_t *tree)
-{
-	int factor = 0;
-	if (tree) {
-		factor = VMEM_HEIGHT(tree->right) - VMEM_HEIGHT(tree->left);
+	if (f < VMEM_SL_BITS) {
+		*fl = 0;
+		*sl = npages;
+	} else {
+		*sl = (npages >> (f - VMEM_SL_BITS)) - VMEM_SL_COUNT;
+		*fl = f - VMEM_SL_BITS + 1;
 	}
-
-	return factor;
 }
 
-/*
- * Left Rotation
- *
- *	  A					  B
- *	   \					/ \
- *		B		 =>	   A   C
- *	   /  \				 \
- *	  D	C				 D
- *
- */
-static avl_node_t* rotation_left(avl_node_t *tree)
+static void vmem_insert_free(video_mm_t *mm, page_t *page)
 {
-	avl_node_t *rchild;
-	avl_node_t *lchild;
-
-	if (tree == NULL)
-		return NULL;
-
-	rchild = tree->right;
-	if (rchild == NULL) {
-		return tree;
-	}
-
-	lchild = rchild->left;
-	rchild->left = tree;
-	tree->right = lchild;
+	int fl, sl;
 
-	tree->height   = MAX(VMEM_HEIGHT(tree->left), VMEM_HEIGHT(tree->right)) + 1;
-	rchild->height = MAX(VMEM_HEIGHT(rchild->left), VMEM_HEIGHT(rchild->right)) + 1;
-
-	return rchild;
+	vmem_mapping(page->alloc_pages, &fl, &sl);
+	list_add(&page->list, &mm->free_list[fl][sl]);
+	mm->fl_bitmap |= 1U << fl;
+	mm->sl_bitmap[fl] |= 1U << sl;
 }
 
-
-/*
- * Reft Rotation
- *
- *		 A				  B
- *	   \				  /  \
- *	  B		 =>	   D	A
- *	/  \					 /
- *   D	C				   C
- *
- */
-static avl_node_t *rotation_right(avl_node_t *tree)
+static void vmem_remove_free(video_mm_t *mm, page_t *page)
 {
-	avl_node_t *rchild;
-	avl_node_t *lchild;
+	int fl, sl;
 
-	if (tree == NULL)
-		return NULL;
-
-	lchild = tree->left;
-	if (lchild == NULL)
-		return NULL;
-
-	rchild = lchild->right;
-	lchild->right = tree;
-	tree->left = rchild;
-
-	tree->height   = MAX(VMEM_HEIGHT(tree->left), VMEM_HEIGHT(tree->right)) + 1;
-	lchild->height = MAX(VMEM_HEIGHT(lchild->left), VMEM_HEIGHT(lchild->right)) + 1;
-
-	return lchild;
-}
-
-static avl_node_t *do_balance(avl_node_t *tree)
-{
-	int bfactor = 0, child_bfactor;	   /* balancing factor */
-
-	bfactor = get_balance_factor(tree);
-
-	if (bfactor >= 2) {
-		child_bfactor = get_balance_factor(tree->right);
-		if (child_bfactor == 1 || child_bfactor == 0) {
-			tree = rotation_left(tree);
-		} else if (child_bfactor == -1) {
-			tree->right = rotation_right(tree->right);
-			tree		= rotation_left(tree);
-		} else {
-			printk(KERN_INFO "invalid balancing factor: %d\n", child_bfactor);
-			VMEM_ASSERT(0);
-			return NULL;
-		}
-	} else if (bfactor <= -2) {
-		child_bfactor = get_balance_factor(tree->left);
-		if (child_bfactor == -1 || child_bfactor == 0) {
-			tree = rotation_right(tree);
-		} else if (child_bfactor == 1) {
-			tree->left = rotation_left(tree->left);
-			tree	   = rotation_right(tree);
-		} else {
-			printk(KERN_INFO "invalid balancing factor: %d\n", child_bfactor);
-			VMEM_ASSERT(0);
-			return NULL;
-		}
+	vmem_mapping(page->alloc_pages, &fl, &sl);
+	list_del_init(&page->list);
+	if (list_empty(&mm->free_list[fl][sl])) {
+		mm->sl_bitmap[fl] &= ~(1U << sl);
+		if (!mm->sl_bitmap[fl])
+			mm->fl_bitmap &= ~(1U << fl);
 	}
-
-	return tree;
 }
 
-static avl_node_t *unlink_end_node(avl_node_t *tree, int dir, avl_node_t **found_node)
+/* first free block of at least npages, NULL if none */
+static page_t *vmem_find_free(video_mm_t *mm, int npages)
 {
-	avl_node_t *node;
-	*found_node = NULL;
-
-	if (tree == NULL)
-		return NULL;
-
-	if (dir == LEFT) {
-		if (tree->left == NULL) {
-			*found_node = tree;
-			return NULL;
-		}
-	} else {
-		if (tree->right == NULL) {
-			*found_node = tree;
-			return NULL;
-		}
-	}
-
-	if (dir == LEFT) {
-		node = tree->left;
-		tree->left = unlink_end_node(tree->left, LEFT, found_node);
-		if (tree->left == NULL) {
-			tree->left = (*found_node)->right;
-			(*found_node)->left  = NULL;
-			(*found_node)->right = NULL;
-		}
-	} else {
-		node = tree->right;
-		tree->right = unlink_end_node(tree->right, RIGHT, found_node);
-		if (tree->right == NULL) {
-			tree->right = (*found_node)->left;
-			(*found_node)->left  = NULL;
-			(*found_node)->right = NULL;
+	unsigned int map;
+	page_t *page;
+	int fl, sl, f, round = npages;
+
+	/* round up so every block in the found class is large enough */
+	f = fls(npages) - 1;
+	if (f >= VMEM_SL_BITS)
+		round += (1 << (f - VMEM_SL_BITS)) - 1;
+	if (round >= 0 && fls(round) <= VMEM_FL_COUNT + VMEM_SL_BITS - 1) {
+		vmem_mapping(round, &fl, &sl);
+		map = mm->sl_bitmap[fl] & (~0U << sl);
+		if (!map) {
+			map = fl + 1 < VMEM_FL_COUNT ? mm->fl_bitmap & (~0U << (fl + 1)) : 0;
+			if (map) {
+				fl = __ffs(map);
+				map = mm->sl_bitmap[fl];
+			}
 		}
-	}
-
-	tree->height = MAX(VMEM_HEIGHT(tree->left), VMEM_HEIGHT(tree->right)) + 1;
-
-	return do_balance(tree);
-}
-
-
-static avl_node_t *avltree_insert(avl_node_t *tree, vmem_key_t key, page_t *page)
-{
-	if (tree == NULL) {
-		tree = make_avl_node(key, page);
-	} else {
-		if (key >= tree->key) {
-			tree->right = avltree_insert(tree->right, key, page);
-		} else {
-			tree->left  = avltree_insert(tree->left, key, page);
+		if (map) {
+			sl = __ffs(map);
+			return list_first_entry(&mm->free_list[fl][sl], page_t, list);
 		}
 	}
 
-	tree = do_balance(tree);
-
-	tree->height = MAX(VMEM_HEIGHT(tree->left), VMEM_HEIGHT(tree->right)) + 1;
-
-	return tree;
-}
-
-static avl_node_t *do_unlink(avl_node_t *tree)
-{
-	avl_node_t *node;
-	avl_node_t *end_node;
-
-	node = unlink_end_node(tree->right, LEFT, &end_node);
-	if (node) {
-		tree->right = node;
-	} else {
-		node = unlink_end_node(tree->left, RIGHT, &end_node);
-		if (node)
-			tree->left = node;
-	}
-
-	if (node == NULL) {
-		node = tree->right ? tree->right : tree->left;
-		end_node = node;
-	}
-
-	if (end_node) {
-		end_node->left  = (tree->left != end_node) ? tree->left : end_node->left;
-		end_node->right = (tree->right != end_node) ? tree->right : end_node->right;
-		end_node->height = MAX(VMEM_HEIGHT(end_node->left), VMEM_HEIGHT(end_node->right)) + 1;
-	}
-
-	tree = end_node;
-
-	return tree;
-}
-
-static avl_node_t *avltree_remove(avl_node_t *tree, avl_node_t **found_node, vmem_key_t key)
-{
-	*found_node = NULL;
-	if (tree == NULL) {
-		printk(KERN_INFO "failed to find key %d\n", (int)key);
-		return NULL;
-	}
-
-	if (key == tree->key) {
-		*found_node = tree;
-		tree = do_unlink(tree);
-	} else if (key > tree->key) {
-		tree->right = avltree_remove(tree->right, found_node, key);
-	} else {
-		tree->left  = avltree_remove(tree->left, found_node, key);
-	}
-
-	if (tree)
-		tree->height = MAX(VMEM_HEIGHT(tree->left), VMEM_HEIGHT(tree->right)) + 1;
-
-	tree = do_balance(tree);
-
-	return tree;
-}
-
-void avltree_free(avl_node_t *tree)
-{
-	if (tree == NULL)
-		return;
-	if (tree->left == NULL && tree->right == NULL) {
-		VMEM_P_FREE(tree);
-		return;
-	}
-
-	avltree_free(tree->left);
-	tree->left = NULL;
-	avltree_free(tree->right);
-	tree->right = NULL;
-	VMEM_P_FREE(tree);
-}
-
-static avl_node_t *remove_approx_value(avl_node_t *tree, avl_node_t **found, vmem_key_t key)
-{
-	*found = NULL;
-	if (tree == NULL) {
-		return NULL;
+	/* near full: the exact class may still hold a block that fits */
+	vmem_mapping(npages, &fl, &sl);
+	list_for_each_entry(page, &mm->free_list[fl][sl], list) {
+		if (page->alloc_pages >= npages)
+			return page;
 	}
 
-	if (key == tree->key) {
-		*found = tree;
-		tree = do_unlink(tree);
-	} else if (key > tree->key) {
-		tree->right = remove_approx_value(tree->right, found, key);
-	} else {
-		tree->left  = remove_approx_value(tree->left, found, key);
-		if (*found == NULL) {
-			*found = tree;
-			tree = do_unlink(tree);
-		}
-	}
-	if (tree)
-		tree->height = MAX(VMEM_HEIGHT(tree->left), VMEM_HEIGHT(tree->right)) + 1;
-
-	tree = do_balance(tree);
-
-	return tree;
+	return NULL;
 }
 
 static void set_blocks_free(video_mm_t *mm, int pageno, int npages)
 {
 	int last_pageno	 = pageno + npages - 1;
-	int i;
 	page_t *page;
-	page_t *last_page;
 
 	VMEM_ASSERT(npages);
 
@@ -382,66 +169,58 @@ static void set_blocks_free(video_mm_t *mm, int pageno, int npages)
 		return;
 	}
 
-	for (i = pageno; i <= last_pageno; i++) {
-		mm->page_list[i].used		 = 0;
-		mm->page_list[i].alloc_pages  = 0;
-		mm->page_list[i].first_pageno = -1;
-	}
-
-	page		= &mm->page_list[pageno];
+	page = &mm->page_list[pageno];
+	page->used = 0;
+	page->owner = 0;
 	page->alloc_pages = npages;
-	last_page   = &mm->page_list[last_pageno];
-	last_page->first_pageno = pageno;
+	mm->page_list[last_pageno].used = 0;
+	mm->page_list[last_pageno].first_pageno = pageno;
 
-	mm->free_tree = avltree_insert(mm->free_tree, MAKE_KEY(npages, pageno), page);
+	vmem_insert_free(mm, page);
 }
 
-static void set_blocks_alloc(video_mm_t *mm, int pageno, int npages)
+static void set_blocks_alloc(video_mm_t *mm, int pageno, int npages, unsigned long pid)
 {
 	int last_pageno	 = pageno + npages - 1;
-	int i;
 	page_t *page;
-	page_t *last_page;
 
 	if (last_pageno >= mm->num_pages) {
-		printk(KERN_INFO "set_blocks_free: invalid last page number: %d\n", last_pageno);
+		printk(KERN_INFO "set_blocks_alloc: invalid last page number: %d\n", last_pageno);
 		VMEM_ASSERT(0);
 		return;
 	}
 
-	for (i = pageno; i <= last_pageno; i++) {
-		mm->page_list[i].used		 = 1;
-		mm->page_list[i].alloc_pages  = 0;
-		mm->page_list[i].first_pageno = -1;
-	}
-
-	page		= &mm->page_list[pageno];
+	page = &mm->page_list[pageno];
+	page->used = 1;
+	page->owner = pid;
 	page->alloc_pages = npages;
-
-	last_page   = &mm->page_list[last_pageno];
-	last_page->first_pageno = pageno;
-
-	mm->alloc_tree = avltree_insert(mm->alloc_tree, MAKE_KEY(page->addr, 0), page);
+	mm->page_list[last_pageno].used = 1;
+	mm->page_list[last_pageno].first_pageno = pageno;
 }
 
-
 int vmem_init(video_mm_t *mm, unsigned long addr, unsigned long size)
 {
-	int i;
+	int i, j;
 
 	if (NULL == mm)
 		return -1;
 
+	memset(mm, 0, sizeof(*mm));
+	for (i = 0; i < VMEM_FL_COUNT; i++)
+		for (j = 0; j < VMEM_SL_COUNT; j++)
+			INIT_LIST_HEAD(&mm->free_list[i][j]);
+
 	mm->base_addr  = (addr+(VMEM_PAGE_SIZE-1))&~(VMEM_PAGE_SIZE-1);
-	mm->mem_size   = size&~VMEM_PAGE_SIZE;
+	mm->mem_size   = (addr + size - mm->base_addr)&~(VMEM_PAGE_SIZE-1);
 	mm->num_pages  = mm->mem_size/VMEM_PAGE_SIZE;
-	mm->free_tree  = NULL;
-	mm->alloc_tree = NULL;
 	mm->free_page_count = mm->num_pages;
 	mm->alloc_page_count = 0;
-	mm->page_list  = (page_t *)VMEM_P_ALLOC(mm->num_pages*sizeof(page_t));
+	if (mm->num_pages <= 0)
+		return -1;
+
+	mm->page_list  = (page_t *)VMEM_P_ALLOC(mm->num_pages);
 	if (mm->page_list == NULL) {
-		printk(KERN_ERR "%s:%d failed to kmalloc(%d)\n", __func__, __LINE__, mm->num_pages*sizeof(page_t));
+		printk(KERN_ERR "%s:%d failed to kmalloc(%zu)\n", __func__, __LINE__, mm->num_pages*sizeof(page_t));
 		return -1;
 	}
 
@@ -451,6 +230,7 @@ int vmem_init(video_mm_t *mm, unsigned long addr, unsigned long size)
 		mm->page_list[i].alloc_pages  = 0;
 		mm->page_list[i].used		 = 0;
 		mm->page_list[i].first_pageno = -1;
+		INIT_LIST_HEAD(&mm->page_list[i].list);
 	}
 
 	set_blocks_free(mm, 0, mm->num_pages);
@@ -465,32 +245,17 @@ int vmem_exit(video_mm_t *mm)
 		return -1;
 	}
 
-	if (mm->free_tree) {
-		avltree_free(mm->free_tree);
-	}
-	if (mm->alloc_tree) {
-		avltree_free(mm->alloc_tree);
-	}
-
 	if (mm->page_list) {
 		VMEM_P_FREE(mm->page_list);
 		mm->page_list = NULL;
 	}
 
-	mm->base_addr  = 0;
-	mm->mem_size   = 0;
-	mm->num_pages  = 0;
-	mm->page_list  = NULL;
-	mm->free_tree  = NULL;
-	mm->alloc_tree = NULL;
-	mm->free_page_count = 0;
-	mm->alloc_page_count = 0;
+	memset(mm, 0, sizeof(*mm));
 	return 0;
 }
 
 unsigned long vmem_alloc(video_mm_t *mm, int size, unsigned long pid)
 {
-	avl_node_t *node;
 	page_t *free_page;
 	int		 npages, free_size;
 	int		 alloc_pageno;
@@ -506,108 +271,90 @@ unsigned long vmem_alloc(video_mm_t *mm, int size, unsigned long pid)
 
 	npages = (size + VMEM_PAGE_SIZE - 1)/VMEM_PAGE_SIZE;
 
-	mm->free_tree = remove_approx_value(mm->free_tree, &node, MAKE_KEY(npages, 0));
-	if (node == NULL) {
+	free_page = vmem_find_free(mm, npages);
+	if (free_page == NULL) {
+		mm->fail_count++;
 		return -1;
 	}
-	free_page = node->page;
-	free_size = KEY_TO_VALUE(node->key);
+	vmem_remove_free(mm, free_page);
+	free_size = free_page->alloc_pages;
 
 	alloc_pageno = free_page->pageno;
-	set_blocks_alloc(mm, alloc_pageno, npages);
+	set_blocks_alloc(mm, alloc_pageno, npages, pid);
 	if (npages != free_size) {
 		int free_pageno = alloc_pageno + npages;
 		set_blocks_free(mm, free_pageno, (free_size-npages));
 	}
 
-	VMEM_P_FREE(node);
-
 	ptr = mm->page_list[alloc_pageno].addr;
 	mm->alloc_page_count += npages;
 	mm->free_page_count  -= npages;
-
+	mm->alloc_block_count++;
+	mm->alloc_count++;
+	if (mm->alloc_page_count > mm->peak_page_count)
+		mm->peak_page_count = mm->alloc_page_count;
 
 	return ptr;
 }
 
 int vmem_free(video_mm_t *mm, unsigned long ptr, unsigned long pid)
 {
-	unsigned long addr;
-	avl_node_t *found;
-	page_t *page;
-	int pageno, prev_free_pageno, next_free_pageno;
-	int prev_size, next_size;
-	int merge_page_no, merge_page_size, free_page_size;
-
+	page_t *page, *prev, *next;
+	int pageno, free_page_size;
+	int merge_page_no, merge_page_size;
 
 	if (mm == NULL) {
 		printk(KERN_INFO "vmem_free: invalid handle\n");
 		return -1;
 	}
 
-	addr = ptr;
+	if (ptr < mm->base_addr || ptr >= mm->base_addr + mm->mem_size ||
+	    (ptr - mm->base_addr) % VMEM_PAGE_SIZE) {
+		printk(KERN_INFO "vmem_free: 0x%08lx not found\n", ptr);
+		return -1;
+	}
 
-	mm->alloc_tree = avltree_remove(mm->alloc_tree, &found, MAKE_KEY(addr, 0));
-	if (found == NULL) {
-		printk(KERN_INFO "vmem_free: 0x%08x not found\n", (int)addr);
+	pageno = (ptr - mm->base_addr) / VMEM_PAGE_SIZE;
+	page = &mm->page_list[pageno];
+	if (!page->used || page->alloc_pages <= 0 ||
+	    mm->page_list[pageno + page->alloc_pages - 1].first_pageno != pageno) {
+		printk(KERN_INFO "vmem_free: 0x%08lx not found\n", ptr);
 		VMEM_ASSERT(0);
 		return -1;
 	}
 
-	/* find previous free block */
-	page = found->page;
-	pageno = page->pageno;
 	free_page_size = page->alloc_pages;
-	prev_free_pageno = pageno-1;
-	prev_size = -1;
-	if (prev_free_pageno >= 0) {
-		if (mm->page_list[prev_free_pageno].used == 0) {
-			prev_free_pageno = mm->page_list[prev_free_pageno].first_pageno;
-			prev_size = mm->page_list[prev_free_pageno].alloc_pages;
-		}
-	}
+	merge_page_no = pageno;
+	merge_page_size = free_page_size;
 
-	/* find next free block */
-	next_free_pageno = pageno + page->alloc_pages;
-	next_free_pageno = (next_free_pageno == mm->num_pages) ? -1 : next_free_pageno;
-	next_size = -1;
-	if (next_free_pageno >= 0) {
-		if (mm->page_list[next_free_pageno].used == 0) {
-			next_size = mm->page_list[next_free_pageno].alloc_pages;
-		}
+	/* merge with the previous free block */
+	if (pageno > 0 && !mm->page_list[pageno - 1].used) {
+		prev = &mm->page_list[mm->page_list[pageno - 1].first_pageno];
+		vmem_remove_free(mm, prev);
+		merge_page_no = prev->pageno;
+		merge_page_size += prev->alloc_pages;
+		prev->alloc_pages = 0;
 	}
-	VMEM_P_FREE(found);
-
-	/* merge */
-	merge_page_no = page->pageno;
-	merge_page_size = page->alloc_pages;
-	if (prev_size >= 0) {
-		mm->free_tree = avltree_remove(mm->free_tree, &found, MAKE_KEY(prev_size, prev_free_pageno));
-		if (found == NULL) {
-			VMEM_ASSERT(0);
-			return -1;
-		}
-		merge_page_no = found->page->pageno;
-		merge_page_size += found->page->alloc_pages;
-		VMEM_P_FREE(found);
-	}
-	if (next_size >= 0) {
-		mm->free_tree = avltree_remove(mm->free_tree, &found, MAKE_KEY(next_size, next_free_pageno));
-		if (found == NULL) {
-			VMEM_ASSERT(0);
-			return -1;
-		}
-		merge_page_size += found->page->alloc_pages;
-		VMEM_P_FREE(found);
+
+	/* merge with the next free block */
+	if (pageno + free_page_size < mm->num_pages &&
+	    !mm->page_list[pageno + free_page_size].used) {
+		next = &mm->page_list[pageno + free_page_size];
+		vmem_remove_free(mm, next);
+		merge_page_size += next->alloc_pages;
+		next->alloc_pages = 0;
 	}
 
+	page->used = 0;
 	page->alloc_pages  = 0;
-	page->first_pageno = -1;
+	page->owner = 0;
 
 	set_blocks_free(mm, merge_page_no, merge_page_size);
 
 	mm->alloc_page_count -= free_page_size;
 	mm->free_page_count  += free_page_size;
+	mm->alloc_block_count--;
+	mm->free_count++;
 
 	return 0;
 }
@@ -631,4 +378,44 @@ int vmem_get_info(video_mm_t *mm, vmem_info_t *info)
 	return 0;
 }
 
+/* dump usage, fragmentation and per owner blocks, walks the whole page list */
+void vmem_show(video_mm_t *mm, struct seq_file *s)
+{
+	int pageno, npages, free_blocks = 0, largest_free = 0;
+	page_t *page;
+
+	for (pageno = 0; pageno < mm->num_pages; pageno += npages) {
+		page = &mm->page_list[pageno];
+		npages = page->alloc_pages;
+		if (npages <= 0)
+			break;
+		if (!page->used) {
+			free_blocks++;
+			largest_free = max(largest_free, npages);
+		}
+	}
+
+	seq_printf(s, "page size      : %d\n", VMEM_PAGE_SIZE);
+	seq_printf(s, "total pages    : %d\n", mm->num_pages);
+	seq_printf(s, "alloc pages    : %d (%d blocks)\n", mm->alloc_page_count, mm->alloc_block_count);
+	seq_printf(s, "free pages     : %d (%d blocks)\n", mm->free_page_count, free_blocks);
+	seq_printf(s, "peak pages     : %d\n", mm->peak_page_count);
+	seq_printf(s, "largest free   : %d\n", largest_free);
+	seq_printf(s, "fragmentation  : %d%%\n", mm->free_page_count ?
+		   100 - largest_free * 100 / mm->free_page_count : 0);
+	seq_printf(s, "alloc/free/fail: %lu/%lu/%lu\n",
+		   mm->alloc_count, mm->free_count, mm->fail_count);
+
+	seq_puts(s, "blocks:\n");
+	for (pageno = 0; pageno < mm->num_pages; pageno += npages) {
+		page = &mm->page_list[pageno];
+		npages = page->alloc_pages;
+		if (npages <= 0)
+			break;
+		if (page->used)
+			seq_printf(s, "  0x%08lx %6d pages pid %lu\n",
+				   page->addr, npages, page->owner);
+	}
+}
+
 #endif /* __RTK_VIDEO_MEMORY_MANAGEMENT_H__ */
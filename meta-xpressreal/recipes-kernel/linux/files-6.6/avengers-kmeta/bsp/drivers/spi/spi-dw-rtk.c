@@ -23,15 +23,35 @@
 #include <linux/reset.h>
 #include <linux/io.h>
 #include <linux/pm_runtime.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include "spi-dw.h"
 
 #define DRIVER_NAME "spi-dw-rtk"
 #define SPI_Wra_CTRL 0
+#define RTK_SPI_DMA_THRESHOLD	256
+
+struct rtk_spi_stats {
+	u64 pio_bytes;
+	u64 dma_bytes;
+	u32 pio_xfers;
+	u32 dma_xfers;
+	u32 dma_errors;
+};
 
 struct rtk_spi {
 	struct dw_spi dws;
 
+	/* generic DW DMA ops with the RTK size policy on top */
+	struct dw_spi_dma_ops dma_ops;
+	const struct dw_spi_dma_ops *dma_generic;
+	int (*transfer_one)(struct spi_controller *master,
+			    struct spi_device *spi, struct spi_transfer *xfer);
+	u32 dma_threshold;
+	bool force_pio;
+	struct rtk_spi_stats stats;
+
 	void __iomem *spi_wrapper;
 	struct clk *clk;
 	struct reset_control *rstc;
@@ -64,6 +84,108 @@ static void rtk_spi_set_cs(struct spi_device *spi, bool enable)
 	dw_spi_set_cs(spi, enable);
 }
 
+/*
+ * Short transfers are cheaper in PIO than a DMA descriptor round trip,
+ * only hand transfers from dma_threshold bytes up to the DMA engine.
+ */
+static bool rtk_spi_can_dma(struct spi_controller *master,
+			    struct spi_device *spi, struct spi_transfer *xfer)
+{
+	struct dw_spi *dws = spi_controller_get_devdata(master);
+	struct rtk_spi *hw = container_of(dws, struct rtk_spi, dws);
+
+	if (hw->force_pio || xfer->len < hw->dma_threshold)
+		return false;
+
+	return hw->dma_generic->can_dma(master, spi, xfer);
+}
+
+static int rtk_spi_dma_transfer(struct dw_spi *dws, struct spi_transfer *xfer)
+{
+	struct rtk_spi *hw = container_of(dws, struct rtk_spi, dws);
+	int ret;
+
+	ret = hw->dma_generic->dma_transfer(dws, xfer);
+	if (ret < 0)
+		hw->stats.dma_errors++;
+
+	return ret;
+}
+
+static int rtk_spi_transfer_one(struct spi_controller *master,
+				struct spi_device *spi,
+				struct spi_transfer *xfer)
+{
+	struct dw_spi *dws = spi_controller_get_devdata(master);
+	struct rtk_spi *hw = container_of(dws, struct rtk_spi, dws);
+	int ret;
+
+	ret = hw->transfer_one(master, spi, xfer);
+
+	if (dws->dma_mapped) {
+		hw->stats.dma_xfers++;
+		hw->stats.dma_bytes += xfer->len;
+	} else {
+		hw->stats.pio_xfers++;
+		hw->stats.pio_bytes += xfer->len;
+	}
+
+	return ret;
+}
+
+static void rtk_spi_dma_setup(struct rtk_spi *hw)
+{
+	struct dw_spi *dws = &hw->dws;
+
+	hw->dma_threshold = RTK_SPI_DMA_THRESHOLD;
+
+	if (!of_property_present(hw->dev->of_node, "dmas"))
+		return;
+
+	dw_spi_dma_setup_generic(dws);
+	if (!dws->dma_ops)
+		return;
+
+	hw->dma_generic = dws->dma_ops;
+	hw->dma_ops = *dws->dma_ops;
+	hw->dma_ops.can_dma = rtk_spi_can_dma;
+	hw->dma_ops.dma_transfer = rtk_spi_dma_transfer;
+	dws->dma_ops = &hw->dma_ops;
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int rtk_spi_stats_show(struct seq_file *s, void *data)
+{
+	struct rtk_spi *hw = s->private;
+
+	seq_printf(s, "dma: %s\n", hw->dws.master->can_dma ?
+		   (hw->force_pio ? "forced off" : "enabled") : "unavailable");
+	seq_printf(s, "dma_threshold: %u\n", hw->dma_threshold);
+	seq_printf(s, "pio: %u xfers, %llu bytes\n", hw->stats.pio_xfers,
+		   hw->stats.pio_bytes);
+	seq_printf(s, "dma: %u xfers, %llu bytes, %u errors\n",
+		   hw->stats.dma_xfers, hw->stats.dma_bytes,
+		   hw->stats.dma_errors);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(rtk_spi_stats);
+
+static void rtk_spi_debugfs_init(struct rtk_spi *hw)
+{
+	struct dentry *dir = hw->dws.debugfs;
+
+	if (!dir)
+		return;
+
+	debugfs_create_u32("dma_threshold", 0644, dir, &hw->dma_threshold);
+	debugfs_create_bool("force_pio", 0644, dir, &hw->force_pio);
+	debugfs_create_file("stats", 0444, dir, hw, &rtk_spi_stats_fops);
+}
+#else
+static inline void rtk_spi_debugfs_init(struct rtk_spi *hw) {}
+#endif
+
 static int rtk_spi_probe(struct platform_device *pdev)
 {
 	struct rtk_spi *hw;
@@ -71,6 +193,7 @@ static int rtk_spi_probe(struct platform_device *pdev)
 	struct clk *clk = clk_get(&pdev->dev, NULL);
 	struct reset_control *rstc =
 		reset_control_get_exclusive(&pdev->dev, NULL);
+	struct resource res;
 	u32 val;
 	int err = -ENODEV;
 
@@ -97,6 +220,9 @@ static int rtk_spi_probe(struct platform_device *pdev)
 		dev_err(&pdev->dev, "[SPI] DW SPI region map failed, addr 0x%p\n", dws->regs);
 		goto exit;
 	}
+	/* the DMA engine addresses the data register physically */
+	if (!of_address_to_resource(pdev->dev.of_node, 0, &res))
+		dws->paddr = res.start;
 	hw->spi_wrapper = of_iomap(pdev->dev.of_node, 1);
 
 	if (IS_ERR(dws->regs)) {
@@ -122,6 +248,8 @@ static int rtk_spi_probe(struct platform_device *pdev)
 	hw->rstc = rstc;
 	hw->dev = &pdev->dev;
 
+	rtk_spi_dma_setup(hw);
+
 	pm_runtime_enable(&pdev->dev);
 
 	/* call setup function */
@@ -130,9 +258,13 @@ static int rtk_spi_probe(struct platform_device *pdev)
 		pr_err("[SPI] Init failed, ret = %d\n", err);
 		goto dw_err_exit;
 	}
-	dev_info(&pdev->dev, "[SPI] num_cs %d, bus_num %d, max_freq %d, irq %d\n",
+
+	hw->transfer_one = hw->dws.master->transfer_one;
+	hw->dws.master->transfer_one = rtk_spi_transfer_one;
+	rtk_spi_debugfs_init(hw);
+	dev_info(&pdev->dev, "[SPI] num_cs %d, bus_num %d, max_freq %d, irq %d, dma %s\n",
 		 hw->dws.num_cs, hw->dws.bus_num, hw->dws.max_freq,
-		 hw->dws.irq);
+		 hw->dws.irq, hw->dws.master->can_dma ? "on" : "off");
 
 	#if IS_ENABLED(CONFIG_SPI_SPIDEV)
 	/* add spidev */
@@ -3,13 +3,55 @@
  * Copyright (c) 2017,2020 Realtek Semiconductor Corp.
  */
 
+#include <linux/cpufreq.h>
 #include <linux/cpumask.h>
 #include <linux/device.h>
+#include <linux/idle_inject.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/of.h>
 #include <linux/platform_device.h>
+#include <linux/pm_opp.h>
+#include <linux/pm_qos.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
 #include <linux/thermal.h>
 #include <soc/realtek/rtk_cpuhp.h>
+#include "sensor.h"
+
+/*
+ * Every cooling state is a combination of a cpufreq cap, an idle
+ * injection ratio and a number of online CPUs. All combinations are
+ * rated with a simple model, at full load:
+ *
+ *   power = cpus * (dyn(freq) * (100 - idle) / 100 + static)
+ *   perf  = cpus * freq * (100 - idle) / 100
+ *
+ * with dyn(freq) = dynamic-power-coefficient * MHz * mV^2 / 10^9, as
+ * cpufreq_cooling does. The states are the options that no other option
+ * beats on both power and perf, ordered by falling power, so each step
+ * gives up the least throughput for the power it saves. For equal perf
+ * more online CPUs win, which leaves offlining to the last states.
+ */
+#define C3DEV_IDLE_PERIOD_US          10000
+#define C3DEV_MAX_DECISIONS           32
+
+static const unsigned int c3dev_idle_levels[] = { 0, 25, 50 };
+
+struct c3dev_option {
+	unsigned int                  freq_khz;
+	unsigned int                  idle_pct;
+	unsigned int                  cpus;
+	u32                           power_mw;
+	u32                           perf;
+};
+
+struct c3dev_decision {
+	s64                           t_ms;
+	unsigned long                 from;
+	unsigned long                 to;
+};
 
 struct c3dev {
 	struct device                 *dev;
@@ -17,8 +59,151 @@ struct c3dev {
 	unsigned long                 max_state;
 	unsigned long                 cur_state;
 	struct rtk_cpuhp_qos_request  req;
+
+	struct cpufreq_policy         *policy;
+	struct freq_qos_request       freq_req;
+	struct idle_inject_device     *ii;
+	struct c3dev_option           *opts;
+	int                           num_opts;
+
+	struct mutex                  lock;
+	struct c3dev_decision         decisions[C3DEV_MAX_DECISIONS];
+	unsigned int                  decision_pos;
+	unsigned int                  decision_num;
 };
 
+static struct c3dev *c3dev_data;
+
+static unsigned int c3dev_num_idle_levels(struct c3dev *c)
+{
+	return c->ii ? ARRAY_SIZE(c3dev_idle_levels) : 1;
+}
+
+static int c3dev_option_cmp(const void *a, const void *b)
+{
+	const struct c3dev_option *x = a, *y = b;
+
+	if (x->power_mw != y->power_mw)
+		return x->power_mw < y->power_mw ? -1 : 1;
+	if (x->perf != y->perf)
+		return x->perf > y->perf ? -1 : 1;
+	return y->cpus - x->cpus;
+}
+
+static int c3dev_build_ladder(struct c3dev *c)
+{
+	struct device_node *np = c->dev->of_node;
+	struct device *cpu_dev = get_cpu_device(0);
+	unsigned int ncpus = num_possible_cpus();
+	unsigned int nidle = c3dev_num_idle_levels(c);
+	unsigned long freq;
+	struct dev_pm_opp *opp;
+	u32 coeff = 100, static_mw = 0;
+	int nfreq;
+	int i, j, k, n;
+	u32 best;
+
+	nfreq = cpu_dev ? dev_pm_opp_get_opp_count(cpu_dev) : 0;
+	if (!c->policy || nfreq <= 0)
+		nfreq = 0;
+
+	if (cpu_dev && cpu_dev->of_node)
+		of_property_read_u32(cpu_dev->of_node, "dynamic-power-coefficient", &coeff);
+	of_property_read_u32(np, "realtek,static-power-mw", &static_mw);
+
+	c->opts = devm_kcalloc(c->dev, max(nfreq, 1) * nidle * ncpus, sizeof(*c->opts),
+			       GFP_KERNEL);
+	if (!c->opts)
+		return -ENOMEM;
+
+	n = 0;
+	for (i = 0, freq = 0; i < max(nfreq, 1); i++, freq++) {
+		unsigned long mhz = 1000, mv = 1000;
+		u64 dyn;
+
+		if (nfreq) {
+			opp = dev_pm_opp_find_freq_ceil(cpu_dev, &freq);
+			if (IS_ERR(opp))
+				break;
+			mhz = freq / 1000000;
+			mv = dev_pm_opp_get_voltage(opp) / 1000;
+			dev_pm_opp_put(opp);
+		}
+		dyn = div_u64((u64)coeff * mhz * mv * mv, 1000000000);
+
+		for (j = 0; j < nidle; j++) {
+			unsigned int active = 100 - c3dev_idle_levels[j];
+
+			for (k = ncpus; k >= 1; k--) {
+				struct c3dev_option *o = &c->opts[n++];
+
+				o->freq_khz = nfreq ? freq / 1000 : FREQ_QOS_MAX_DEFAULT_VALUE;
+				o->idle_pct = c3dev_idle_levels[j];
+				o->cpus = k;
+				o->power_mw = k * (div_u64(dyn * active, 100) + static_mw);
+				o->perf = k * mhz * active / 100;
+			}
+		}
+	}
+
+	sort(c->opts, n, sizeof(*c->opts), c3dev_option_cmp, NULL);
+
+	/* cheapest first, keep what beats every cheaper option on perf */
+	best = 0;
+	for (i = 0, j = 0; i < n; i++) {
+		if (c->opts[i].perf <= best)
+			continue;
+		best = c->opts[i].perf;
+		c->opts[j++] = c->opts[i];
+	}
+	c->num_opts = j;
+
+	/* state 0 is the most expensive one */
+	for (i = 0; i < j / 2; i++)
+		swap(c->opts[i], c->opts[j - 1 - i]);
+
+	c->max_state = c->num_opts - 1;
+	return 0;
+}
+
+static void c3dev_apply(struct c3dev *c, const struct c3dev_option *o)
+{
+	if (c->policy)
+		freq_qos_update_request(&c->freq_req, o->freq_khz);
+
+#ifdef CONFIG_IDLE_INJECT
+	if (c->ii) {
+		unsigned int idle_us = C3DEV_IDLE_PERIOD_US * o->idle_pct / 100;
+
+		idle_inject_stop(c->ii);
+		if (idle_us) {
+			idle_inject_set_duration(c->ii, C3DEV_IDLE_PERIOD_US - idle_us, idle_us);
+			idle_inject_start(c->ii);
+		}
+	}
+#endif
+
+	rtk_cpuhp_qos_update_request(&c->req, num_possible_cpus() - o->cpus);
+}
+
+static void c3dev_log(struct c3dev *c, unsigned long from, unsigned long to)
+{
+	struct c3dev_decision *d = &c->decisions[c->decision_pos];
+
+	/* called with the zone locked, so no temperature here */
+	d->t_ms = ktime_to_ms(ktime_get());
+	d->from = from;
+	d->to = to;
+
+	c->decision_pos = (c->decision_pos + 1) % C3DEV_MAX_DECISIONS;
+	if (c->decision_num < C3DEV_MAX_DECISIONS)
+		c->decision_num++;
+
+	dev_dbg(c->dev, "state %lu -> %lu: %ukHz idle=%u%% cpus=%u %umW\n", from, to,
+		c->opts[to].freq_khz, c->opts[to].idle_pct, c->opts[to].cpus,
+		c->opts[to].power_mw);
+}
+
 static int c3dev_get_max_state(struct thermal_cooling_device *cdev,
 			       unsigned long *state)
 {
@@ -42,14 +227,122 @@ static int c3dev_set_cur_state(struct thermal_cooling_device *cdev,
 {
 	struct c3dev *c = cdev->devdata;
 
-	rtk_cpuhp_qos_update_request(&c->req, (int)state);
+	if (state > c->max_state)
+		return -EINVAL;
+
+	mutex_lock(&c->lock);
+	if (state != c->cur_state) {
+		c3dev_apply(c, &c->opts[state]);
+		c3dev_log(c, c->cur_state, state);
+		c->cur_state = state;
+	}
+	mutex_unlock(&c->lock);
+	return 0;
+}
+
+/* full load is assumed, so the request is the power of the first state */
+static int c3dev_get_requested_power(struct thermal_cooling_device *cdev,
+				     u32 *power)
+{
+	struct c3dev *c = cdev->devdata;
+
+	*power = c->opts[0].power_mw;
+	return 0;
+}
+
+static int c3dev_state2power(struct thermal_cooling_device *cdev,
+			     unsigned long state, u32 *power)
+{
+	struct c3dev *c = cdev->devdata;
+
+	if (state > c->max_state)
+		return -EINVAL;
+
+	*power = c->opts[state].power_mw;
+	return 0;
+}
+
+static int c3dev_power2state(struct thermal_cooling_device *cdev,
+			     u32 power, unsigned long *state)
+{
+	struct c3dev *c = cdev->devdata;
+	unsigned long i;
+
+	for (i = 0; i < c->max_state; i++)
+		if (c->opts[i].power_mw <= power)
+			break;
+
+	*state = i;
 	return 0;
 }
 
 static struct thermal_cooling_device_ops c3dev_cooling_ops = {
-	.get_max_state = c3dev_get_max_state,
-	.get_cur_state = c3dev_get_cur_state,
-	.set_cur_state = c3dev_set_cur_state,
+	.get_max_state       = c3dev_get_max_state,
+	.get_cur_state       = c3dev_get_cur_state,
+	.set_cur_state       = c3dev_set_cur_state,
+	.get_requested_power = c3dev_get_requested_power,
+	.state2power         = c3dev_state2power,
+	.power2state         = c3dev_power2state,
+};
+
+int rtk_cpu_core_cooling_get_power(void)
+{
+	struct c3dev *c = c3dev_data;
+
+	if (!c)
+		return -ENODEV;
+	return c->opts[c->cur_state].power_mw;
+}
+EXPORT_SYMBOL_GPL(rtk_cpu_core_cooling_get_power);
+
+static ssize_t states_show(struct device *dev, struct device_attribute *attr,
+			   char *buf)
+{
+	struct c3dev *c = dev_get_drvdata(dev);
+	int len = 0;
+	int i;
+
+	len += scnprintf(buf + len, PAGE_SIZE - len,
+			 "state freq_khz idle_pct cpus power_mw perf\n");
+	for (i = 0; i < c->num_opts; i++) {
+		struct c3dev_option *o = &c->opts[i];
+
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%c%4d %8u %8u %4u %8u %4u\n",
+				 i == c->cur_state ? '*' : ' ', i, o->freq_khz,
+				 o->idle_pct, o->cpus, o->power_mw, o->perf);
+	}
+	return len;
+}
+static DEVICE_ATTR_RO(states);
+
+static ssize_t decisions_show(struct device *dev, struct device_attribute *attr,
+			      char *buf)
+{
+	struct c3dev *c = dev_get_drvdata(dev);
+	struct c3dev_decision *d;
+	unsigned int i, pos;
+	int len = 0;
+
+	mutex_lock(&c->lock);
+	pos = (c->decision_pos + C3DEV_MAX_DECISIONS - c->decision_num) % C3DEV_MAX_DECISIONS;
+	for (i = 0; i < c->decision_num; i++) {
+		d = &c->decisions[(pos + i) % C3DEV_MAX_DECISIONS];
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%lld %lu %lu\n",
+				 d->t_ms, d->from, d->to);
+	}
+	mutex_unlock(&c->lock);
+	return len;
+}
+static DEVICE_ATTR_RO(decisions);
+
+static struct attribute *c3dev_attrs[] = {
+	&dev_attr_states.attr,
+	&dev_attr_decisions.attr,
+	NULL
+};
+
+static const struct attribute_group c3dev_attr_group = {
+	.attrs = c3dev_attrs,
 };
 
 static int c3dev_probe(struct platform_device *pdev)
@@ -64,28 +357,87 @@ static int c3dev_probe(struct platform_device *pdev)
 		return -ENOMEM;
 
 	c->dev = dev;
-	c->max_state = num_possible_cpus() - 1;
 	c->cur_state = 0;
-	rtk_cpuhp_qos_add_request(&c->req, 0);
+	mutex_init(&c->lock);
+
+	if (IS_ENABLED(CONFIG_CPU_FREQ)) {
+		c->policy = cpufreq_cpu_get(0);
+		if (!c->policy)
+			return -EPROBE_DEFER;
+
+		ret = freq_qos_add_request(&c->policy->constraints, &c->freq_req,
+					   FREQ_QOS_MAX, FREQ_QOS_MAX_DEFAULT_VALUE);
+		if (ret < 0)
+			goto put_policy;
+	}
+
+#ifdef CONFIG_IDLE_INJECT
+	c->ii = idle_inject_register((struct cpumask *)cpu_possible_mask);
+	if (!c->ii)
+		dev_warn(dev, "no idle injection, using the other options only\n");
+#endif
+
+	ret = c3dev_build_ladder(c);
+	if (ret)
+		goto unregister_idle;
+
+	ret = rtk_cpuhp_qos_add_request(&c->req, 0);
+	if (ret < 0) {
+		dev_err(dev, "failed to add cpuhp request: %d\n", ret);
+		goto unregister_idle;
+	}
 
 	c->cdev = thermal_of_cooling_device_register(np, "thermal-cpu-core",
 						     c, &c3dev_cooling_ops);
 	if (IS_ERR(c->cdev)) {
 		ret = PTR_ERR(c->cdev);
 		dev_err(dev, "failed to register cooling device: %d\n", ret);
-		rtk_cpuhp_qos_remove_request(&c->req);
-		return ret;
+		goto remove_qos_req;
 	}
 
+	platform_set_drvdata(pdev, c);
+
+	ret = sysfs_create_group(&dev->kobj, &c3dev_attr_group);
+	if (ret)
+		dev_warn(dev, "failed to create sysfs group: %d\n", ret);
+
+	dev_info(dev, "%d cooling states\n", c->num_opts);
+	c3dev_data = c;
 	return 0;
+
+remove_qos_req:
+	rtk_cpuhp_qos_remove_request(&c->req);
+unregister_idle:
+#ifdef CONFIG_IDLE_INJECT
+	if (c->ii)
+		idle_inject_unregister(c->ii);
+#endif
+	if (c->policy)
+		freq_qos_remove_request(&c->freq_req);
+put_policy:
+	if (c->policy)
+		cpufreq_cpu_put(c->policy);
+	return ret;
 }
 
 static int c3dev_remove(struct platform_device *pdev)
 {
 	struct c3dev *c = platform_get_drvdata(pdev);
 
+	c3dev_data = NULL;
+	sysfs_remove_group(&pdev->dev.kobj, &c3dev_attr_group);
 	thermal_cooling_device_unregister(c->cdev);
 	rtk_cpuhp_qos_remove_request(&c->req);
+#ifdef CONFIG_IDLE_INJECT
+	if (c->ii) {
+		idle_inject_stop(c->ii);
+		idle_inject_unregister(c->ii);
+	}
+#endif
+	if (c->policy) {
+		freq_qos_remove_request(&c->freq_req);
+		cpufreq_cpu_put(c->policy);
+	}
 	return 0;
 }
 
@@ -6,6 +6,7 @@
  * Author: Cheng-Yu Lee <cylee12@realtek.com>
  */
 
+#include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/of.h>
 #include <linux/platform_device.h>
@@ -13,6 +14,7 @@
 #include <linux/slab.h>
 #include <linux/thermal.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/mfd/syscon.h>
 #include <linux/of_device.h>
 #include <linux/of_address.h>
@@ -92,6 +94,116 @@ void thermal_sensor_hw_dump_status(struct thermal_sensor_device *tdev)
 	}
 }
 
+#ifdef CONFIG_DEBUG_FS
+/*
+ * Synthetic first-order thermal model, to drive the cooling devices and
+ * governors without heating the SoC. When enabled it replaces the sensor
+ * reading with
+ *
+ *   T += (ambient + P * rth - T) * dt / (tau + dt)
+ *
+ * where P is power_mw, or the power of the current CPU cooling state when
+ * power_mw is negative.
+ */
+static struct thermal_sensor_model {
+	struct mutex lock;
+	struct dentry *debugfs;
+	bool enable;
+	s64 ambient_mc;
+	u32 rth;        /* mC per W */
+	u32 tau_ms;
+	s64 power_mw;
+	int temp;
+	ktime_t last;
+} tmodel = {
+	.lock       = __MUTEX_INITIALIZER(tmodel.lock),
+	.ambient_mc = 40000,
+	.rth        = 20000,
+	.tau_ms     = 5000,
+	.power_mw   = -1,
+};
+
+static int thermal_sensor_model_get_temp(int *temp)
+{
+	ktime_t now = ktime_get();
+	s64 dt, power, target;
+
+	mutex_lock(&tmodel.lock);
+	if (!tmodel.enable) {
+		tmodel.last = 0;
+		mutex_unlock(&tmodel.lock);
+		return -ENODATA;
+	}
+
+	if (!tmodel.last) {
+		tmodel.temp = tmodel.ambient_mc;
+		tmodel.last = now;
+	}
+
+	power = tmodel.power_mw;
+	if (power < 0)
+		power = max(rtk_cpu_core_cooling_get_power(), 0);
+	target = tmodel.ambient_mc + div_s64(power * tmodel.rth, 1000);
+
+	dt = ktime_ms_delta(now, tmodel.last);
+	if (dt > 0) {
+		tmodel.temp += div64_s64((target - tmodel.temp) * dt, tmodel.tau_ms + dt);
+		tmodel.last = now;
+	}
+	*temp = tmodel.temp;
+	mutex_unlock(&tmodel.lock);
+	return 0;
+}
+
+static int thermal_sensor_model_s64_get(void *data, u64 *val)
+{
+	mutex_lock(&tmodel.lock);
+	*val = *(s64 *)data;
+	mutex_unlock(&tmodel.lock);
+	return 0;
+}
+
+static int thermal_sensor_model_s64_set(void *data, u64 val)
+{
+	mutex_lock(&tmodel.lock);
+	*(s64 *)data = val;
+	mutex_unlock(&tmodel.lock);
+	return 0;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(thermal_sensor_model_s64_fops, thermal_sensor_model_s64_get,
+			 thermal_sensor_model_s64_set, "%lld\n");
+
+static void thermal_sensor_model_init(void)
+{
+	struct dentry *d;
+
+	d = debugfs_create_dir("rtk_thermal_model", NULL);
+	debugfs_create_bool("enable", 0644, d, &tmodel.enable);
+	debugfs_create_file("ambient_mc", 0644, d, &tmodel.ambient_mc,
+			    &thermal_sensor_model_s64_fops);
+	debugfs_create_u32("rth", 0644, d, &tmodel.rth);
+	debugfs_create_u32("tau_ms", 0644, d, &tmodel.tau_ms);
+	debugfs_create_file("power_mw", 0644, d, &tmodel.power_mw,
+			    &thermal_sensor_model_s64_fops);
+	debugfs_create_u32("temp", 0444, d, (u32 *)&tmodel.temp);
+	tmodel.debugfs = d;
+}
+
+static void thermal_sensor_model_exit(void)
+{
+	debugfs_remove_recursive(tmodel.debugfs);
+	tmodel.debugfs = NULL;
+}
+#else
+static inline int thermal_sensor_model_get_temp(int *temp)
+{
+	return -ENODATA;
+}
+
+static inline void thermal_sensor_model_init(void) {}
+static inline void thermal_sensor_model_exit(void) {}
+#endif
+
 static const struct thermal_zone_device_ops rtk_thermal_device_ops;
 
 static int thermal_sensor_device_add(struct device *dev,
@@ -126,6 +238,11 @@ static int thermal_sensor_get_temp(struct thermal_zone_device *tz, int *temp)
 	struct thermal_sensor_device *tdev = thermal_zone_device_priv(tz);
 	int ret;
 
+	if (!thermal_sensor_model_get_temp(temp)) {
+		dev_dbg(tdev->dev, "model temp=%d\n", *temp);
+		return 0;
+	}
+
 	ret = thermal_sensor_hw_get_temp(tdev, temp);
 
 	if (ret || !is_vaild_temp(*temp)) {
@@ -194,6 +311,7 @@ static int thermal_sensor_probe(struct platform_device *pdev)
 	if (ret)
 		dev_err(dev, "failed to add thermal sensor: %d\n", ret);
 	platform_set_drvdata(pdev, tdev);
+	thermal_sensor_model_init();
 	return 0;
 }
 
@@ -201,6 +319,7 @@ static int thermal_sensor_remove(struct platform_device *pdev)
 {
 	struct thermal_sensor_device *tdev = platform_get_drvdata(pdev);
 
+	thermal_sensor_model_exit();
 	thermal_sensor_device_remove(tdev);
 	platform_set_drvdata(pdev, NULL);
 	return 0;
@@ -81,4 +81,13 @@ static inline int is_vaild_temp(int temp)
 	return 1;
 }
 
+#if IS_ENABLED(CONFIG_RTK_THERMAL_CPU_CORE_COOLING)
+int rtk_cpu_core_cooling_get_power(void);
+#else
+static inline int rtk_cpu_core_cooling_get_power(void)
+{
+	return -ENODEV;
+}
+#endif
+
 #endif
@@ -19,6 +19,15 @@ int rtk_cpuhp_qos_add_request(struct rtk_cpuhp_qos_request *req, s32 value);
 int rtk_cpuhp_qos_update_request(struct rtk_cpuhp_qos_request *req, s32 new_value);
 int rtk_cpuhp_qos_remove_request(struct rtk_cpuhp_qos_request *req);
 
+/*
+ * Floor requests set the minimum number of online CPUs the controller
+ * keeps in load mode; the largest one wins. They share the update/remove
+ * calls and the notifier chain with the offline requests above, which
+ * take precedence.
+ */
+s32 rtk_cpuhp_floor_read_value(void);
+int rtk_cpuhp_floor_add_request(struct rtk_cpuhp_qos_request *req, s32 value);
+
 int rtk_cpuhp_qos_add_notifier(struct notifier_block *notifier);
 int rtk_cpuhp_qos_remove_notifier(struct notifier_block *notifier);
 
@@ -76,6 +76,11 @@ static void snd_card_capture_setup_pts(struct snd_pcm_runtime *runtime, struct A
 static int snd_realtek_capture_check_hdmirx_enable(void);
 char *snd_realtek_capture_get_stream_name(void);
 static void snd_card_capture_handle_HDMI_plug_out(struct snd_pcm_substream *substream);
+static void snd_card_capture_zero_copy_release(struct snd_pcm_runtime *runtime);
+static void snd_card_capture_zero_copy_resync(struct snd_pcm_runtime *runtime);
+static int snd_card_capture_zero_copy_reconnect(struct snd_pcm_runtime *runtime,
+			unsigned int offset);
+static void snd_card_capture_zero_copy_work(struct work_struct *work);
 
 
 static enum hrtimer_restart snd_card_timer_function(struct hrtimer *timer);
@@ -122,6 +127,7 @@ static spinlock_t playback_lock;
 static spinlock_t capture_lock;
 static int mtotal_latency;
 static bool is_suspend;
+static bool capture_zero_copy;
 
 static char gRtkDriverName[] = SND_REALTEK_DRIVER_HDMI_IN;
 
@@ -210,6 +216,8 @@ module_param_array(snd_card_enable, bool, NULL, 0444);
 MODULE_PARM_DESC(snd_card_enable, "Enable this mars soundcard.");
 module_param_array(pcm_substreams, int, NULL, 0444);
 MODULE_PARM_DESC(pcm_substreams, "PCM substreams # (1-16) for mars driver.");
+module_param(capture_zero_copy, bool, 0644);
+MODULE_PARM_DESC(capture_zero_copy, "Let AI write LPCM capture directly into the ALSA buffer.");
 
 
 struct rtksnd_dma_buf_attachment {
@@ -509,7 +517,9 @@ static int snd_realtek_hw_capture_init_ringheader_of_AI(struct snd_pcm_runtime *
 	return 0;
 }
 
-static int snd_realtek_hw_capture_init_LPCM_ringheader_of_AI(struct snd_pcm_runtime *runtime)
+// offset: where AI starts writing, only non-zero when reconnecting a zero copy ring
+static int __snd_realtek_hw_capture_init_LPCM_ringheader_of_AI(struct snd_pcm_runtime *runtime,
+			unsigned int offset)
 {
 	struct snd_card_RTK_capture_pcm *dpcm = runtime->private_data;
 	struct RINGBUFFER_HEADER *pAIRingHeader = &dpcm->nLPCMRing;
@@ -519,8 +529,8 @@ static int snd_realtek_hw_capture_init_LPCM_ringheader_of_AI(struct snd_pcm_runt
 	// init ring header
 	pAIRingHeader_LE->beginAddr = (unsigned int)dpcm->phy_pLPCMData;
 	pAIRingHeader_LE->size = dpcm->nLPCMRingSize;
-	pAIRingHeader_LE->readPtr[0] = pAIRingHeader_LE->beginAddr;
-	pAIRingHeader_LE->writePtr = pAIRingHeader_LE->beginAddr;
+	pAIRingHeader_LE->readPtr[0] = pAIRingHeader_LE->beginAddr + offset;
+	pAIRingHeader_LE->writePtr = pAIRingHeader_LE->beginAddr + offset;
 	pAIRingHeader_LE->numOfReadPtr = 1;
 
 	pAIRingHeader->beginAddr = htonl((unsigned int)pAIRingHeader_LE->beginAddr);
@@ -551,6 +561,11 @@ static int snd_realtek_hw_capture_init_LPCM_ringheader_of_AI(struct snd_pcm_runt
 	return 0;
 }
 
+static int snd_realtek_hw_capture_init_LPCM_ringheader_of_AI(struct snd_pcm_runtime *runtime)
+{
+	return __snd_realtek_hw_capture_init_LPCM_ringheader_of_AI(runtime, 0);
+}
+
 static int snd_realtek_hw_capture_init_PTS_ringheader_of_AI(struct snd_pcm_runtime *runtime)
 {
 	struct snd_card_RTK_capture_pcm *dpcm = runtime->private_data;
@@ -1177,6 +1192,18 @@ static int snd_realtek_hw_capture_malloc_lpcm_ring(struct snd_pcm_runtime *runti
 	void *vaddr;
 	size_t size = RTK_ENC_LPCM_BUFFER_SIZE;
 
+	if (dpcm->bZeroCopy) {
+		/* AI writes into the ALSA buffer, keep it alive until AI is destroyed */
+		dpcm->pZeroCopyBuf = runtime->dma_buffer_p->private_data;
+		get_dma_buf(dpcm->pZeroCopyBuf);
+
+		dpcm->phy_pLPCMData = runtime->dma_addr;
+		dpcm->pLPCMData = (unsigned int *)runtime->dma_area;
+		dpcm->nLPCMRingSize = frames_to_bytes(runtime, runtime->buffer_size);
+
+		return 0;
+	}
+
 	vaddr = dma_alloc_coherent(dev, size, &dat, GFP_KERNEL);
 
 	if (!vaddr) {
@@ -1193,6 +1220,41 @@ static int snd_realtek_hw_capture_malloc_lpcm_ring(struct snd_pcm_runtime *runti
 	return bMallocSuccess;
 }
 
+static void snd_realtek_hw_capture_put_zero_copy_buf(struct snd_card_RTK_capture_pcm *dpcm)
+{
+	dma_buf_put(dpcm->pZeroCopyBuf);
+	dpcm->pZeroCopyBuf = NULL;
+	dpcm->pLPCMData = NULL;
+	dpcm->phy_pLPCMData = 0;
+}
+
+/*
+ * Connect AI to ALSA. An AFW without zero copy support clears bZeroCopy,
+ * then swap the ALSA buffer for a private LPCM ring and connect again so
+ * the timer copies as usual.
+ */
+static int snd_realtek_hw_capture_connect_alsa(struct snd_pcm_runtime *runtime)
+{
+	struct snd_card_RTK_capture_pcm *dpcm = runtime->private_data;
+
+	if (RPC_TOAGENT_AI_CONNECT_ALSA_AFW(dpcm->phy_addr_rpc, dpcm->vaddr_rpc, runtime))
+		return -1;
+
+	if (!dpcm->pZeroCopyBuf || dpcm->bZeroCopy)
+		return 0;
+
+	pr_info("[ALSA %s %d] fall back to LPCM copy\n", __func__, __LINE__);
+	snd_realtek_hw_capture_put_zero_copy_buf(dpcm);
+
+	if (snd_realtek_hw_capture_malloc_lpcm_ring(runtime))
+		return -1;
+
+	if (snd_realtek_hw_capture_init_LPCM_ringheader_of_AI(runtime))
+		return -1;
+
+	return RPC_TOAGENT_AI_CONNECT_ALSA_AFW(dpcm->phy_addr_rpc, dpcm->vaddr_rpc, runtime);
+}
+
 static int snd_realtek_hw_capture_malloc_pts_ring(struct snd_pcm_runtime *runtime)
 {
 	struct snd_card_RTK_capture_pcm *dpcm = runtime->private_data;
@@ -1358,7 +1420,9 @@ static int snd_realtek_hw_capture_free_ring(struct snd_pcm_runtime *runtime)
 	}
 
 	// free AI lpcm ring
-	if (dpcm->pLPCMData) {
+	if (dpcm->pZeroCopyBuf) {
+		snd_realtek_hw_capture_put_zero_copy_buf(dpcm);
+	} else if (dpcm->pLPCMData) {
 		dat = dpcm->phy_pLPCMData;
 		vaddr = dpcm->pLPCMData;
 		size = dpcm->nLPCMRingSize;
@@ -1925,6 +1989,7 @@ static int snd_card_capture_open(struct snd_pcm_substream *substream)
 
 	// init hr timer
 	hrtimer_init(&dpcm->hr_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	INIT_WORK(&dpcm->zero_copy_work, snd_card_capture_zero_copy_work);
 
 	spin_lock_init(&capture_lock);
 
@@ -1961,6 +2026,8 @@ static int snd_card_capture_close(struct snd_pcm_substream *substream)
 
 	pr_info("[ALSA %s %d]\n", __func__, __LINE__);
 
+	cancel_work_sync(&dpcm->zero_copy_work);
+
 	if (dpcm->source_in == ENUM_AIN_AUDIO) {
 		if (RPC_TOAGENT_AI_DISCONNECT_ALSA_AUDIO_AFW(
 					dpcm->phy_addr_rpc, dpcm->vaddr_rpc, runtime)) {
@@ -2278,7 +2345,7 @@ static int snd_card_capture_prepare_LPCM_audio(struct snd_pcm_substream *substre
 	}
 
 	// private info
-	if (RPC_TOAGENT_AI_CONNECT_ALSA_AFW(dpcm->phy_addr_rpc, dpcm->vaddr_rpc, runtime)) {
+	if (snd_realtek_hw_capture_connect_alsa(runtime)) {
 		pr_err("[%s %d fail]\n", __func__, __LINE__);
 		return -ENOMEM;
 	}
@@ -2361,8 +2428,7 @@ static int snd_card_capture_prepare_LPCM(struct snd_pcm_substream *substream)
 	case ENUM_AIN_AUDIO_V3:
 	case ENUM_AIN_AUDIO_V4:
 		// For audio processing flow, doing connect alsa before config audio v2 or v3
-		if (RPC_TOAGENT_AI_CONNECT_ALSA_AFW(dpcm->phy_addr_rpc,
-					dpcm->vaddr_rpc, runtime)) {
+		if (snd_realtek_hw_capture_connect_alsa(runtime)) {
 			pr_err("[%s %d fail]\n", __func__, __LINE__);
 			return -ENOMEM;
 		}
@@ -2420,7 +2486,7 @@ static int snd_card_capture_prepare_LPCM(struct snd_pcm_substream *substream)
 	case ENUM_AIN_AUDIO_V4:
 		break;
 	default:
-		if (RPC_TOAGENT_AI_CONNECT_ALSA_AFW(dpcm->phy_addr_rpc, dpcm->vaddr_rpc, runtime)) {
+		if (snd_realtek_hw_capture_connect_alsa(runtime)) {
 			pr_err("[%s %d fail]\n", __func__, __LINE__);
 			return -ENOMEM;
 		}
@@ -2503,7 +2569,21 @@ static int snd_card_capture_prepare(struct snd_pcm_substream *substream)
 	}
 
 	if (dpcm->bInitRing) {
-		dpcm->nTotalWrite = 0;
+		if (dpcm->bZeroCopy) {
+			if (dpcm->phy_pLPCMData != runtime->dma_addr) {
+				/* hw_params brought a new buffer, move AI onto it */
+				pr_info("[zero copy buffer changed %s %d]\n", __func__, __LINE__);
+				cancel_work_sync(&dpcm->zero_copy_work);
+				dpcm->bZeroCopyStale = 0;
+				if (snd_card_capture_zero_copy_reconnect(runtime, 0))
+					return -ENOMEM;
+				dpcm->nTotalWrite = 0;
+			} else {
+				snd_card_capture_zero_copy_resync(runtime);
+			}
+		} else {
+			dpcm->nTotalWrite = 0;
+		}
 		pr_err("[Re-Prepare %d %d %s %d]\n",
 					(int)runtime->control->appl_ptr,
 					(int)runtime->status->hw_ptr,
@@ -2513,6 +2593,11 @@ static int snd_card_capture_prepare(struct snd_pcm_substream *substream)
 
 	dpcm->nPeriodBytes = frames_to_bytes(runtime, runtime->period_size);
 	dpcm->nFrameBytes = frames_to_bytes(runtime, 1);
+	dpcm->bZeroCopy = capture_zero_copy && runtime->dma_buffer_p &&
+		runtime->dma_buffer_p->private_data &&
+		dpcm->nAIFormat != AUDIO_ALSA_FORMAT_32BITS_BE_PCM;
+	if (dpcm->bZeroCopy)
+		pr_info("[ALSA capture zero copy]\n");
 
 	switch (dpcm->nAIFormat) {
 	case AUDIO_ALSA_FORMAT_32BITS_BE_PCM:
@@ -2817,6 +2902,106 @@ exit:
 	return;
 }
 
+/*
+ * In zero copy mode the LPCM ring and the ALSA buffer are the same memory.
+ * LE readPtr tracks what has been reported as hw_ptr, while the BE readPtr
+ * seen by AI follows appl_ptr so AI never overwrites unread frames.
+ */
+static void snd_card_capture_zero_copy_release(struct snd_pcm_runtime *runtime)
+{
+	struct snd_card_RTK_capture_pcm *dpcm = runtime->private_data;
+	snd_pcm_uframes_t appl = runtime->control->appl_ptr % runtime->buffer_size;
+
+	dpcm->nLPCMRing.readPtr[0] = htonl(dpcm->nLPCMRing_LE.beginAddr +
+		frames_to_bytes(runtime, appl));
+}
+
+/* After re-prepare, line hw_ptr up with where AI is in the shared ring */
+static void snd_card_capture_zero_copy_resync(struct snd_pcm_runtime *runtime)
+{
+	struct snd_card_RTK_capture_pcm *dpcm = runtime->private_data;
+	unsigned int offset;
+
+	offset = dpcm->nLPCMRing_LE.readPtr[0] - dpcm->nLPCMRing_LE.beginAddr;
+	dpcm->nTotalWrite = offset / dpcm->nFrameBytes;
+
+	// frames before the ring position have no valid data, hand out silence
+	memset(runtime->dma_area, 0, offset);
+	snd_card_capture_zero_copy_release(runtime);
+}
+
+/* AUDIO sources are started by the AFW flow, the others by capture_run */
+static bool snd_card_capture_ai_is_run(struct snd_card_RTK_capture_pcm *dpcm)
+{
+	switch (dpcm->source_in) {
+	case ENUM_AIN_AUDIO:
+	case ENUM_AIN_AUDIO_V2:
+	case ENUM_AIN_AUDIO_V3:
+	case ENUM_AIN_AUDIO_V4:
+		return false;
+	default:
+		return true;
+	}
+}
+
+/*
+ * Point AI at the current ALSA buffer again, writing from offset on. Used
+ * when hw_params swapped the buffer and after injected HDMI-RX silence
+ * moved hw_ptr away from where AI would write next.
+ */
+static int snd_card_capture_zero_copy_reconnect(struct snd_pcm_runtime *runtime,
+			unsigned int offset)
+{
+	struct snd_card_RTK_capture_pcm *dpcm = runtime->private_data;
+	bool run = snd_card_capture_ai_is_run(dpcm);
+
+	if (run && RPC_TOAGENT_PAUSE_SVC_AFW(dpcm->phy_addr_rpc, dpcm->vaddr_rpc,
+					    dpcm->AIAgentID)) {
+		pr_err("[%s %d fail]\n", __func__, __LINE__);
+		return -1;
+	}
+
+	if (dpcm->phy_pLPCMData != runtime->dma_addr) {
+		snd_realtek_hw_capture_put_zero_copy_buf(dpcm);
+		if (snd_realtek_hw_capture_malloc_lpcm_ring(runtime)) {
+			pr_err("[%s %d fail]\n", __func__, __LINE__);
+			return -1;
+		}
+	}
+
+	if (__snd_realtek_hw_capture_init_LPCM_ringheader_of_AI(runtime, offset) ||
+	    snd_realtek_hw_capture_connect_alsa(runtime)) {
+		pr_err("[%s %d fail]\n", __func__, __LINE__);
+		return -1;
+	}
+
+	if (dpcm->bZeroCopy)
+		snd_card_capture_zero_copy_release(runtime);
+
+	if (run && snd_realtek_hw_capture_run(dpcm)) {
+		pr_err("[%s %d fail]\n", __func__, __LINE__);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void snd_card_capture_zero_copy_work(struct work_struct *work)
+{
+	struct snd_card_RTK_capture_pcm *dpcm =
+		container_of(work, struct snd_card_RTK_capture_pcm, zero_copy_work);
+	struct snd_pcm_runtime *runtime = dpcm->substream->runtime;
+	unsigned int offset;
+
+	// the timer holds hw_ptr still until this is done
+	offset = frames_to_bytes(runtime, dpcm->nTotalWrite % runtime->buffer_size);
+	if (snd_card_capture_zero_copy_reconnect(runtime, offset))
+		pr_err("[ALSA %s %d] zero copy reconnect fail\n", __func__, __LINE__);
+
+	// plugged out again meanwhile: leave it for the next reconnect
+	cmpxchg(&dpcm->bZeroCopyStale, 2, 0);
+}
+
 static void snd_card_capture_LPCM_copy(struct snd_pcm_runtime *runtime, long nPeriodCount)
 {
 	struct snd_card_RTK_capture_pcm *dpcm = runtime->private_data;
@@ -2917,15 +3102,36 @@ static enum hrtimer_restart snd_card_capture_lpcm_timer_function(struct hrtimer
 				, (int)runtime->buffer_size, __func__, __LINE__);
 		}
 
+		if (dpcm->bZeroCopy)
+			snd_card_capture_zero_copy_release(runtime);
+
 		// check if HDMI-RX plug out
 		if (dpcm->source_in == ENUM_AIN_HDMIRX) {
 			if (snd_realtek_capture_check_hdmirx_enable() == 0) {
+				/* silence lands in the shared ring, AI is reconnected past it */
+				if (dpcm->bZeroCopy)
+					dpcm->bZeroCopyStale = 1;
 				snd_card_capture_handle_HDMI_plug_out(substream);
 				goto SET_TIMER;
 			}
 		}
 
-		nRingDataSize = snd_card_get_ring_data(&dpcm->nLPCMRing, &dpcm->nLPCMRing_LE);
+		if (dpcm->bZeroCopyStale) {
+			if (dpcm->bZeroCopyStale == 1) {
+				dpcm->bZeroCopyStale = 2;
+				schedule_work(&dpcm->zero_copy_work);
+			}
+			goto SET_TIMER;
+		}
+
+		if (dpcm->bZeroCopy)
+			nRingDataSize = ring_valid_data(
+				(unsigned long)dpcm->nLPCMRing_LE.beginAddr,
+				(unsigned long)(dpcm->nLPCMRing_LE.beginAddr + dpcm->nLPCMRing_LE.size),
+				(unsigned long)dpcm->nLPCMRing_LE.readPtr[0],
+				(unsigned long)ntohl(dpcm->nLPCMRing.writePtr));
+		else
+			nRingDataSize = snd_card_get_ring_data(&dpcm->nLPCMRing, &dpcm->nLPCMRing_LE);
 		nRingDataFrame = nRingDataSize / dpcm->nFrameBytes;
 		if (nRingDataFrame >= runtime->period_size) {
 			nPeriodCount = nRingDataFrame / runtime->period_size;
@@ -2946,7 +3152,8 @@ static enum hrtimer_restart snd_card_capture_lpcm_timer_function(struct hrtimer
 			}
 
 			// copy data from LPCM_ring to dma_buf
-			snd_card_capture_LPCM_copy(runtime, nPeriodCount);
+			if (!dpcm->bZeroCopy)
+				snd_card_capture_LPCM_copy(runtime, nPeriodCount);
 
 #ifdef CAPTURE_USE_PTS_RING
 			// calculate PTS
@@ -2969,7 +3176,8 @@ static enum hrtimer_restart snd_card_capture_lpcm_timer_function(struct hrtimer
 				, (unsigned long)(dpcm->nLPCMRing_LE.beginAddr + dpcm->nLPCMRing_LE.size)
 				, (unsigned long)(dpcm->nLPCMRing_LE.readPtr[0])
 				, nPeriodCount * runtime->period_size * dpcm->nFrameBytes);
-			dpcm->nLPCMRing.readPtr[0] = htonl(dpcm->nLPCMRing_LE.readPtr[0]);
+			if (!dpcm->bZeroCopy)
+				dpcm->nLPCMRing.readPtr[0] = htonl(dpcm->nLPCMRing_LE.readPtr[0]);
 
 			dpcm->nTotalWrite += nPeriodCount * runtime->period_size;
 
@@ -67,6 +67,9 @@ extern struct rtk_krpc_ept_info *acpu_ept_info;
 #define RTK_ENC_LPCM_BUFFER_SIZE        (32*1024)
 #define RTK_ENC_PTS_BUFFER_SIZE         (8*1024)
 
+/* privateInfo[4] of AI_CONNECT_ALSA: LPCM ring is the ALSA buffer itself */
+#define RTK_AI_ALSA_ZERO_COPY           (0x1)
+
 enum {
 	ENUM_AIN_HDMIRX = 0,
 	ENUM_AIN_I2S,  // from ADC outside of IC
@@ -574,6 +577,10 @@ struct snd_card_RTK_capture_pcm {
 	unsigned int nFrameBytes;
 	unsigned int nRingSize; // bytes
 	unsigned int nLPCMRingSize;
+	int bZeroCopy;                  // AI writes LPCM into the ALSA buffer
+	struct dma_buf *pZeroCopyBuf;   // ALSA buffer held while AI owns it
+	int bZeroCopyStale;             // 1: HDMI-RX plugged out, 2: reconnect queued
+	struct work_struct zero_copy_work;
 	phys_addr_t phy_pAIRingData[8]; //physical address of ai data
 	phys_addr_t phy_pLPCMData;      //physical address of lpcm data
 	phys_addr_t phy_addr;           //physical addresss of struct snd_card_RTK_capture_pcm;
@@ -1286,6 +1286,10 @@ int RPC_TOAGENT_AI_CONNECT_ALSA_AFW(phys_addr_t paddr, void *vaddr,
 		break;
 	}
 
+	// LPCM ring is the ALSA buffer: keep native endian, honor rp strictly
+	if (dpcm->bZeroCopy)
+		cmd->privateInfo[4] = htonl(RTK_AI_ALSA_ZERO_COPY);
+
 	if (send_rpc(acpu_ept_info,
 		ENUM_KERNEL_RPC_PRIVATEINFO,
 		CONVERT_FOR_AVCPU(dat),
@@ -1300,6 +1304,13 @@ int RPC_TOAGENT_AI_CONNECT_ALSA_AFW(phys_addr_t paddr, void *vaddr,
 		goto exit;
 	}
 
+	/* the caller sees bZeroCopy cleared and moves AI to a copy ring */
+	if (dpcm->bZeroCopy &&
+	    !(ntohl(res->privateInfo[0]) & RTK_AI_ALSA_ZERO_COPY)) {
+		pr_info("[ALSA %s %d] AFW did not ack zero copy\n", __func__, __LINE__);
+		dpcm->bZeroCopy = 0;
+	}
+
 	pr_info("[%s %s %d] success\n", __FILE__, __func__, __LINE__);
 	ret = 0;
 exit: